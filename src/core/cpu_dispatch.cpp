@@ -0,0 +1,399 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#include "core/cpu_dispatch.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH_X86
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512dq,avx2,fma")))
+#else
+// no per function target attributes (MSVC, non x86), everything runs the baseline path
+#define KERNEL_INLINE inline
+#endif
+
+//-----------------------------------------------------------------------------
+// Kernel bodies. Plain loops the compiler vectorizes for whatever target the wrapper that inlines them has.
+//-----------------------------------------------------------------------------
+
+// cephes expf, ~1 ulp. Bit trick for 2^n instead of ldexp so it vectorizes. Underflow goes to 0.
+KERNEL_INLINE float kernel_exp(float x)
+{
+    const bool underflow = x < -87.3f;
+    x = x < -87.3f ? -87.3f : x;
+    x = x > 88.0f ? 88.0f : x;
+    const float fx = x * 1.44269504088896341f + 0.5f;
+    int32_t n = (int32_t)fx;
+    n -= ((float)n > fx) ? 1 : 0;
+    const float fn = (float)n;
+    x = x - fn * 0.693359375f;
+    x = x - fn * -2.12194440e-4f;
+    const float z = x * x;
+    float y = 1.9875691500E-4f;
+    y = y * x + 1.3981999507E-3f;
+    y = y * x + 8.3334519073E-3f;
+    y = y * x + 4.1665795894E-2f;
+    y = y * x + 1.6666665459E-1f;
+    y = y * x + 5.0000001201E-1f;
+    y = y * z + x + 1.0f;
+    const int32_t bits = underflow ? 0 : (n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return y * scale;
+}
+
+// cephes exp, Pade form, ~1 ulp
+KERNEL_INLINE double kernel_exp(double x)
+{
+    const bool underflow = x < -708.0;
+    x = x < -708.0 ? -708.0 : x;
+    x = x > 709.0 ? 709.0 : x;
+    const double fx = x * 1.4426950408889634073599 + 0.5;
+    int32_t n = (int32_t)fx;
+    n -= ((double)n > fx) ? 1 : 0;
+    const double fn = (double)n;
+    x = x - fn * 6.93145751953125E-1;
+    x = x - fn * 1.42860682030941723212E-6;
+    const double xx = x * x;
+    const double px = x * ((1.26177193074810590878E-4 * xx + 3.02994407707441961300E-2) * xx + 9.99999999999999999910E-1);
+    const double qx = ((3.00198505138664455042E-6 * xx + 2.52448340349684104192E-3) * xx + 2.27265548208155028766E-1) * xx + 2.00000000000000000009E0;
+    const double y = 1.0 + 2.0 * px / (qx - px);
+    const int64_t bits = underflow ? 0 : (int64_t)(n + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(double));
+    return y * scale;
+}
+
+// Numerical Recipes erfcc, fractional error < 1.2e-7, enough for float
+KERNEL_INLINE float kernel_erfc(float x)
+{
+    const float z = std::abs(x);
+    const float t = 1.0f / (1.0f + 0.5f * z);
+    float poly = 0.17087277f;
+    poly = -0.82215223f + t * poly;
+    poly = 1.48851587f + t * poly;
+    poly = -1.13520398f + t * poly;
+    poly = 0.27886807f + t * poly;
+    poly = -0.18628806f + t * poly;
+    poly = 0.09678418f + t * poly;
+    poly = 0.37409196f + t * poly;
+    poly = 1.00002368f + t * poly;
+    poly = -1.26551223f + t * poly;
+    const float r = t * kernel_exp(poly - z * z);
+    return x >= 0.0f ? r : 2.0f - r;
+}
+
+// cephes erfc, rational fits of erf below 1, erfc below 8 and above. All three are evaluated and one selected so the
+// loops stay branch free.
+KERNEL_INLINE double kernel_erfc(double a)
+{
+    const double x = std::abs(a);
+    const double z = a * a;
+
+    // 1 - erf(a), |a| < 1
+    double tn = 9.60497373987051638749E0;
+    tn = tn * z + 9.00260197203842689217E1;
+    tn = tn * z + 2.23200534594684319226E3;
+    tn = tn * z + 7.00332514112805075473E3;
+    tn = tn * z + 5.55923013010394962768E4;
+    double ud = z + 3.35617141647503099647E1;
+    ud = ud * z + 5.21357949780152679795E2;
+    ud = ud * z + 4.59432382970980127987E3;
+    ud = ud * z + 2.26290000613890934246E4;
+    ud = ud * z + 4.92673942608635921086E4;
+    const double small = 1.0 - (a * tn / ud);
+
+    // 1 <= |a| < 8
+    double pn = 2.46196981473530512524E-10;
+    pn = pn * x + 5.64189564831068821977E-1;
+    pn = pn * x + 7.46321056442269912687E0;
+    pn = pn * x + 4.86371970985681366614E1;
+    pn = pn * x + 1.96520832956077098242E2;
+    pn = pn * x + 5.26445194995477358631E2;
+    pn = pn * x + 9.34528527171957607540E2;
+    pn = pn * x + 1.02755188689515710272E3;
+    pn = pn * x + 5.57535335369399327526E2;
+    double qd = x + 1.32281951154744992508E1;
+    qd = qd * x + 8.67072140885989742329E1;
+    qd = qd * x + 3.54937778887819891062E2;
+    qd = qd * x + 9.75708501743205489753E2;
+    qd = qd * x + 1.82390916687909736289E3;
+    qd = qd * x + 2.24633760818710981792E3;
+    qd = qd * x + 1.65666309194161350182E3;
+    qd = qd * x + 5.57535340817727675546E2;
+
+    // |a| >= 8
+    double rn = 5.64189583547755073984E-1;
+    rn = rn * x + 1.27536670759978104416E0;
+    rn = rn * x + 5.01905042251180477414E0;
+    rn = rn * x + 6.16021097993053585195E0;
+    rn = rn * x + 7.40974269950448939160E0;
+    rn = rn * x + 2.97886665372100240670E0;
+    double sd = x + 2.26052863220117276590E0;
+    sd = sd * x + 9.39603524938001434673E0;
+    sd = sd * x + 1.20489539808096656605E1;
+    sd = sd * x + 1.70814450747565897222E1;
+    sd = sd * x + 9.60896809063285878198E0;
+    sd = sd * x + 3.36907645100081516050E0;
+
+    const bool mid = x < 8.0;
+    // exp underflows to 0 past |a| ~ 26.6, which gives 0 or 2
+    double large = kernel_exp(-z) * (mid ? pn : rn) / (mid ? qd : sd);
+    large = a < 0.0 ? 2.0 - large : large;
+    return x < 1.0 ? small : large;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real, typename T_src>
+KERNEL_INLINE void accumulate_impl(T_real* dst, const T_src* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] += (T_real)src[i];
+    }
+}
+
+template<typename T_real>
+KERNEL_INLINE void axpy_impl(T_real* dst, T_real a, const T_real* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] += a * src[i];
+    }
+}
+
+template<typename T_real>
+KERNEL_INLINE T_real dot_impl(const T_real* a, const T_real* b, size_t n)
+{
+    T_real sum = (T_real)0.0;
+#pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+template<typename T_real>
+KERNEL_INLINE void residual_impl(T_real* out, const T_real* spectra, const T_real* model, const T_real* weights, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = (spectra[i] - model[i]) * weights[i];
+    }
+}
+
+// one loop per combination of shapes so the unused erfc's are not evaluated
+template<typename T_real, bool STEP, bool TAIL>
+KERNEL_INLINE void line_shape_loop(T_real* counts, const T_real* ev, size_t n, T_real peak_E, T_real inv_sigma, T_real peak_scale, T_real step_scale, T_real tail_scale, T_real inv_gamma)
+{
+    const T_real tail_offset = inv_gamma * (T_real)M_SQRT1_2;
+    for (size_t i = 0; i < n; i++)
+    {
+        const T_real x = (ev[i] - peak_E) * inv_sigma;
+        T_real c = peak_scale * kernel_exp((T_real)-0.5 * x * x);
+        if (STEP)
+        {
+            c += step_scale * kernel_erfc(x * (T_real)M_SQRT1_2);
+        }
+        if (TAIL)
+        {
+            c += tail_scale * kernel_exp((x < (T_real)0.0 ? x : (T_real)0.0) * inv_gamma) * kernel_erfc(x * (T_real)M_SQRT1_2 + tail_offset);
+        }
+        counts[i] += c;
+    }
+}
+
+template<typename T_real>
+KERNEL_INLINE void line_shape_impl(T_real* counts, const T_real* ev, size_t n, T_real peak_E, T_real inv_sigma, T_real peak_scale, T_real step_scale, T_real tail_scale, T_real inv_gamma)
+{
+    const bool step = step_scale != (T_real)0.0;
+    const bool tail = tail_scale != (T_real)0.0;
+    if (step && tail)
+    {
+        line_shape_loop<T_real, true, true>(counts, ev, n, peak_E, inv_sigma, peak_scale, step_scale, tail_scale, inv_gamma);
+    }
+    else if (step)
+    {
+        line_shape_loop<T_real, true, false>(counts, ev, n, peak_E, inv_sigma, peak_scale, step_scale, tail_scale, inv_gamma);
+    }
+    else if (tail)
+    {
+        line_shape_loop<T_real, false, true>(counts, ev, n, peak_E, inv_sigma, peak_scale, step_scale, tail_scale, inv_gamma);
+    }
+    else
+    {
+        line_shape_loop<T_real, false, false>(counts, ev, n, peak_E, inv_sigma, peak_scale, step_scale, tail_scale, inv_gamma);
+    }
+}
+
+template<typename T_real>
+KERNEL_INLINE void erfc_impl(T_real* out, const T_real* x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = kernel_erfc(x[i]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// One wrapper per kernel and path. The bodies are inlined into each so they get compiled for that target.
+//-----------------------------------------------------------------------------
+
+#define DEFINE_KERNEL_PATH(TARGET, SUFFIX) \
+template<typename T_real> TARGET void accumulate_##SUFFIX(T_real* dst, const T_real* src, size_t n) { accumulate_impl(dst, src, n); } \
+template<typename T_real> TARGET void accumulate_cvt_##SUFFIX(T_real* dst, const Other_Real<T_real>* src, size_t n) { accumulate_impl(dst, src, n); } \
+template<typename T_real> TARGET void axpy_##SUFFIX(T_real* dst, T_real a, const T_real* src, size_t n) { axpy_impl(dst, a, src, n); } \
+template<typename T_real> TARGET T_real dot_##SUFFIX(const T_real* a, const T_real* b, size_t n) { return dot_impl(a, b, n); } \
+template<typename T_real> TARGET void residual_##SUFFIX(T_real* out, const T_real* spectra, const T_real* model, const T_real* weights, size_t n) \
+    { residual_impl(out, spectra, model, weights, n); } \
+template<typename T_real> TARGET void line_shape_##SUFFIX(T_real* counts, const T_real* ev, size_t n, T_real peak_E, T_real inv_sigma, T_real peak_scale, T_real step_scale, T_real tail_scale, T_real inv_gamma) \
+    { line_shape_impl(counts, ev, n, peak_E, inv_sigma, peak_scale, step_scale, tail_scale, inv_gamma); } \
+template<typename T_real> TARGET void erfc_##SUFFIX(T_real* out, const T_real* x, size_t n) { erfc_impl(out, x, n); } \
+template<typename T_real> CPU_Kernels<T_real> kernels_##SUFFIX() \
+{ \
+    CPU_Kernels<T_real> k; \
+    k.accumulate = &accumulate_##SUFFIX<T_real>; \
+    k.accumulate_cvt = &accumulate_cvt_##SUFFIX<T_real>; \
+    k.axpy = &axpy_##SUFFIX<T_real>; \
+    k.dot = &dot_##SUFFIX<T_real>; \
+    k.residual = &residual_##SUFFIX<T_real>; \
+    k.line_shape = &line_shape_##SUFFIX<T_real>; \
+    k.erfc = &erfc_##SUFFIX<T_real>; \
+    return k; \
+}
+
+DEFINE_KERNEL_PATH(, baseline)
+
+#ifdef CPU_DISPATCH_X86
+DEFINE_KERNEL_PATH(TARGET_AVX2, avx2)
+DEFINE_KERNEL_PATH(TARGET_AVX512, avx512)
+#endif
+
+// ----------------------------------------------------------------------------
+
+static CPU_PATH detect_cpu_path()
+{
+#ifdef CPU_DISPATCH_X86
+    // also checks that the os saves the wide registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+    {
+        return CPU_PATH::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return CPU_PATH::AVX2;
+    }
+#endif
+    return CPU_PATH::BASELINE;
+}
+
+// ----------------------------------------------------------------------------
+
+CPU_PATH cpu_path()
+{
+    static const CPU_PATH path = detect_cpu_path();
+    return path;
+}
+
+// ----------------------------------------------------------------------------
+
+const char* cpu_path_name(CPU_PATH path)
+{
+    switch (path)
+    {
+    case CPU_PATH::AVX512:
+        return "AVX-512";
+    case CPU_PATH::AVX2:
+        return "AVX2";
+    default:
+#if defined(__x86_64__) || defined(_M_X64)
+        return "SSE2";
+#else
+        return "baseline";
+#endif
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+static CPU_Kernels<T_real> select_kernels(CPU_PATH path)
+{
+#ifdef CPU_DISPATCH_X86
+    if (path == CPU_PATH::AVX512)
+    {
+        return kernels_avx512<T_real>();
+    }
+    if (path == CPU_PATH::AVX2)
+    {
+        return kernels_avx2<T_real>();
+    }
+#endif
+    return kernels_baseline<T_real>();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+const CPU_Kernels<T_real>& cpu_kernels()
+{
+    static const CPU_Kernels<T_real> kernels = select_kernels<T_real>(cpu_path());
+    return kernels;
+}
+
+// ----------------------------------------------------------------------------
+
+template DLL_EXPORT const CPU_Kernels<float>& cpu_kernels<float>();
+template DLL_EXPORT const CPU_Kernels<double>& cpu_kernels<double>();
+
+
@@ -0,0 +1,110 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include "core/defines.h"
+#include <cstddef>
+#include <type_traits>
+
+//-----------------------------------------------------------------------------
+
+/**
+ * @brief The CPU_PATH enum : instruction set the hot kernels run with. Picked once at startup from what the cpu
+ *        supports, so one portable build runs on every node. BASELINE is what the compiler targets by default
+ *        (SSE2 on x86-64).
+ */
+enum class CPU_PATH { BASELINE, AVX2, AVX512 };
+
+/**
+ * @brief Other_Real : the other floating point type, double for float and float for double
+ */
+template<typename T_real>
+using Other_Real = typename std::conditional<std::is_same<T_real, float>::value, double, float>::type;
+
+/**
+ * @brief The CPU_Kernels struct : dispatch table of the hot loops, filled with the best path for this cpu.
+ *        accumulate : dst += src
+ *        accumulate_cvt : dst += src, src in the other precision (float into double or double into float)
+ *        axpy : dst += a * src
+ *        dot : sum(a * b)
+ *        residual : out = (spectra - model) * weights
+ *        line_shape : counts += gauss peak + step + tail of one emission line at peak_E, evaluated on ev with the
+ *                     erfc kernel. step_scale or tail_scale of 0 leaves that shape out.
+ *        erfc : out = erfc(x), Numerical Recipes Chebyshev fit for float, cephes rational fits for double
+ */
+template<typename T_real>
+struct DLL_EXPORT CPU_Kernels
+{
+    void (*accumulate)(T_real* dst, const T_real* src, size_t n);
+
+    void (*accumulate_cvt)(T_real* dst, const Other_Real<T_real>* src, size_t n);
+
+    void (*axpy)(T_real* dst, T_real a, const T_real* src, size_t n);
+
+    T_real (*dot)(const T_real* a, const T_real* b, size_t n);
+
+    void (*residual)(T_real* out, const T_real* spectra, const T_real* model, const T_real* weights, size_t n);
+
+    void (*line_shape)(T_real* counts, const T_real* ev, size_t n, T_real peak_E, T_real inv_sigma, T_real peak_scale, T_real step_scale, T_real tail_scale, T_real inv_gamma);
+
+    void (*erfc)(T_real* out, const T_real* x, size_t n);
+};
+
+/**
+ * @brief cpu_path : best path the running cpu supports, detected on first call
+ */
+DLL_EXPORT CPU_PATH cpu_path();
+
+DLL_EXPORT const char* cpu_path_name(CPU_PATH path);
+
+/**
+ * @brief cpu_kernels : dispatch table for cpu_path()
+ */
+template<typename T_real>
+DLL_EXPORT const CPU_Kernels<T_real>& cpu_kernels();
+
+#endif // CPU_DISPATCH_H
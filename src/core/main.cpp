@@ -48,7 +48,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "core/command_line_parser.h"
 #include "core/process_streaming.h"
 #include "core/process_whole.h"
+#include "core/cpu_dispatch.h"
 #include <cctype>
+#include <omp.h>
 
 // ----------------------------------------------------------------------------
 
@@ -69,11 +71,14 @@ void help()
 	logit_s << "--update-amps <us_amp>,<ds_amp>: Updates upstream and downstream amps if they changed inbetween scans.\n";
 	logit_s << "--update-quant-amps <us_amp>,<ds_amp>: Updates upstream and downstream amps for quantification if they changed inbetween scans.\n";
     logit_s<<"--quick-and-dirty : Integrate the detector range into 1 spectra.\n";
-//	logit_s<< "--mem-limit <limit> : Limit the memory usage. Append M for megabytes or G for gigabytes\n";
+    logit_s<<"--mem-limit <limit> : Limit the memory usage. Append M for megabytes or G for gigabytes. Defaults to the available memory (cgroup limit aware)\n";
+    logit_s<<"--compression <filter> : hdf5 output compression: none, deflate:<0-9>, lz4, zstd:<1-22>, blosc:<0-9>. Prefix with shuffle+ to shuffle bytes first. Default deflate:7. lz4, zstd, and blosc need hdf5 plugins in HDF5_PLUGIN_PATH \n";
+    logit_s<<"--spectra-compression <filter> : Same as --compression but only for the spectra volume (mca_arr). ex: shuffle+zstd:3 \n";
     logit_s<<"--optimize-fit-override-params : <int> Integrate the 8 largest mda datasets and fit with multiple params.\n"<<
                "  1 = matrix batch fit\n  2 = batch fit without tails\n  3 = batch fit with tails\n  4 = batch fit with free E, everything else fixed \n";
     logit_s<<"--optimize-fit-routine : <general,hybrid> General (default): passes elements amplitudes as fit parameters. Hybrid only passes fit parameters and fits element amplitudes using NNLS\n";
     logit_s<<"--optimizer <lmfit, mpfit> : Choose which optimizer to use for --optimize-fit-override-params or matrix fit routine \n";
+    logit_s<<"--fit-batch-size <int> : Fit matrix pixels in blocks of this size with the batched lm solver, ignores --optimizer. Num_Iter maps then count LM steps (analytic jacobian) instead of optimizer function evaluations. Default 1 (off) \n";
     logit_s<<"--optimize-rois : Looks in 'rois' directory and performs --optimize-fit-override-params on each roi separately. \n";
     logit_s<<"Fitting Routines: \n";
 	logit_s<< "--fit <routines,> comma seperated \n";
@@ -110,6 +115,11 @@ void set_optimizer(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>&
         analysis_job.set_optimizer(clp.get_option("--optimizer"));
     }
 
+    if (clp.option_exists("--fit-batch-size"))
+    {
+        analysis_job.fit_batch_size = std::max(1, std::stoi(clp.get_option("--fit-batch-size")));
+    }
+
     if (clp.option_exists("--optimize-fit-routine"))
     {
         std::string opt = clp.get_option("--optimize-fit-routine");
@@ -129,19 +139,30 @@ void set_mem_limit(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>&
     if (clp.option_exists("--mem-limit"))
     {
         std::string memlimit = clp.get_option("--mem-limit");
-        if (memlimit.rfind('M'))
+        long long scale = 0;
+        if (memlimit.length() > 1 && (memlimit.back() == 'M' || memlimit.back() == 'm'))
         {
-
+            scale = 1024LL * 1024LL;
         }
-        else if (memlimit.rfind('G'))
+        else if (memlimit.length() > 1 && (memlimit.back() == 'G' || memlimit.back() == 'g'))
         {
-
+            scale = 1024LL * 1024LL * 1024LL;
         }
-        else
+        try
+        {
+            if (scale > 0)
+            {
+                analysis_job.mem_limit = (long long)(std::stod(memlimit.substr(0, memlimit.length() - 1)) * scale);
+            }
+        }
+        catch (...)
+        {
+            scale = 0;
+        }
+        if (scale == 0)
         {
             logW << "Could not parse --mem-limit parameter. Make sure to use M for megabytes or G for gigabytes. ex 200M\n";
         }
-        //analysis_job.mem_limit = ;
     }
 }
 
@@ -154,6 +175,40 @@ void set_num_threads(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>
     {
         analysis_job.num_threads = std::stoi(clp.get_option("--nthreads"));
     }
+    // openmp regions follow the same thread count as the thread pools
+    omp_set_num_threads((int)analysis_job.num_threads);
+}
+
+// ----------------------------------------------------------------------------
+
+template <typename T_real>
+void set_compression(Command_Line_Parser& clp, data_struct::Analysis_Job<T_real>& analysis_job)
+{
+    io::file::H5_Compression h5_compression;
+    if (clp.option_exists("--compression"))
+    {
+        analysis_job.compression = clp.get_option("--compression");
+        if (io::file::parse_h5_compression(analysis_job.compression, h5_compression))
+        {
+            io::file::HDF5_IO::inst()->set_compression(h5_compression);
+        }
+        else
+        {
+            analysis_job.compression = "";
+        }
+    }
+    if (clp.option_exists("--spectra-compression"))
+    {
+        analysis_job.spectra_compression = clp.get_option("--spectra-compression");
+        if (io::file::parse_h5_compression(analysis_job.spectra_compression, h5_compression))
+        {
+            io::file::HDF5_IO::inst()->set_dataset_compression("mca_arr", h5_compression);
+        }
+        else
+        {
+            analysis_job.spectra_compression = "";
+        }
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -409,6 +464,7 @@ int set_general_options(Command_Line_Parser& clp, data_struct::Analysis_Job<T_re
     set_num_threads(clp, analysis_job);
     set_detectors(clp, analysis_job);
     set_optimizer(clp, analysis_job);
+    set_compression(clp, analysis_job);
     set_whole_command(clp, analysis_job);
     return set_dir_and_files(clp, analysis_job);
 }
@@ -740,6 +796,7 @@ int main(int argc, char* argv[])
         whole_command_line += std::string(argv[i]) + " ";
     }
     logI << whole_command_line << "\n";
+    logI << "Using " << cpu_path_name(cpu_path()) << " kernels\n";
 
     //Performance measure
     std::chrono::time_point<std::chrono::system_clock> start, end;
@@ -747,6 +804,7 @@ int main(int argc, char* argv[])
     //////// HENKE and ELEMENT INFO /////////////
     const std::string element_csv_filename = "../reference/xrf_library.csv";
     const std::string element_henke_filename = "../reference/henke.xdr";
+    const std::string element_cache_filename = "../reference/element_info.bin";
     const std::string scaler_lookup_yaml = "../reference/Scaler_to_PV_map.yaml";
 
     start = std::chrono::system_clock::now();
@@ -758,12 +816,7 @@ int main(int argc, char* argv[])
     }
 
     //load element information
-    if (false == io::file::load_element_info<float>(element_henke_filename, element_csv_filename))
-    {
-        logE << "loading element information: " << "\n";
-        return -1;
-    }
-    if (false == io::file::load_element_info<double>(element_henke_filename, element_csv_filename))
+    if (false == io::file::load_element_info_cached(element_henke_filename, element_csv_filename, element_cache_filename))
     {
         logE << "loading element information: " << "\n";
         return -1;
@@ -45,6 +45,133 @@ POSSIBILITY OF SUCH DAMAGE.
 
 /// Initial Author <2019>: Arthur Glowacki
 #include "mem_info.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// cgroup v1 reports no limit as a huge page aligned number
+#define CGROUP_NO_LIMIT (1LL << 60)
+// queued task and future of one pixel fit job
+#define PIXEL_JOB_BYTES 256
+// Spectra object, counters and allocation overhead besides the channels
+#define SPECTRA_OVERHEAD_BYTES 64
+// fraction of the available memory we plan to use
+#define MEM_HEADROOM 0.9
+
+// ----------------------------------------------------------------------------
+
+#if !defined _WIN32 && !defined __CYGWIN__
+
+static long long read_mem_value(const std::string& path)
+{
+	std::ifstream in(path);
+	std::string value;
+	if (!(in >> value) || value == "max")
+	{
+		return -1;
+	}
+	try
+	{
+		return std::stoll(value);
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static long long read_mem_stat(const std::string& path, const std::string& key)
+{
+	std::ifstream in(path);
+	std::string name;
+	long long value;
+	while (in >> name >> value)
+	{
+		if (name == key)
+		{
+			return value;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+// memory cgroup path of this process, v2 unified or v1 memory controller
+static bool find_mem_cgroup(std::string& path, bool& is_v2)
+{
+	std::ifstream in("/proc/self/cgroup");
+	std::string line;
+	bool found = false;
+	while (std::getline(in, line))
+	{
+		size_t first = line.find(':');
+		size_t second = line.find(':', first + 1);
+		if (first == std::string::npos || second == std::string::npos)
+		{
+			continue;
+		}
+		std::string controllers = "," + line.substr(first + 1, second - first - 1) + ",";
+		if (controllers.find(",memory,") != std::string::npos)
+		{
+			path = line.substr(second + 1);
+			is_v2 = false;
+			return true;
+		}
+		if (line.compare(0, 3, "0::") == 0)
+		{
+			path = line.substr(second + 1);
+			is_v2 = true;
+			found = true;
+		}
+	}
+	return found;
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+long long get_cgroup_free_mem()
+{
+#if defined _WIN32 || defined __CYGWIN__
+	return -1;
+#else
+	std::string cgroup_path;
+	bool is_v2 = false;
+	if (false == find_mem_cgroup(cgroup_path, is_v2))
+	{
+		return -1;
+	}
+	// containers with a cgroup namespace see their own group mounted at the root
+	std::string base = is_v2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/memory";
+	std::string dir = base + cgroup_path;
+	std::string limit_file = is_v2 ? "/memory.max" : "/memory.limit_in_bytes";
+	long long limit = read_mem_value(dir + limit_file);
+	if (limit < 0)
+	{
+		dir = base;
+		limit = read_mem_value(dir + limit_file);
+	}
+	if (limit < 0 || limit >= CGROUP_NO_LIMIT)
+	{
+		return -1;
+	}
+	long long usage = read_mem_value(dir + (is_v2 ? "/memory.current" : "/memory.usage_in_bytes"));
+	if (usage < 0)
+	{
+		return limit;
+	}
+	// inactive page cache is reclaimed before the group is OOM killed
+	usage -= read_mem_stat(dir + "/memory.stat", is_v2 ? "inactive_file" : "total_inactive_file");
+	return std::max(0LL, limit - std::max(0LL, usage));
+#endif
+}
+
+// ----------------------------------------------------------------------------
 
 long long get_available_mem()
 {
@@ -56,14 +183,39 @@ long long get_available_mem()
 	GlobalMemoryStatusEx(&memInfo);
 	return memInfo.ullAvailPhys;
 #else
-	struct sysinfo memInfo;
+	long long availMem = -1;
+	std::ifstream meminfo("/proc/meminfo");
+	std::string line;
+	while (std::getline(meminfo, line))
+	{
+		if (line.compare(0, 13, "MemAvailable:") == 0)
+		{
+			std::istringstream strstream(line.substr(13));
+			long long kb;
+			if (strstream >> kb)
+			{
+				availMem = kb * 1024;
+			}
+			break;
+		}
+	}
+	if (availMem < 0)
+	{
+		// kernels before 3.14 have no MemAvailable
+		struct sysinfo memInfo;
 
-	sysinfo(&memInfo);
-	long long totalVirtualMem = memInfo.totalram;
-	//Add other values in next statement to avoid int overflow on right hand side...
-	totalVirtualMem += memInfo.totalswap;
-	totalVirtualMem *= memInfo.mem_unit;
-	return totalVirtualMem;
+		sysinfo(&memInfo);
+		availMem = memInfo.freeram;
+		//Add other values in next statement to avoid int overflow on right hand side...
+		availMem += memInfo.bufferram;
+		availMem *= memInfo.mem_unit;
+	}
+	long long cgroupMem = get_cgroup_free_mem();
+	if (cgroupMem >= 0)
+	{
+		availMem = std::min(availMem, cgroupMem);
+	}
+	return availMem;
 #endif
 }
 
@@ -87,3 +239,39 @@ long long get_total_mem()
 	return totalPhysMem;
 #endif
 }
+
+// ----------------------------------------------------------------------------
+
+Mem_Plan plan_dataset_memory(long long mem_limit, size_t rows, size_t cols, size_t samples, size_t n_maps, size_t num_threads, size_t real_size, size_t num_volumes)
+{
+	Mem_Plan plan;
+	long long avail = get_available_mem();
+	if (mem_limit > 0)
+	{
+		avail = std::min(avail, mem_limit);
+	}
+	plan.budget = (long long)(avail * MEM_HEADROOM);
+
+	num_threads = std::max((size_t)1, num_threads);
+	cols = std::max((size_t)1, cols);
+	long long pixels = (long long)rows * (long long)cols;
+	long long volume_bytes = (long long)num_volumes * pixels * (long long)(samples * real_size + SPECTRA_OVERHEAD_BYTES);
+	long long maps_bytes = pixels * (long long)(n_maps * real_size);
+	// model spectra, residuals and jacobian rows per fitting thread
+	long long workspace_bytes = (long long)num_threads * (long long)((n_maps + 8) * samples * sizeof(double));
+	long long fixed_bytes = volume_bytes + maps_bytes + workspace_bytes;
+
+	// keep enough pixel jobs queued for every thread, more only while it costs a small part of what is left
+	size_t min_tile_rows = std::max((size_t)1, ((2 * num_threads) + cols - 1) / cols);
+	long long row_job_bytes = (long long)cols * PIXEL_JOB_BYTES;
+	plan.tile_rows = min_tile_rows;
+	if (plan.budget > fixed_bytes)
+	{
+		long long spare_rows = ((plan.budget - fixed_bytes) / 4) / row_job_bytes;
+		plan.tile_rows = std::max(min_tile_rows, (size_t)std::min((long long)rows, spare_rows));
+	}
+
+	plan.dataset_bytes = fixed_bytes + ((long long)plan.tile_rows * row_job_bytes);
+	plan.stream = plan.dataset_bytes > plan.budget;
+	return plan;
+}
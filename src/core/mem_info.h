@@ -55,9 +55,29 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "sys/sysinfo.h"
 #endif
 
+#include <cstddef>
+
+/// Memory we can use without swapping: MemAvailable clamped to the cgroup limit minus its usage.
 long long get_available_mem();
 
 long long get_total_mem();
 
+/// cgroup v2 memory.max or v1 memory.limit_in_bytes minus current usage, -1 if there is no limit.
+long long get_cgroup_free_mem();
+
+/// Sizing of one dataset against the memory budget.
+struct Mem_Plan
+{
+	long long budget;            // bytes we allow ourselves, --mem-limit or available memory, less headroom
+	long long dataset_bytes;     // spectra volume + fitted maps + per thread fit workspaces
+	size_t tile_rows;            // rows of pixel fit jobs kept in flight
+	bool stream;                 // the whole dataset does not fit, it should be streamed instead of loaded
+};
+
+/// Estimate the footprint of num_volumes rows x cols x samples volumes fitted to n_maps maps by num_threads threads.
+/// Call it before the volumes are loaded, the available memory must not already include them.
+/// mem_limit <= 0 uses get_available_mem().
+Mem_Plan plan_dataset_memory(long long mem_limit, size_t rows, size_t cols, size_t samples, size_t n_maps, size_t num_threads, size_t real_size, size_t num_volumes = 1);
+
 #endif
 
@@ -64,16 +64,22 @@ template<typename T_real>
 DLL_EXPORT data_struct::Stream_Block<T_real>* proc_spectra_block( data_struct::Stream_Block<T_real>* stream_block )
 {
 
+    // reused by every block fit on this thread, values are reset instead of reallocating the nodes
+    thread_local std::unordered_map<std::string, T_real> counts_dict;
     for (auto& itr : stream_block->fitting_blocks)
     {
-        std::unordered_map<std::string, T_real> counts_dict;
-        stream_block->fitting_blocks[itr.first].fit_routine->fit_spectra(stream_block->model, stream_block->spectra, stream_block->elements_to_fit, counts_dict);
+        for (auto& c_itr : counts_dict)
+        {
+            c_itr.second = (T_real)0.0;
+        }
+        itr.second.fit_routine->fit_spectra(stream_block->model, stream_block->spectra, stream_block->elements_to_fit, counts_dict);
         //make count / sec
+        std::unordered_map<std::string, T_real>& fit_counts = itr.second.fit_counts;
         for (auto& el_itr : *(stream_block->elements_to_fit))
         {
-            stream_block->fitting_blocks[itr.first].fit_counts[el_itr.first] = counts_dict[el_itr.first] / stream_block->spectra->elapsed_livetime();
+            fit_counts[el_itr.first] = counts_dict[el_itr.first] / stream_block->spectra->elapsed_livetime();
         }
-        stream_block->fitting_blocks[itr.first].fit_counts[STR_NUM_ITR] = counts_dict[STR_NUM_ITR];
+        fit_counts[STR_NUM_ITR] = counts_dict[STR_NUM_ITR];
     }
     return stream_block;
 }
@@ -133,6 +139,29 @@ DLL_EXPORT void run_stream_pipeline(data_struct::Analysis_Job<T_real>* job)
 
 // ----------------------------------------------------------------------------
 
+///
+/// \brief stream_dataset : runs the stream pipeline over one dataset of the job, for the given detectors only.
+///        Used for datasets too large to load whole. The job's dataset and detector lists are swapped back
+///        afterwards, so iterators into them stay valid.
+///
+template<typename T_real>
+DLL_EXPORT void stream_dataset(data_struct::Analysis_Job<T_real>* job, const std::string& dataset_file, const std::vector<size_t>& detector_num_arr)
+{
+    std::vector<std::string> dataset_files = { dataset_file };
+    std::vector<size_t> detectors = detector_num_arr;
+    long long mem_limit = job->mem_limit;
+
+    job->dataset_files.swap(dataset_files);
+    job->detector_num_arr.swap(detectors);
+    run_stream_pipeline(job);
+    job->dataset_files.swap(dataset_files);
+    job->detector_num_arr.swap(detectors);
+    // the file source replaces an unset limit with the available memory
+    job->mem_limit = mem_limit;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 DLL_EXPORT void stream_spectra(data_struct::Analysis_Job<T_real>* job)
 {
@@ -57,7 +57,9 @@ bool optimize_integrated_fit_params(data_struct::Analysis_Job<double> * analysis
                                     size_t detector_num,
                                     data_struct::Params_Override<double>* params_override,
                                     std::string save_filename,
-                                    data_struct::Fit_Parameters<double>& out_fitp)
+                                    data_struct::Fit_Parameters<double>& out_fitp,
+                                    size_t concurrent_fits,
+                                    fitting::optimizers::Optimizer<double>* optimizer)
 {
     fitting::models::Gaussian_Model<double> model;
     bool ret_val = false;
@@ -80,7 +82,8 @@ bool optimize_integrated_fit_params(data_struct::Analysis_Job<double> * analysis
             fit_routine = new fitting::routines::Param_Optimized_Fit_Routine<double>();
         }
 
-        fit_routine->set_optimizer(analysis_job->optimizer());
+        // fits running at the same time pass their own optimizer
+        fit_routine->set_optimizer((optimizer != nullptr) ? optimizer : analysis_job->optimizer());
 		fit_routine->set_update_coherent_amplitude_on_fit(false);
 
         //reset model fit parameters to defaults
@@ -89,6 +92,8 @@ bool optimize_integrated_fit_params(data_struct::Analysis_Job<double> * analysis
         model.update_fit_params_values(&(params_override->fit_params));
         //set fixed/fit preset
         model.set_fit_params_preset(analysis_job->optimize_fit_params_preset);
+        //share the threads with any other spectra being optimized at the same time
+        model.set_num_threads(analysis_job->model_threads(PARALLELISM_POLICY::INTRA_FIT, concurrent_fits));
 
         //Initialize the fit routine
         fit_routine->initialize(&model, &params_override->elements_to_fit, energy_range);
@@ -134,67 +139,110 @@ void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job)
     std::unordered_map<int, data_struct::Fit_Parameters<double>> fit_params_avgs;
     std::unordered_map<int, data_struct::Params_Override<double>*> params;
     std::unordered_map<int, float> detector_file_cnt;
-    data_struct::Params_Override<double>* params_override = nullptr;
-    data_struct::Spectra<double> int_spectra;
+    std::vector<size_t> detectors;
 
     std::string full_path = analysis_job->dataset_directory + DIR_END_CHAR + "maps_fit_parameters_override.txt";
 
     for (size_t detector_num : analysis_job->detector_num_arr)
     {
         detector_file_cnt[detector_num] = 0.0;
+
+        data_struct::Params_Override<double>* params_override = new data_struct::Params_Override<double>();
+        //load override parameters
+        if (false == io::file::load_override_params(analysis_job->dataset_directory, detector_num, params_override))
+        {
+            if (false == io::file::load_override_params(analysis_job->dataset_directory, -1, params_override))
+            {
+                logE << "Loading maps_fit_parameters_override.txt\n";
+                delete params_override;
+                continue;
+            }
+        }
+        params[detector_num] = params_override;
+        detectors.push_back(detector_num);
     }
 
-    for (auto& itr : analysis_job->optimize_dataset_files)
+    // Integration reads hdf5 which is not thread safe, so every load goes through a single io thread
+    // in dataset order. Each detector gets its own fit chain that walks the datasets in the same order
+    // so the warm start from the previous good fit is the same as running serially.
+    size_t num_datasets = analysis_job->optimize_dataset_files.size();
+    std::vector<data_struct::Spectra<double>> int_spectras(num_datasets * detectors.size());
+    std::vector<std::shared_future<bool>> loaded;
+    loaded.reserve(int_spectras.size());
+    ThreadPool io_pool(1);
+    for (size_t d = 0; d < num_datasets; d++)
     {
-        for (size_t detector_num : analysis_job->detector_num_arr)
+        for (size_t i = 0; i < detectors.size(); i++)
         {
-            //reuse previous param override if it exists
-            if (params.count(detector_num) > 0)
+            const std::string& dataset_file = analysis_job->optimize_dataset_files[d];
+            size_t detector_num = detectors[i];
+            data_struct::Spectra<double>* int_spectra = &int_spectras[(d * detectors.size()) + i];
+            // the loaders store the dataset's quantification scalers in the override, give them a copy so they
+            // don't write to the one the fit chain of this detector is using
+            data_struct::Params_Override<double> dataset_override = *params[detector_num];
+            loaded.emplace_back(io_pool.enqueue([analysis_job, dataset_file, detector_num, int_spectra, dataset_override]() mutable
             {
-                params_override = params[detector_num];
-            }
-            else
+                return io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, dataset_file, detector_num, int_spectra, &dataset_override);
+            }).share());
+        }
+    }
+
+    size_t concurrent_fits = std::max((size_t)1, std::min(analysis_job->num_threads, detectors.size()));
+    // chains fit at the same time, each gets its own optimizer
+    std::vector<std::unique_ptr<fitting::optimizers::Optimizer<double>>> optimizers;
+    for (size_t i = 0; i < detectors.size(); i++)
+    {
+        optimizers.emplace_back(analysis_job->new_optimizer());
+    }
+    std::vector<std::future<std::pair<float, data_struct::Fit_Parameters<double>>>> chains;
+    ThreadPool fit_pool(concurrent_fits);
+    for (size_t i = 0; i < detectors.size(); i++)
+    {
+        chains.emplace_back(fit_pool.enqueue([&, i]()
+        {
+            size_t detector_num = detectors[i];
+            fitting::optimizers::Optimizer<double>* optimizer = optimizers[i].get();
+            data_struct::Params_Override<double>* params_override = params[detector_num];
+            std::pair<float, data_struct::Fit_Parameters<double>> result(0.0, data_struct::Fit_Parameters<double>());
+            for (size_t d = 0; d < num_datasets; d++)
             {
-                params_override = new data_struct::Params_Override<double>();
-                //load override parameters
-                if (false == io::file::load_override_params(analysis_job->dataset_directory, detector_num, params_override))
+                size_t idx = (d * detectors.size()) + i;
+                const std::string& dataset_file = analysis_job->optimize_dataset_files[d];
+                if (loaded[idx].get())
                 {
-                    if (false == io::file::load_override_params(analysis_job->dataset_directory, -1, params_override))
+                    data_struct::Fit_Parameters<double> out_fitp;
+                    if (optimize_integrated_fit_params(analysis_job, int_spectras[idx], detector_num, params_override, dataset_file, out_fitp, concurrent_fits, optimizer))
                     {
-                        logE << "Loading maps_fit_parameters_override.txt\n";
-                        delete params_override;
-                        params_override = nullptr;
-                        continue;
+                        if (result.first > 0.)
+                        {
+                            result.second.sum_values(out_fitp);
+                        }
+                        else
+                        {
+                            result.second = out_fitp;
+                        }
+                        result.first += 1.0;
                     }
                 }
-                if (params_override != nullptr)
+                else
                 {
-                    params[detector_num] = params_override;
+                    logE << "In optimize_integrated_dataset loading dataset" << dataset_file << " for detector" << detector_num << "\n";
                 }
-				
+                // free the integrated spectra as soon as it is fit
+                int_spectras[idx] = data_struct::Spectra<double>();
             }
+            return result;
+        }));
+    }
 
-            //load the int spectra from the dataset.
-            if (io::file::load_and_integrate_spectra_volume(analysis_job->dataset_directory, itr, detector_num, &int_spectra, params_override))
-            {
-                data_struct::Fit_Parameters<double> out_fitp;
-                if (optimize_integrated_fit_params(analysis_job, int_spectra, detector_num, params_override, itr, out_fitp))
-                {
-                    detector_file_cnt[detector_num] += 1.0;
-                    if (fit_params_avgs.count(detector_num) > 0)
-                    {
-                        fit_params_avgs[detector_num].sum_values(out_fitp);
-                    }
-                    else
-                    {
-                        fit_params_avgs[detector_num] = out_fitp;
-                    }
-                }
-            }
-            else
-            {
-                logE << "In optimize_integrated_dataset loading dataset" << itr << " for detector" << detector_num << "\n";
-            }
+    // collect in detector order so the averages do not depend on which chain finishes first
+    for (size_t i = 0; i < detectors.size(); i++)
+    {
+        std::pair<float, data_struct::Fit_Parameters<double>> result = chains[i].get();
+        if (result.first > 0.)
+        {
+            detector_file_cnt[detectors[i]] = result.first;
+            fit_params_avgs[detectors[i]] = result.second;
         }
     }
 
@@ -209,7 +257,7 @@ void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job)
 
         if (params.count(detector_num) > 0)
         {
-            params_override = params[detector_num];
+            data_struct::Params_Override<double>* params_override = params[detector_num];
             if (params_override != nullptr)
             {
                 delete params_override;
@@ -361,6 +409,7 @@ void load_and_fit_quatification_datasets(data_struct::Analysis_Job<double>* anal
             model.reset_to_default_fit_params();
             //Update fit parameters by override values
             model.update_fit_params_values(&(override_params->fit_params));
+            model.set_num_threads(analysis_job->model_threads(PARALLELISM_POLICY::INTRA_FIT));
             //Initialize the fit routine
             fit_routine->initialize(&model, &elements_to_fit, energy_range);
             //Fit the spectra
@@ -382,6 +431,7 @@ void load_and_fit_quatification_datasets(data_struct::Analysis_Job<double>* anal
                     }
                 }
                 fitting::routines::Matrix_Optimized_Fit_Routine<double>* f_routine = (fitting::routines::Matrix_Optimized_Fit_Routine<double>*)fit_routine;
+                f_routine->reduce_integrated_spectra();
                 double energy_offset = fit_params.value(STR_ENERGY_OFFSET);
                 double energy_slope = fit_params.value(STR_ENERGY_SLOPE);
                 double energy_quad = fit_params.value(STR_ENERGY_QUADRATIC);
@@ -525,28 +575,49 @@ void find_and_optimize_roi(data_struct::Analysis_Job<double>& analysis_job, int
     std::vector<std::string> files = io::file::File_Scan::inst()->find_all_dataset_files(analysis_job.dataset_directory + "img.dat", search_filename);
     if (files.size() > 0)
     {
-        for (auto& roi_itr : rois)
+        // integrate every roi in one pass over the dataset
+        std::map<int, Spectra<double>> int_spectras;
+        std::string file_path = analysis_job.dataset_directory + "img.dat" + DIR_END_CHAR + files[0];
+        if (false == io::file::HDF5_IO::inst()->load_integrated_spectra_analyzed_h5_rois(file_path, rois, &int_spectras))
         {
-            Spectra<double> int_spectra;
-            std::string file_path = analysis_job.dataset_directory + "img.dat" + DIR_END_CHAR + files[0];
-            if (io::file::HDF5_IO::inst()->load_integrated_spectra_analyzed_h5_roi(file_path, &int_spectra, roi_itr.second))
+            logE << "Loading rois from " << file_path << "\n";
+            return;
+        }
+
+        data_struct::Params_Override<double> params_override;
+        //load override parameters
+        if (false == io::file::load_override_params(analysis_job.dataset_directory, detector_num, &params_override))
+        {
+            if (false == io::file::load_override_params(analysis_job.dataset_directory, -1, &params_override))
             {
-                data_struct::Params_Override<double> params_override;
-                //load override parameters
-                if (false == io::file::load_override_params(analysis_job.dataset_directory, detector_num, &params_override))
-                {
-                    if (false == io::file::load_override_params(analysis_job.dataset_directory, -1, &params_override))
-                    {
-                        logE << "Loading maps_fit_parameters_override.txt\n";
-                        return;
-                    }
-                }
+                logE << "Loading maps_fit_parameters_override.txt\n";
+                return;
+            }
+        }
+
+        // each roi is optimized from its own copy of the override params
+        size_t concurrent_fits = std::max((size_t)1, std::min(analysis_job.num_threads, int_spectras.size()));
+        std::vector<std::pair<std::string, std::future<bool>>> jobs;
+        ThreadPool tp(concurrent_fits);
+        for (auto& roi_itr : int_spectras)
+        {
+            std::string roi_name = std::to_string(roi_itr.first);
+            std::string save_filename = files[0] + "_roi_" + roi_name;
+            Spectra<double>* int_spectra = &roi_itr.second;
+            jobs.emplace_back(roi_name, tp.enqueue([&analysis_job, &params_override, int_spectra, detector_num, save_filename, concurrent_fits]()
+            {
+                data_struct::Params_Override<double> roi_params_override = params_override;
                 data_struct::Fit_Parameters<double> out_fitp;
-                std::string roi_name = std::to_string(roi_itr.first);
-                if (false == optimize_integrated_fit_params(&analysis_job, int_spectra, detector_num, &params_override, files[0]+ "_roi_" + roi_name, out_fitp))
-                {
-                    logE << "Failed to optimize ROI "<< file_path<<" : "<< roi_name<<".\n";
-                }
+                std::unique_ptr<fitting::optimizers::Optimizer<double>> optimizer(analysis_job.new_optimizer());
+                return optimize_integrated_fit_params(&analysis_job, *int_spectra, detector_num, &roi_params_override, save_filename, out_fitp, concurrent_fits, optimizer.get());
+            }));
+        }
+
+        for (auto& itr : jobs)
+        {
+            if (false == itr.second.get())
+            {
+                logE << "Failed to optimize ROI "<< file_path<<" : "<< itr.first<<".\n";
             }
         }
     }
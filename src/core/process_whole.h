@@ -54,6 +54,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <array>
 #include <vector>
+#include <memory>
 #include <unordered_map>
 #include <chrono>
 #include <ctime>
@@ -75,6 +76,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "workflow/threadpool.h"
 
+#include "core/mem_info.h"
+#include "core/process_streaming.h"
+
 #include "io/file/hl_file_io.h"
 #include "io/file/mca_io.h"
 
@@ -110,10 +114,13 @@ using namespace std::placeholders; //for _1, _2,
 DLL_EXPORT bool perform_quantification(data_struct::Analysis_Job<double>* analysis_job);
 
 DLL_EXPORT bool optimize_integrated_fit_params(data_struct::Analysis_Job<double>* analysis_job,
-    std::string  dataset_filename,
+    data_struct::Spectra<double>& int_spectra,
     size_t detector_num,
     data_struct::Params_Override<double>* params_override,
-    data_struct::Fit_Parameters<double>& out_fitp);
+    std::string save_filename,
+    data_struct::Fit_Parameters<double>& out_fitp,
+    size_t concurrent_fits = 1,
+    fitting::optimizers::Optimizer<double>* optimizer = nullptr);
 
 DLL_EXPORT void generate_optimal_params(data_struct::Analysis_Job<double>* analysis_job);
 
@@ -159,52 +166,304 @@ DLL_EXPORT data_struct::Fit_Count_Dict<T_real>* generate_fit_count_dict(const Fi
 // ----------------------------------------------------------------------------
 
 template<typename T_real>
-DLL_EXPORT bool fit_single_spectra(fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
-                        const fitting::models::Base_Model<T_real>* const model,
-                        const data_struct::Spectra<T_real>* const spectra,
-                        const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
-                        data_struct::Fit_Count_Dict<T_real>* out_fit_counts,
-                        size_t i,
-                        size_t j)
+DLL_EXPORT data_struct::Fit_Count_Tensor<T_real>* generate_fit_count_tensor(const Fit_Element_Map_Dict<T_real>* elements_to_fit, size_t height, size_t width, bool alloc_iter_count)
 {
-    std::unordered_map<std::string, T_real> counts_dict;
-    fit_routine->fit_spectra(model, spectra, elements_to_fit, counts_dict);
-    //save count / sec
+    std::unordered_map<std::string, bool> count_names;
+    for (auto& e_itr : *elements_to_fit)
+    {
+        count_names[e_itr.first] = true;
+    }
+    if (alloc_iter_count)
+    {
+        count_names[STR_NUM_ITR] = true;
+        count_names[STR_RESIDUAL] = true;
+    }
+    count_names[STR_TOTAL_FLUORESCENCE_YIELD] = true;
+    count_names[STR_SUM_ELASTIC_INELASTIC_AMP] = true;
+
+    // planes in save order so the tensor is written in one call
+    return new data_struct::Fit_Count_Tensor<T_real>(data_struct::get_element_save_order(count_names), height, width);
+}
+
+// ----------------------------------------------------------------------------
+
+///
+/// \brief The Fit_Count_Index struct : planes of a Fit_Count_Tensor resolved once per fit routine so
+///                                      fit_single_spectra does not look them up by name for every pixel
+///
+template<typename T_real>
+struct Fit_Count_Index
+{
+    data_struct::Fit_Count_Tensor<T_real>* counts = nullptr;
+    std::vector<std::pair<std::string, size_t> > element_planes;
+    int num_itr_plane = -1;
+    int residual_plane = -1;
+    int total_fluorescence_yield_plane = -1;
+    int sum_elastic_inelastic_plane = -1;
+};
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+DLL_EXPORT Fit_Count_Index<T_real> generate_fit_count_index(const Fit_Element_Map_Dict<T_real>* elements_to_fit, data_struct::Fit_Count_Tensor<T_real>* fit_counts)
+{
+    Fit_Count_Index<T_real> fit_count_index;
+    fit_count_index.counts = fit_counts;
     for (auto& el_itr : *elements_to_fit)
     {
-        (*out_fit_counts)[el_itr.first](i, j) = counts_dict[el_itr.first] / spectra->elapsed_livetime();
+        int plane = fit_counts->plane_index(el_itr.first);
+        if (plane > -1)
+        {
+            fit_count_index.element_planes.push_back({ el_itr.first, (size_t)plane });
+        }
     }
-    (*out_fit_counts)[STR_NUM_ITR](i, j) = counts_dict[STR_NUM_ITR];
+    fit_count_index.num_itr_plane = fit_counts->plane_index(STR_NUM_ITR);
+    fit_count_index.residual_plane = fit_counts->plane_index(STR_RESIDUAL);
+    fit_count_index.total_fluorescence_yield_plane = fit_counts->plane_index(STR_TOTAL_FLUORESCENCE_YIELD);
+    fit_count_index.sum_elastic_inelastic_plane = fit_counts->plane_index(STR_SUM_ELASTIC_INELASTIC_AMP);
+    return fit_count_index;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+DLL_EXPORT void save_fit_counts(const std::unordered_map<std::string, T_real>& counts_dict,
+                                const data_struct::Spectra<T_real>* const spectra,
+                                const Fit_Count_Index<T_real>* out_fit_counts,
+                                size_t i,
+                                size_t j)
+{
+    data_struct::Fit_Count_Tensor<T_real>& counts = *(out_fit_counts->counts);
+    T_real elapsed_livetime = spectra->elapsed_livetime();
+    T_real spectra_sum = spectra->sum();
+    // counts the routine did not report this pixel are 0
+    auto count_value = [&counts_dict](const std::string& name)
+    {
+        auto c_itr = counts_dict.find(name);
+        return (c_itr != counts_dict.end()) ? c_itr->second : (T_real)0.0;
+    };
 
-    (*out_fit_counts)[STR_RESIDUAL](i, j) = counts_dict[STR_RESIDUAL];
-    // add total fluorescense yield
-    if (out_fit_counts->count(STR_TOTAL_FLUORESCENCE_YIELD))
+    //save count / sec
+    for (const auto& el_itr : out_fit_counts->element_planes)
+    {
+        counts.at(el_itr.second, i, j) = count_value(el_itr.first) / elapsed_livetime;
+    }
+    if (out_fit_counts->num_itr_plane > -1)
     {
-        (*out_fit_counts)[STR_TOTAL_FLUORESCENCE_YIELD](i, j) = spectra->sum();
+        counts.at(out_fit_counts->num_itr_plane, i, j) = count_value(STR_NUM_ITR);
+    }
+    if (out_fit_counts->residual_plane > -1)
+    {
+        counts.at(out_fit_counts->residual_plane, i, j) = count_value(STR_RESIDUAL);
     }
     // add sum coherent and compton
-    if (out_fit_counts->count(STR_SUM_ELASTIC_INELASTIC_AMP) > 0 && counts_dict.count(STR_COHERENT_SCT_AMPLITUDE) > 0 && counts_dict.count(STR_COMPTON_AMPLITUDE) > 0)
+    auto coherent_itr = counts_dict.find(STR_COHERENT_SCT_AMPLITUDE);
+    auto compton_itr = counts_dict.find(STR_COMPTON_AMPLITUDE);
+    if (out_fit_counts->sum_elastic_inelastic_plane > -1 && coherent_itr != counts_dict.end() && compton_itr != counts_dict.end())
     {
-        (*out_fit_counts)[STR_SUM_ELASTIC_INELASTIC_AMP](i, j) = counts_dict[STR_COHERENT_SCT_AMPLITUDE] + counts_dict[STR_COMPTON_AMPLITUDE];
+        T_real sum_elastic_inelastic = coherent_itr->second + compton_itr->second;
+        counts.at(out_fit_counts->sum_elastic_inelastic_plane, i, j) = sum_elastic_inelastic;
         // add total fluorescense yield
-        if (out_fit_counts->count(STR_TOTAL_FLUORESCENCE_YIELD))
+        if (out_fit_counts->total_fluorescence_yield_plane > -1)
         {                   //                                      (sum - (elastic + inelastic)) / live time
-            (*out_fit_counts)[STR_TOTAL_FLUORESCENCE_YIELD](i, j) = (spectra->sum() - (*out_fit_counts)[STR_SUM_ELASTIC_INELASTIC_AMP](i, j)) / spectra->elapsed_livetime();
+            counts.at(out_fit_counts->total_fluorescence_yield_plane, i, j) = (spectra_sum - sum_elastic_inelastic) / elapsed_livetime;
         }
     }
     else
     {
         // add total fluorescense yield
-        if (out_fit_counts->count(STR_TOTAL_FLUORESCENCE_YIELD))
+        if (out_fit_counts->total_fluorescence_yield_plane > -1)
         {
-            (*out_fit_counts)[STR_TOTAL_FLUORESCENCE_YIELD](i, j) = spectra->sum() / spectra->elapsed_livetime();
+            counts.at(out_fit_counts->total_fluorescence_yield_plane, i, j) = spectra_sum / elapsed_livetime;
         }
     }
+}
+
+// ----------------------------------------------------------------------------
 
+template<typename T_real>
+DLL_EXPORT bool fit_single_spectra(fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                        const fitting::models::Base_Model<T_real>* const model,
+                        const data_struct::Spectra<T_real>* const spectra,
+                        const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                        const Fit_Count_Index<T_real>* out_fit_counts,
+                        size_t i,
+                        size_t j)
+{
+    // scratch for the fit routine on this thread, cleared so counts from the previous pixel never carry over
+    thread_local std::unordered_map<std::string, T_real> counts_dict;
+    counts_dict.clear();
+    fit_routine->fit_spectra(model, spectra, elements_to_fit, counts_dict);
+    save_fit_counts(counts_dict, spectra, out_fit_counts, i, j);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+DLL_EXPORT bool fit_spectra_line(fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* fit_routine,
+                                 const fitting::models::Base_Model<T_real>* const model,
+                                 const data_struct::Spectra_Line<T_real>* const spectra_line,
+                                 const data_struct::Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                 const Fit_Count_Index<T_real>* out_fit_counts,
+                                 size_t i)
+{
+    // the pixels of the row are fit together in lockstep blocks
+    thread_local std::vector<std::unordered_map<std::string, T_real>> counts_dicts;
+    std::vector<const data_struct::Spectra<T_real>*> spectras(spectra_line->size());
+    for (size_t j = 0; j < spectra_line->size(); j++)
+    {
+        spectras[j] = &((*spectra_line)[j]);
+    }
+    for (auto& counts_dict : counts_dicts)
+    {
+        counts_dict.clear();
+    }
+    fit_routine->fit_spectra_block(model, spectras, elements_to_fit, counts_dicts);
+    for (size_t j = 0; j < spectras.size(); j++)
+    {
+        save_fit_counts(counts_dicts[j], spectras[j], out_fit_counts, i, j);
+    }
     return true;
 }
 
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+DLL_EXPORT void set_save_compression(data_struct::Analysis_Job<T_real>* analysis_job, data_struct::Detector<T_real>* detector)
+{
+    // command line takes priority over maps_fit_parameters_override.txt
+    std::string compression = analysis_job->compression;
+    std::string spectra_compression = analysis_job->spectra_compression;
+    if (detector != nullptr)
+    {
+        if (compression.length() == 0)
+        {
+            compression = detector->fit_params_override_dict.compression;
+        }
+        if (spectra_compression.length() == 0)
+        {
+            spectra_compression = detector->fit_params_override_dict.spectra_compression;
+        }
+    }
+
+    // settings from the previous detector don't carry over, no override means the defaults
+    io::file::H5_Compression h5_compression;
+    if (compression.length() == 0 || false == io::file::parse_h5_compression(compression, h5_compression))
+    {
+        h5_compression = io::file::H5_Compression();
+    }
+    io::file::HDF5_IO::inst()->set_compression(h5_compression);
+    if (spectra_compression.length() > 0 && io::file::parse_h5_compression(spectra_compression, h5_compression))
+    {
+        io::file::HDF5_IO::inst()->set_dataset_compression("mca_arr", h5_compression);
+    }
+    else
+    {
+        io::file::HDF5_IO::inst()->clear_dataset_compression("mca_arr");
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+///
+/// \brief fit_spectra_volume : fits every pixel of the volume with one routine on the thread pool, filling the
+///        planes of element_fit_counts. ROI sums and the batched matrix fit run a row per job, the rest a pixel.
+///        tile_rows > 0 caps the queued pixel jobs at that many rows, see plan_dataset_memory.
+///
+template<typename T_real>
+DLL_EXPORT void fit_spectra_volume(data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                   data_struct::Fitting_Routines proc_type,
+                                   fitting::routines::Base_Fit_Routine<T_real>* fit_routine,
+                                   fitting::models::Base_Model<T_real>* model,
+                                   data_struct::Fit_Element_Map_Dict<T_real>* elements_to_fit,
+                                   data_struct::Fit_Count_Tensor<T_real>* element_fit_counts,
+                                   ThreadPool* tp,
+                                   Callback_Func_Status_Def* status_callback = nullptr,
+                                   size_t tile_rows = 0)
+{
+    //Fit job queue
+    std::queue<std::future<bool> > fit_job_queue;
+    size_t cur_block = 0;
+
+    Fit_Count_Index<T_real> fit_count_index = generate_fit_count_index(elements_to_fit, element_fit_counts);
+
+    size_t total_blocks = (spectra_volume->rows() * spectra_volume->cols()) - 1;
+    fitting::routines::ROI_Fit_Routine<T_real>* roi_fit = nullptr;
+    fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* batched_fit = nullptr;
+    if (proc_type == data_struct::Fitting_Routines::ROI)
+    {
+        roi_fit = (fitting::routines::ROI_Fit_Routine<T_real>*)fit_routine;
+    }
+    else if (proc_type == data_struct::Fitting_Routines::GAUSS_MATRIX)
+    {
+        batched_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
+    }
+
+    fitting::models::Range energy_range;
+    if (roi_fit != nullptr && model != nullptr)
+    {
+        const data_struct::Fit_Parameters<T_real>& fitp = model->fit_parameters();
+        energy_range = data_struct::get_energy_range(fitp.value(STR_MIN_ENERGY_TO_FIT), fitp.value(STR_MAX_ENERGY_TO_FIT), spectra_volume->samples_size(), fitp.value(STR_ENERGY_OFFSET), fitp.value(STR_ENERGY_SLOPE));
+    }
+
+    if (roi_fit != nullptr && roi_fit->is_initialized_for(model, elements_to_fit, energy_range))
+    {
+        // roi windows are precomputed, sum a whole row per job
+        for (size_t i = 0; i < spectra_volume->rows(); i++)
+        {
+            fit_job_queue.emplace(tp->enqueue([roi_fit, model, spectra_volume, elements_to_fit, energy_range, element_fit_counts, i]()
+            {
+                return roi_fit->fit_spectra_line(model, &(*spectra_volume)[i], elements_to_fit, energy_range, element_fit_counts, i);
+            }));
+        }
+        total_blocks = spectra_volume->rows() - 1;
+    }
+    else if (batched_fit != nullptr && batched_fit->batch_size() > 1)
+    {
+        // batched levenberg marquardt over the pixels of a row per job
+        for (size_t i = 0; i < spectra_volume->rows(); i++)
+        {
+            fit_job_queue.emplace(tp->enqueue(fit_spectra_line<T_real>, batched_fit, model, &(*spectra_volume)[i], elements_to_fit, &fit_count_index, i));
+        }
+        total_blocks = spectra_volume->rows() - 1;
+    }
+    else
+    {
+        size_t max_queued = (tile_rows > 0) ? tile_rows * spectra_volume->cols() : total_blocks + 1;
+        for (size_t i = 0; i < spectra_volume->rows(); i++)
+        {
+            for (size_t j = 0; j < spectra_volume->cols(); j++)
+            {
+                //logD<< i<<" "<<j<<"\n";
+                if (fit_job_queue.size() >= max_queued)
+                {
+                    fit_job_queue.front().get();
+                    fit_job_queue.pop();
+                    if (status_callback != nullptr)
+                    {
+                        (*status_callback)(cur_block, total_blocks);
+                    }
+                    cur_block++;
+                }
+                fit_job_queue.emplace(tp->enqueue(fit_single_spectra<T_real>, fit_routine, model, &(*spectra_volume)[i][j], elements_to_fit, &fit_count_index, i, j));
+            }
+        }
+    }
 
+    //wait for queue to finish processing
+    while (!fit_job_queue.empty())
+    {
+        auto ret = std::move(fit_job_queue.front());
+        fit_job_queue.pop();
+        ret.get();
+        if (status_callback != nullptr)
+        {
+            (*status_callback)(cur_block, total_blocks);
+        }
+        cur_block++;
+    }
+}
 
 // ----------------------------------------------------------------------------
 
@@ -213,7 +472,8 @@ DLL_EXPORT void proc_spectra(data_struct::Spectra_Volume<T_real>* spectra_volume
                              data_struct::Detector<T_real>* detector,
                              ThreadPool* tp,
                              bool save_spec_vol,
-                             Callback_Func_Status_Def* status_callback = nullptr)
+                             Callback_Func_Status_Def* status_callback = nullptr,
+                             size_t tile_rows = 0)
 {
     if (detector == nullptr)
     {
@@ -247,66 +507,51 @@ DLL_EXPORT void proc_spectra(data_struct::Spectra_Volume<T_real>* spectra_volume
             continue;
         }
 
-        //Fit job queue
-        std::queue<std::future<bool> >* fit_job_queue = new std::queue<std::future<bool> >();
-
         //Allocate memeory to save fit counts
-        data_struct::Fit_Count_Dict<T_real>* element_fit_count_dict = generate_fit_count_dict(&override_params->elements_to_fit, spectra_volume->rows(), spectra_volume->cols(), true);
+        data_struct::Fit_Count_Tensor<T_real>* element_fit_counts = generate_fit_count_tensor(&override_params->elements_to_fit, spectra_volume->rows(), spectra_volume->cols(), true);
 
-        for (size_t i = 0; i < spectra_volume->rows(); i++)
-        {
-            for (size_t j = 0; j < spectra_volume->cols(); j++)
-            {
-                //logD<< i<<" "<<j<<"\n";
-                fit_job_queue->emplace(tp->enqueue(fit_single_spectra<T_real>, fit_routine, detector->model, &(*spectra_volume)[i][j], &override_params->elements_to_fit, element_fit_count_dict, i, j));
-            }
-        }
-
-        size_t total_blocks = (spectra_volume->rows() * spectra_volume->cols()) - 1;
-        size_t cur_block = 0;
-        //wait for queue to finish processing
-        while (!fit_job_queue->empty())
-        {
-            auto ret = std::move(fit_job_queue->front());
-            fit_job_queue->pop();
-            ret.get();
-            if (status_callback != nullptr)
-            {
-                (*status_callback)(cur_block, total_blocks);
-            }
-            cur_block++;
-        }
+        fit_spectra_volume(spectra_volume, itr.first, fit_routine, detector->model, &override_params->elements_to_fit, element_fit_counts, tp, status_callback, tile_rows);
 
         std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
         std::chrono::duration<double> elapsed_seconds = end - start;
         logI << "Fitting [ " << fit_routine->get_name() << " ] elapsed time: " << elapsed_seconds.count() << "s" << "\n";
 
-        io::file::HDF5_IO::inst()->save_element_fits(fit_routine->get_name(), element_fit_count_dict);
+        // saves are queued on the hdf5 io thread so the next fit routine can start while this one is written
+        std::string fit_name = fit_routine->get_name();
+        io::file::HDF5_IO::inst()->async_save([fit_name, element_fit_counts]()
+        {
+            io::file::HDF5_IO::inst()->save_element_fits(fit_name, element_fit_counts);
+            delete element_fit_counts;
+        });
 
         if (itr.first == data_struct::Fitting_Routines::GAUSS_MATRIX
             || itr.first == data_struct::Fitting_Routines::NNLS
             || itr.first == data_struct::Fitting_Routines::SVD)
         {
             fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
-            io::file::HDF5_IO::inst()->save_fitted_int_spectra(fit_routine->get_name(),
-                matrix_fit->fitted_integrated_spectra(),
-                matrix_fit->energy_range(),
-                matrix_fit->fitted_integrated_background(),
-                (*spectra_volume)[0][0].size());
+            matrix_fit->reduce_integrated_spectra();
+            // copy, fit routine buffers are reused by the next dataset
+            data_struct::Spectra<T_real> fitted_spectra = matrix_fit->fitted_integrated_spectra();
+            data_struct::Spectra<T_real> fitted_background = matrix_fit->fitted_integrated_background();
+            data_struct::Range energy_range = matrix_fit->energy_range();
+            size_t save_spectra_size = (*spectra_volume)[0][0].size();
+            io::file::HDF5_IO::inst()->async_save([fit_name, fitted_spectra, energy_range, fitted_background, save_spectra_size]()
+            {
+                io::file::HDF5_IO::inst()->save_fitted_int_spectra(fit_name, fitted_spectra, energy_range, fitted_background, save_spectra_size);
+            });
         }
         if (itr.first == data_struct::Fitting_Routines::GAUSS_MATRIX)
         {
             fitting::routines::Matrix_Optimized_Fit_Routine<T_real>* matrix_fit = (fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)fit_routine;
-            io::file::HDF5_IO::inst()->save_max_10_spectra(fit_routine->get_name(),
-                matrix_fit->energy_range(),
-                matrix_fit->max_integrated_spectra(),
-                matrix_fit->max_10_integrated_spectra(),
-                matrix_fit->fitted_integrated_background());
+            data_struct::Spectra<T_real> max_spectra = matrix_fit->max_integrated_spectra();
+            data_struct::Spectra<T_real> max_10_spectra = matrix_fit->max_10_integrated_spectra();
+            data_struct::Spectra<T_real> fitted_background = matrix_fit->fitted_integrated_background();
+            data_struct::Range energy_range = matrix_fit->energy_range();
+            io::file::HDF5_IO::inst()->async_save([fit_name, energy_range, max_spectra, max_10_spectra, fitted_background]()
+            {
+                io::file::HDF5_IO::inst()->save_max_10_spectra(fit_name, energy_range, max_spectra, max_10_spectra, fitted_background);
+            });
         }
-
-        delete fit_job_queue;
-        element_fit_count_dict->clear();
-        delete element_fit_count_dict;
     }
 
     T_real energy_offset = 0.0;
@@ -326,14 +571,22 @@ DLL_EXPORT void proc_spectra(data_struct::Spectra_Volume<T_real>* spectra_volume
         energy_quad = fit_params[STR_ENERGY_QUADRATIC].value;
     }
 
-    io::file::HDF5_IO::inst()->save_energy_calib(spectra_volume->samples_size(), energy_offset, energy_slope, energy_quad);
+    int samples_size = spectra_volume->samples_size();
+    io::file::HDF5_IO::inst()->async_save([samples_size, energy_offset, energy_slope, energy_quad]()
+    {
+        io::file::HDF5_IO::inst()->save_energy_calib(samples_size, energy_offset, energy_slope, energy_quad);
+    });
 
+    // spectra_volume has to stay allocated until the queued save runs, callers hand it to HDF5_IO::async_release()
     if (save_spec_vol)
     {
-        io::file::HDF5_IO::inst()->save_spectra_volume("mca_arr", spectra_volume);
+        io::file::HDF5_IO::inst()->async_save([spectra_volume]()
+        {
+            io::file::HDF5_IO::inst()->save_spectra_volume("mca_arr", spectra_volume);
+        });
     }
     
-    io::file::HDF5_IO::inst()->end_save_seq();
+    io::file::HDF5_IO::inst()->async_end_save_seq();
 
 
 }
@@ -409,11 +662,60 @@ void find_quantifier_scalers(unordered_map<string, double>& pv_map, Quantificati
 
 // ----------------------------------------------------------------------------
 
+///
+/// \brief plan_dataset_memory : sizes num_volumes volumes of an mda dataset from its header, before they are loaded,
+///        plus the maps of every fit routine against --mem-limit or the available memory, and logs the plan.
+///        Other datasets are not sized, they are loaded whole with no cap on the queued pixel jobs.
+///
+template<typename T_real>
+DLL_EXPORT Mem_Plan plan_dataset_memory(data_struct::Analysis_Job<T_real>* analysis_job,
+                                        data_struct::Detector<T_real>* detector,
+                                        const std::string& dataset_file,
+                                        size_t num_volumes = 1)
+{
+    Mem_Plan mem_plan;
+    mem_plan.budget = 0;
+    mem_plan.dataset_bytes = 0;
+    mem_plan.tile_rows = 0;
+    mem_plan.stream = false;
+
+    size_t dlen = dataset_file.length();
+    if (dlen < 4 || dataset_file.compare(dlen - 4, 4, ".mda") != 0)
+    {
+        return mem_plan;
+    }
+    size_t dims[10] = { 0 };
+    int rank = io::file::mda_get_rank_and_dims(analysis_job->dataset_directory + "mda" + DIR_END_CHAR + dataset_file, &dims[0]);
+    if (rank < 2)
+    {
+        return mem_plan;
+    }
+    // spectra in netcdf / hdf5 side files are not in the mda header, size them as 2048 channels
+    size_t samples = (rank == 3) ? dims[2] : 2048;
+
+    // element maps plus the per routine extras (num iter, residual, ...) of every routine, saves may overlap
+    size_t n_maps = (detector->fit_params_override_dict.elements_to_fit.size() + 4) * std::max((size_t)1, analysis_job->fitting_routines.size());
+    mem_plan = plan_dataset_memory(analysis_job->mem_limit, dims[0], dims[1], samples, n_maps, analysis_job->num_threads, sizeof(T_real), num_volumes);
+    logI << "Memory budget " << (mem_plan.budget >> 20) << "MB, dataset " << (mem_plan.dataset_bytes >> 20) << "MB, "
+        << mem_plan.tile_rows << " rows of pixel jobs in flight\n";
+    if (mem_plan.stream)
+    {
+        logW << "Dataset needs more memory than the budget, streaming it a row at a time instead of loading it whole.\n";
+    }
+    return mem_plan;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysis_job, Callback_Func_Status_Def* status_callback = nullptr)
 {
     ThreadPool tp(analysis_job->num_threads);
 
+    // write fit results behind while the next routine / dataset is fitted
+    io::file::HDF5_IO::inst()->start_async_saves();
+    io::file::HDF5_IO::inst()->set_compress_threads(analysis_job->num_threads);
+
     for (auto& dataset_file : analysis_job->dataset_files)
     {
         //if quick and dirty then sum all detectors to 1 spectra volume and process it
@@ -429,8 +731,10 @@ DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysi
 
                 data_struct::Detector<T_real>* detector = analysis_job->get_detector(detector_num);
 
-                //Spectra volume data
-                data_struct::Spectra_Volume<T_real>* spectra_volume = new data_struct::Spectra_Volume<T_real>();
+                set_save_compression(analysis_job, detector);
+
+                //Spectra volume data, owned by the hdf5 io queue once it is processed
+                std::unique_ptr<data_struct::Spectra_Volume<T_real>> spectra_volume(new data_struct::Spectra_Volume<T_real>());
 
                 std::string fullpath;
                 size_t dlen = dataset_file.length();
@@ -450,12 +754,18 @@ DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysi
                     io::file::HDF5_IO::inst()->set_filename(full_save_path);
                 }
 
+                Mem_Plan mem_plan = plan_dataset_memory(analysis_job, detector, dataset_file);
+                if (mem_plan.stream)
+                {
+                    stream_dataset(analysis_job, dataset_file, { detector_num });
+                    continue;
+                }
+
                 bool loaded_from_analyzed_hdf5 = false;
                 //load spectra volume
-                if (false == io::file::load_spectra_volume(analysis_job->dataset_directory, dataset_file, detector_num, spectra_volume, &detector->fit_params_override_dict, &loaded_from_analyzed_hdf5, true))
+                if (false == io::file::load_spectra_volume(analysis_job->dataset_directory, dataset_file, detector_num, spectra_volume.get(), &detector->fit_params_override_dict, &loaded_from_analyzed_hdf5, true))
                 {
                     logW << "Skipping detector " << detector_num << "\n";
-                    delete spectra_volume;
                     if (status_callback != nullptr)
                     {
                         (*status_callback)(0, 1);
@@ -464,11 +774,15 @@ DLL_EXPORT void process_dataset_files(data_struct::Analysis_Job<T_real>* analysi
                 }
 
                 analysis_job->init_fit_routines(spectra_volume->samples_size(), true);
-                proc_spectra(spectra_volume, detector, &tp, !loaded_from_analyzed_hdf5, status_callback);
-                delete spectra_volume;
+                proc_spectra(spectra_volume.get(), detector, &tp, !loaded_from_analyzed_hdf5, status_callback, mem_plan.tile_rows);
+                io::file::HDF5_IO::inst()->async_release(std::move(spectra_volume));
+                // the next volume was sized without this one, it is freed once its saves are written
+                io::file::HDF5_IO::inst()->flush_async_saves();
             }
         }
     }
+
+    io::file::HDF5_IO::inst()->stop_async_saves();
 }
 
 // ----------------------------------------------------------------------------
@@ -479,20 +793,29 @@ DLL_EXPORT void process_dataset_files_quick_and_dirty(std::string dataset_file,
     std::string full_save_path = analysis_job->dataset_directory + DIR_END_CHAR + "img.dat" + DIR_END_CHAR + dataset_file + ".h5";
 
     data_struct::Detector<T_real>* detector = analysis_job->get_detector(0);
+    set_save_compression(analysis_job, detector);
+    io::file::HDF5_IO::inst()->set_compress_threads(analysis_job->num_threads);
+
+    // the sum and the detector being added to it are held at once
+    Mem_Plan mem_plan = plan_dataset_memory(analysis_job, detector, dataset_file, (analysis_job->detector_num_arr.size() > 1) ? 2 : 1);
+    if (mem_plan.stream)
+    {
+        stream_dataset(analysis_job, dataset_file, analysis_job->detector_num_arr);
+        return;
+    }
+
     //Spectra volume data
-    data_struct::Spectra_Volume<T_real>* spectra_volume = new data_struct::Spectra_Volume<T_real>();
-    data_struct::Spectra_Volume<T_real>* tmp_spectra_volume = new data_struct::Spectra_Volume<T_real>();
+    std::unique_ptr<data_struct::Spectra_Volume<T_real>> spectra_volume(new data_struct::Spectra_Volume<T_real>());
+    std::unique_ptr<data_struct::Spectra_Volume<T_real>> tmp_spectra_volume(new data_struct::Spectra_Volume<T_real>());
 
     io::file::HDF5_IO::inst()->start_save_seq(full_save_path, true); // force to create new file for quick and dirty
 
     //load the first one
     size_t detector_num = analysis_job->detector_num_arr[0];
     bool is_loaded_from_analyzed_h5 = false;
-    if (false == io::file::load_spectra_volume(analysis_job->dataset_directory, dataset_file, detector_num, spectra_volume, &detector->fit_params_override_dict, &is_loaded_from_analyzed_h5, true))
+    if (false == io::file::load_spectra_volume(analysis_job->dataset_directory, dataset_file, detector_num, spectra_volume.get(), &detector->fit_params_override_dict, &is_loaded_from_analyzed_h5, true))
     {
         logE << "Loading all detectors for " << analysis_job->dataset_directory << DIR_END_CHAR << dataset_file << "\n";
-        delete spectra_volume;
-        delete tmp_spectra_volume;
         if (status_callback != nullptr)
         {
             (*status_callback)(0, 1);
@@ -503,11 +826,9 @@ DLL_EXPORT void process_dataset_files_quick_and_dirty(std::string dataset_file,
     //load spectra volume
     for (int i = 1; i < analysis_job->detector_num_arr.size(); i++)
     {
-        if (false == io::file::load_spectra_volume(analysis_job->dataset_directory, dataset_file, analysis_job->detector_num_arr[i], tmp_spectra_volume, &detector->fit_params_override_dict, &is_loaded_from_analyzed_h5, false))
+        if (false == io::file::load_spectra_volume(analysis_job->dataset_directory, dataset_file, analysis_job->detector_num_arr[i], tmp_spectra_volume.get(), &detector->fit_params_override_dict, &is_loaded_from_analyzed_h5, false))
         {
             logE << "Loading all detectors for " << analysis_job->dataset_directory << DIR_END_CHAR << dataset_file << "\n";
-            delete spectra_volume;
-            delete tmp_spectra_volume;
             if (status_callback != nullptr)
             {
                 (*status_callback)(0, 1);
@@ -539,12 +860,13 @@ DLL_EXPORT void process_dataset_files_quick_and_dirty(std::string dataset_file,
             }
         }
     }
-    delete tmp_spectra_volume;
+    tmp_spectra_volume.reset();
 
     analysis_job->init_fit_routines(spectra_volume->samples_size(), true);
 
-    proc_spectra(spectra_volume, detector, &tp, !is_loaded_from_analyzed_h5, status_callback);
-    delete spectra_volume;
+    proc_spectra(spectra_volume.get(), detector, &tp, !is_loaded_from_analyzed_h5, status_callback, mem_plan.tile_rows);
+    io::file::HDF5_IO::inst()->async_release(std::move(spectra_volume));
+    io::file::HDF5_IO::inst()->flush_async_saves();
 }
 
 // ----------------------------------------------------------------------------
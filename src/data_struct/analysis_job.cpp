@@ -85,6 +85,9 @@ Analysis_Job<T_real>::Analysis_Job()
 	update_ds_amps_str = "";
 	update_quant_us_amps_str = "";
 	update_quant_ds_amps_str = "";
+    compression = "";
+    spectra_compression = "";
+    fit_batch_size = 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -174,6 +177,24 @@ void Analysis_Job<T_real>::set_optimizer(std::string optimizer)
 
 //-----------------------------------------------------------------------------
 
+template<typename T_real>
+fitting::optimizers::Optimizer<T_real>* Analysis_Job<T_real>::new_optimizer()
+{
+    fitting::optimizers::Optimizer<T_real>* optimizer = nullptr;
+    if (_optimizer == &_mpfit_optimizer)
+    {
+        optimizer = new fitting::optimizers::MPFit_Optimizer<T_real>();
+    }
+    else
+    {
+        optimizer = new fitting::optimizers::LMFit_Optimizer<T_real>();
+    }
+    optimizer->set_options(_optimizer->get_options());
+    return optimizer;
+}
+
+//-----------------------------------------------------------------------------
+
 TEMPLATE_CLASS_DLL_EXPORT Analysis_Job<float>;
 TEMPLATE_CLASS_DLL_EXPORT Analysis_Job<double>;
 
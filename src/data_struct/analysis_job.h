@@ -69,6 +69,12 @@ namespace data_struct
 
     enum class OPTIMIZE_FIT_ROUTINE { ALL_PARAMS, HYBRID };
 
+    /**
+     * PIXEL : pixels are spread over num_threads workers, each model evaluation is single threaded.
+     * INTRA_FIT : one spectra (integrated / standard) is fit at a time, model evaluations use num_threads.
+     */
+    enum class PARALLELISM_POLICY { PIXEL, INTRA_FIT };
+
 ///
 /// \brief The Analysis_Job class
 ///
@@ -89,8 +95,16 @@ public:
 
     fitting::optimizers::Optimizer<T_real>* optimizer(){return _optimizer;}
 
+    /**
+     * @brief new_optimizer : new optimizer of the type optimizer() is set to, with the same options. For fits running
+     *        concurrently, which must not share one. Caller deletes it.
+     */
+    fitting::optimizers::Optimizer<T_real>* new_optimizer();
+
     void init_fit_routines(size_t spectra_samples, bool force=false);
 
+    size_t model_threads(PARALLELISM_POLICY policy, size_t concurrent_fits = 1) const { return (policy == PARALLELISM_POLICY::INTRA_FIT) ? std::max((size_t)1, num_threads / std::max((size_t)1, concurrent_fits)) : 1; }
+
     std::string command_line;
 
     std::string dataset_directory;
@@ -151,6 +165,14 @@ public:
 
 	std::string update_quant_ds_amps_str;
 
+    // hdf5 output filters from the command line, take priority over the override file
+    std::string compression;
+
+    std::string spectra_compression;
+
+    // > 1 fits the matrix routine pixels with the batched lm solver instead of optimizer()
+    size_t fit_batch_size;
+
     OPTIMIZE_FIT_ROUTINE optimize_fit_routine;
 
     //list of quantification standards to use
@@ -49,6 +49,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "element_info.h"
 #include <cmath>
+#include <algorithm>
 
 namespace data_struct
 {
@@ -216,28 +217,51 @@ void Element_Info<T_real>::init_extra_energies(int len)
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+bool Element_Info<T_real>::find_energy_bracket(T_real energy, size_t* out_low_idx, size_t* out_high_idx) const
+{
+    // first grid point above energy, the henke grid is ascending but not evenly log spaced so binary search it
+    if (energies->size() < 2)
+    {
+        return false;
+    }
+    size_t idx = std::upper_bound(energies->begin() + 1, energies->end(), energy, [](T_real e, float grid_e) { return e < (T_real)grid_e; }) - energies->begin();
+    if (idx == energies->size())
+    {
+        return false;
+    }
+    *out_low_idx = idx - 1;
+    *out_high_idx = idx;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 void Element_Info<T_real>::get_energies_between(T_real energy, T_real* out_low, T_real* out_high, size_t* out_low_idx, size_t* out_high_idx)
 {
+    const size_t len = energies->size();
     *out_low_idx = 0;
-    *out_high_idx = energies->size()-1;
-    for(size_t l = 0; l < energies->size()-1; l++)
+    *out_high_idx = len - 1;
+    if (len < 2)
     {
-        if(energy < (*energies)[l+1])
-        {
-            *out_low_idx = l;
-            *out_low = (*energies)[l];
-            break;
-        }
+        return;
     }
-    for(size_t h = energies->size()-1; h > 1; h--)
+    // low: grid point below the first one above energy
+    size_t low_idx = 0;
+    size_t above_idx = 0;
+    if (find_energy_bracket(energy, &low_idx, &above_idx))
     {
-        if(energy > (*energies)[h-1])
-        {
-            *out_high_idx = h;
-            *out_high = (*energies)[h];
-            break;
-        }
+        *out_low_idx = low_idx;
+        *out_low = (*energies)[low_idx];
+    }
+    // high: first grid point at or above energy, clamped to the last point and never below 2
+    size_t high_idx = std::lower_bound(energies->begin(), energies->end(), energy, [](float grid_e, T_real e) { return (T_real)grid_e < e; }) - energies->begin();
+    high_idx = std::min(high_idx, len - 1);
+    if (high_idx > 1)
+    {
+        *out_high_idx = high_idx;
+        *out_high = (*energies)[high_idx];
     }
 }
 
@@ -250,7 +274,6 @@ T_real Element_Info<T_real>::calc_beta(T_real density_val, T_real energy)
     T_real molecules_per_cc = 0.0;
     T_real atwt = Element_Weight<T_real>.at(this->number);
     size_t low_e_idx=0, high_e_idx=0;
-    bool found_indexes = false;
 
     ////z = wo+1
     if (atwt != 0.0)
@@ -264,17 +287,7 @@ T_real Element_Info<T_real>::calc_beta(T_real density_val, T_real energy)
     T_real constant = RE * ((T_real)1.0e-16 * wavelength_angstroms * wavelength_angstroms) * molecules_per_cc / ((T_real)2.0 * (T_real)M_PI);
 
 
-    for(size_t i=1; i< energies->size(); i++)
-    {
-        if( (*energies)[i] > energy)
-        {
-            low_e_idx = i - 1;
-            high_e_idx = i;
-            found_indexes = true;
-            break;
-        }
-    }
-    if(false == found_indexes)
+    if(false == find_energy_bracket(energy, &low_e_idx, &high_e_idx))
     {
         //if(name != "Be" && name != "Ge")
         //{
@@ -310,19 +323,8 @@ T_real Element_Info<T_real>::get_f2(T_real energy)
     T_real molecules_per_cc = 0.0;
    
     size_t low_e_idx = 0, high_e_idx = 0;
-    bool found_indexes = false;
 
-    for (size_t i = 1; i < energies->size(); i++)
-    {
-        if ((*energies)[i] > energy)
-        {
-            low_e_idx = i - 1;
-            high_e_idx = i;
-            found_indexes = true;
-            break;
-        }
-    }
-    if (false == found_indexes)
+    if (false == find_energy_bracket(energy, &low_e_idx, &high_e_idx))
     {
         return f2;
     }
@@ -70,6 +70,9 @@ struct DLL_EXPORT Element_Info
 	void init_extra_energies(int len);
     void get_energies_between(T_real energy, T_real* out_low, T_real* out_high, size_t* out_low_idx, size_t* out_high_idx);
 
+    /// \brief Indexes of the henke grid points around energy (first point above energy and the one before it). False if energy is past the grid.
+    bool find_energy_bracket(T_real energy, size_t* out_low_idx, size_t* out_high_idx) const;
+
     T_real calc_beta(T_real density_val, T_real energy);
 
     T_real get_f2(T_real energy);
@@ -129,6 +132,8 @@ public:
 
     bool contains(std::string element_name) {return _name_element_info_map.count(element_name) > 0 ? true : false; }
 
+    const std::map<int, Element_Info<T_real>*>& elements() const { return _number_element_info_map; }
+
     std::vector<float> _energies;
 
 private:
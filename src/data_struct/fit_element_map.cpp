@@ -54,6 +54,11 @@ namespace data_struct
 
 //-----------------------------------------------------------------------------
 
+template<typename T_real>
+std::atomic<size_t> Fit_Element_Map<T_real>::_next_revision(0);
+
+//-----------------------------------------------------------------------------
+
 template<typename T_real>
 Fit_Element_Map<T_real>::Fit_Element_Map(std::string name, Element_Info<T_real>* element_info)
 {
@@ -70,6 +75,8 @@ Fit_Element_Map<T_real>::Fit_Element_Map(std::string name, Element_Info<T_real>*
 
     _width = 0;
 
+    _revision = _next_revision++;
+
     size_t num_ratios = 1;
 
     int idx = _full_name.find_last_of("_") + 1;
@@ -124,6 +131,7 @@ void Fit_Element_Map<T_real>::init_energy_ratio_for_detector_element(const Eleme
     //T_real weight =  Element_Weight.at(element_info->number);
 
     _energy_ratios.clear();
+    _revision = _next_revision++;
 
     if (_shell_type == "K") // K line
     {
@@ -299,6 +307,7 @@ void Fit_Element_Map<T_real>::set_as_pileup(std::string name, Element_Info<T_rea
         }
         _full_name += "_"+name;
         _pileup_element_info = element_info;
+        _revision = _next_revision++;
     }
     else
     {
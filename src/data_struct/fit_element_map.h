@@ -52,6 +52,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "core/defines.h"
 #include "data_struct/fit_parameters.h"
 #include "data_struct/element_info.h"
+#include <atomic>
+#include <algorithm>
+#include <vector>
 
 namespace data_struct
 {
@@ -167,6 +170,10 @@ public:
 	const string& shell_type_as_string() const { return _shell_type; }
 
 	bool check_binding_energy(T_real incident_energy, int energy_ratio_idx) const;
+
+    // changes every time the energy ratios or pileup are regenerated, unique across all element maps
+    size_t revision() const { return _revision; }
+
 protected:
 
     void generate_energy_ratio(T_real energy, T_real ratio, Element_Param_Type et, const Element_Info<T_real> * const detector_element);
@@ -186,6 +193,10 @@ protected:
 
     Element_Info<T_real>* _pileup_element_info;
     std::string _pileup_shell_type;
+
+    size_t _revision;
+
+    static std::atomic<size_t> _next_revision;
 };
 
 TEMPLATE_CLASS_DLL_EXPORT Fit_Element_Map<float>;
@@ -222,6 +233,100 @@ DLL_EXPORT Fit_Element_Map<T_real>* gen_element_map(std::string element_symb)
 template<typename T_real>
 using Fit_Element_Map_Dict = std::unordered_map<std::string, Fit_Element_Map<T_real>*>;
 
+//-----------------------------------------------------------------------------
+
+// Save order is element Z number with K, L, M lines followed by the rest of the keys (Num_Iter, Residual, ...)
+template<typename T_val>
+std::vector<std::string> get_element_save_order(const std::unordered_map<std::string, T_val>& element_counts)
+{
+    std::vector<std::string> element_lines;
+    for (const std::string& el_name : Element_Symbols)
+    {
+        if (element_counts.count(el_name) > 0)
+        {
+            element_lines.push_back(el_name);
+        }
+    }
+    for (const std::string& el_name : Element_Symbols)
+    {
+        if (element_counts.count(el_name + "_L") > 0)
+        {
+            element_lines.push_back(el_name + "_L");
+        }
+    }
+    for (const std::string& el_name : Element_Symbols)
+    {
+        if (element_counts.count(el_name + "_M") > 0)
+        {
+            element_lines.push_back(el_name + "_M");
+        }
+    }
+
+    //add the rest 
+    for (const auto& itr : element_counts)
+    {
+        if (std::find(element_lines.begin(), element_lines.end(), itr.first) == element_lines.end())
+        {
+            element_lines.push_back(itr.first);
+        }
+    }
+    return element_lines;
+}
+
+//-----------------------------------------------------------------------------
+
+///
+/// \brief The Fit_Count_Tensor class : dense [plane][row][col] counts of one fit routine over a volume. Planes are in
+///        the order of the names given, plane_index() is meant to be resolved once per routine, not per pixel.
+///
+template<typename T_real>
+class Fit_Count_Tensor
+{
+public:
+
+    Fit_Count_Tensor(const std::vector<std::string>& names, size_t rows, size_t cols) : _names(names), _rows(rows), _cols(cols)
+    {
+        for (size_t p = 0; p < _names.size(); p++)
+        {
+            _index[_names[p]] = p;
+        }
+        _data.assign(_names.size() * _rows * _cols, (T_real)0.0);
+    }
+
+    const std::vector<std::string>& names() const { return _names; }
+
+    size_t planes() const { return _names.size(); }
+
+    size_t rows() const { return _rows; }
+
+    size_t cols() const { return _cols; }
+
+    // -1 if there is no plane for name
+    int plane_index(const std::string& name) const
+    {
+        auto itr = _index.find(name);
+        return (itr == _index.end()) ? -1 : static_cast<int>(itr->second);
+    }
+
+    T_real& at(size_t plane, size_t row, size_t col) { return _data[(((plane * _rows) + row) * _cols) + col]; }
+
+    const T_real* data() const { return _data.data(); }
+
+    Eigen::Map<const ArrayXXr<T_real> > plane(size_t plane) const { return Eigen::Map<const ArrayXXr<T_real> >(_data.data() + (plane * _rows * _cols), _rows, _cols); }
+
+private:
+
+    std::vector<std::string> _names;
+
+    std::unordered_map<std::string, size_t> _index;
+
+    size_t _rows;
+
+    size_t _cols;
+
+    std::vector<T_real> _data;
+};
+
 } //namespace data_struct
 
 #endif // Fit_Element_Map_H
@@ -93,6 +93,8 @@ public:
         ge_dead_layer = "0.0";
         airpath = "0";
         theta_pv = "";
+        compression = "";
+        spectra_compression = "";
     }
 
     Params_Override(string dir, int detector)
@@ -115,6 +117,8 @@ public:
         dataset_directory = dir;
         detector_num = detector;
         detector_element = "Si";
+        compression = "";
+        spectra_compression = "";
     }
 
     ~Params_Override()
@@ -234,6 +238,10 @@ public:
 
     string theta_pv;
 
+    // hdf5 output filters, see io::file::parse_h5_compression()
+    string compression;
+    string spectra_compression;
+
     vector<string> branching_family_L;
     vector<string> branching_ratio_L;
     vector<string> branching_ratio_K;
@@ -50,6 +50,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define SPECTRA_H
 
 #include "core/defines.h"
+#include "core/cpu_dispatch.h"
 #include <Eigen/Core>
 #include <vector>
 #include <functional>
@@ -167,7 +168,7 @@ public:
 
     void add(const Spectra<_T>& spectra)
     {
-        *this += (ArrayTr<_T>)spectra;
+        _accumulate(spectra.data(), std::min((size_t)this->size(), (size_t)spectra.size()));
         _T val = spectra.elapsed_livetime();
         if(std::isfinite(val))
         {
@@ -196,10 +197,7 @@ public:
     {
         if (spectra != nullptr)
         {
-            for (int i = 0; i < this->size(); i++)
-            {
-                (ArrayTr<_T>(*this))(i) += static_cast<_T>( (*spectra)(i) );
-            }
+            _accumulate(spectra->data(), std::min((size_t)this->size(), (size_t)spectra->size()));
             _T val = spectra->elapsed_livetime();
             if (std::isfinite(val))
             {
@@ -246,6 +244,10 @@ public:
 
 private:
 
+    void _accumulate(const _T* src, size_t n) { cpu_kernels<_T>().accumulate(this->data(), src, n); }
+
+    void _accumulate(const Other_Real<_T>* src, size_t n) { cpu_kernels<_T>().accumulate_cvt(this->data(), src, n); }
+
     _T _elapsed_livetime;
     _T _elapsed_realtime;
     _T _input_counts;
@@ -271,14 +273,12 @@ DLL_EXPORT ArrayTr<T_real> convolve1d(const ArrayTr<T_real>& arr, const ArrayTr<
     ArrayTr<T_real> const& max_v = (nf < ng) ? boxcar : arr;
     size_t const n = std::max(nf, ng) - std::min(nf, ng) + 1;
     ArrayTr<T_real> out(n);
-    out.setZero(n);
+    // reversed kernel so every output is a dot product
+    ArrayTr<T_real> rev_min_v = min_v.reverse();
+    const CPU_Kernels<T_real>& kernels = cpu_kernels<T_real>();
     for (size_t i = 0; i < n; ++i)
     {
-        for (int j(min_v.size() - 1), k(i); j >= 0; --j)
-        {
-            out[i] += min_v[j] * max_v[k];
-            ++k;
-        }
+        out[i] = kernels.dot(rev_min_v.data(), max_v.data() + i, rev_min_v.size());
     }
     T_real norm = 1 / T_real(boxcar.size());
     int j = min_v.size() / 2;
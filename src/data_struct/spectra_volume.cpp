@@ -48,6 +48,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "spectra_volume.h"
+#include <algorithm>
+#include <array>
 
 namespace data_struct
 {
@@ -84,31 +86,70 @@ void Spectra_Volume<T_real>::resize_and_zero(size_t rows, size_t cols, size_t sa
 
 // ----------------------------------------------------------------------------
 
+static inline void accumulate_into_double(double* dst, const double* src, size_t n)
+{
+    cpu_kernels<double>().accumulate(dst, src, n);
+}
+
+static inline void accumulate_into_double(double* dst, const float* src, size_t n)
+{
+    cpu_kernels<double>().accumulate_cvt(dst, src, n);
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 Spectra<T_real> Spectra_Volume<T_real>::integrate()
 {
+    const size_t samples = samples_size();
+    const size_t num_pixels = rows() * cols();
+    if (num_pixels == 0)
+    {
+        return Spectra<T_real>(samples);
+    }
+
+    // Pixels are summed in double over a fixed number of blocks, then the blocks are added pairwise. Block
+    // boundaries do not depend on the thread count so the result is the same for any --nthreads.
+    const size_t num_blocks = std::min(num_pixels, (size_t)256);
+    const size_t num_cols = cols();
+    std::vector<ArrayTr<double>> block_sums(num_blocks);
+    std::vector<std::array<double, 4>> block_meta(num_blocks);
+
+#pragma omp parallel for schedule(static)
+    for (long int b = 0; b < (long int)num_blocks; b++)
+    {
+        ArrayTr<double>& block_sum = block_sums[b];
+        std::array<double, 4>& meta = block_meta[b];
+        block_sum.setZero(samples);
+        meta.fill(0.0);
+        const size_t start = (num_pixels * b) / num_blocks;
+        const size_t end = (num_pixels * (b + 1)) / num_blocks;
+        for (size_t p = start; p < end; p++)
+        {
+            const Spectra<T_real>& spectra = _data_vol[p / num_cols][p % num_cols];
+            accumulate_into_double(block_sum.data(), spectra.data(), std::min(samples, (size_t)spectra.size()));
+            meta[0] += spectra.elapsed_livetime();
+            meta[1] += spectra.elapsed_realtime();
+            meta[2] += spectra.input_counts();
+            meta[3] += spectra.output_counts();
+        }
+    }
 
-    Spectra<T_real> i_spectra(_data_vol[0][0].size());
-    T_real elt = 0.0;
-    T_real ert = 0.0;
-    T_real in_cnt = 0.0;
-    T_real out_cnt = 0.0;
-    for(size_t i = 0; i < _data_vol.size(); i++)
+    const CPU_Kernels<double>& kernels = cpu_kernels<double>();
+    for (size_t stride = 1; stride < num_blocks; stride *= 2)
     {
-        for(size_t j = 0; j < _data_vol[0].size(); j++)
+        for (size_t b = 0; b + stride < num_blocks; b += 2 * stride)
         {
-            i_spectra += _data_vol[i][j];
-            elt += _data_vol[i][j].elapsed_livetime();
-            ert += _data_vol[i][j].elapsed_realtime();
-            in_cnt += _data_vol[i][j].input_counts();
-            out_cnt += _data_vol[i][j].output_counts();
+            kernels.accumulate(block_sums[b].data(), block_sums[b + stride].data(), samples);
+            kernels.accumulate(block_meta[b].data(), block_meta[b + stride].data(), 4);
         }
     }
 
-    i_spectra.elapsed_livetime(elt);
-    i_spectra.elapsed_realtime(ert);
-    i_spectra.input_counts(in_cnt);
-    i_spectra.output_counts(out_cnt);
+    Spectra<T_real> i_spectra(block_sums[0].template cast<T_real>());
+    i_spectra.elapsed_livetime((T_real)block_meta[0][0]);
+    i_spectra.elapsed_realtime((T_real)block_meta[0][1]);
+    i_spectra.input_counts((T_real)block_meta[0][2]);
+    i_spectra.output_counts((T_real)block_meta[0][3]);
 
     i_spectra.recalc_elapsed_livetime();
 
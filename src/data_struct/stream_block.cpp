@@ -187,7 +187,8 @@ size_t Stream_Block<T_real>::dataset_hash()
 {
     if (dataset_directory != nullptr && dataset_name != nullptr)
     {
-        return std::hash<std::string> {} ((*dataset_directory) + (*dataset_name)) + _detector;
+        // detectors of the same dataset share a hash, the end block has no detector
+        return std::hash<std::string> {} ((*dataset_directory) + (*dataset_name));
     }
     return -1;
 }
@@ -79,7 +79,7 @@ public:
     /**
      * @brief Base_Model : Constructor
      */
-    Base_Model() {}
+    Base_Model() { _num_threads = 1; }
 
     /**
      * @brief ~Base_Model : Destructor
@@ -92,6 +92,14 @@ public:
      */
     virtual const Fit_Parameters<T_real>& fit_parameters() const = 0;
 
+    /**
+     * @brief set_num_threads : threads one model_spectrum_mp call may use. Keep at 1 when the model is evaluated from
+     *                          thread pool workers, see Analysis_Job::model_threads()
+     */
+    void set_num_threads(size_t num_threads) { _num_threads = std::max((size_t)1, num_threads); }
+
+    size_t num_threads() const { return _num_threads; }
+
     /**
      * @brief model_spectrum : Model a spectra based on the fit parameters passed in.
      * @param fit_params : Fitting parameters required to model the spectra.
@@ -117,6 +125,24 @@ public:
                                                  const ArrayTr<T_real>  &ev,
                                                  unordered_map<string, ArrayTr<T_real> >* labeled_spectras) = 0;
 
+    /**
+     * @brief model_spectrum_elements : model of every element in elements_to_fit (except scattering) saved by element name
+     */
+    virtual void model_spectrum_elements(const Fit_Parameters<T_real> * const fitp,
+                                         const Fit_Element_Map_Dict<T_real> * const elements_to_fit,
+                                         const ArrayTr<T_real>  &ev,
+                                         unordered_map<string, Spectra<T_real> >* element_spectras)
+    {
+        for (const auto& itr : *elements_to_fit)
+        {
+            if (itr.first == STR_COHERENT_SCT_AMPLITUDE || itr.first == STR_COMPTON_AMPLITUDE)
+            {
+                continue;
+            }
+            (*element_spectras)[itr.first] = model_spectrum_element(fitp, itr.second, ev, nullptr);
+        }
+    }
+
     virtual const ArrayTr<T_real>  peak(T_real gain, T_real sigma, const ArrayTr<T_real> & delta_energy) const = 0;
 
     virtual const ArrayTr<T_real>  step(T_real gain, T_real sigma, const ArrayTr<T_real> & delta_energy, T_real peak_E) const = 0;
@@ -135,7 +161,7 @@ public:
 
 protected:
 
-
+    size_t _num_threads;
 
 private:
 
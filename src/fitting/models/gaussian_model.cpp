@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "gaussian_model.h"
+#include "core/cpu_dispatch.h"
 
 #include <iostream>
 #include <algorithm>
@@ -69,10 +70,154 @@ namespace models
 
 // ----------------------------------------------------------------------------
 
+template<typename T_real>
+bool Emission_Line_Table<T_real>::matches(const Fit_Element_Map_Dict<T_real>* const elements_to_fit, T_real incident_energy_) const
+{
+    if (incident_energy != incident_energy_)
+    {
+        return false;
+    }
+    size_t e = 0;
+    for (const auto& itr : (*elements_to_fit))
+    {
+        if (itr.first == STR_COHERENT_SCT_AMPLITUDE || itr.first == STR_COMPTON_AMPLITUDE)
+        {
+            continue;
+        }
+        if (e >= elements.size() || elements[e] != itr.second || revisions[e] != itr.second->revision() || names[e] != itr.first)
+        {
+            return false;
+        }
+        e++;
+    }
+    return e == elements.size();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Emission_Line_Table<T_real>::build(const Fit_Element_Map_Dict<T_real>* const elements_to_fit, T_real incident_energy_)
+{
+    *this = Emission_Line_Table<T_real>();
+    incident_energy = incident_energy_;
+    line_start.push_back(0);
+    for (const auto& itr : (*elements_to_fit))
+    {
+        if (itr.first == STR_COHERENT_SCT_AMPLITUDE || itr.first == STR_COMPTON_AMPLITUDE)
+        {
+            continue;
+        }
+        _add_element(itr.first, itr.second);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Emission_Line_Table<T_real>::build(const Fit_Element_Map<T_real>* const element_to_fit, T_real incident_energy_)
+{
+    *this = Emission_Line_Table<T_real>();
+    incident_energy = incident_energy_;
+    line_start.push_back(0);
+    _add_element(element_to_fit->full_name(), element_to_fit);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Emission_Line_Table<T_real>::_add_element(const std::string& name, const Fit_Element_Map<T_real>* const element_to_fit)
+{
+    size_t e = elements.size();
+    names.push_back(name);
+    elements.push_back(element_to_fit);
+    revisions.push_back(element_to_fit->revision());
+
+    const vector<Element_Energy_Ratio<T_real>>& energy_ratios = element_to_fit->energy_ratios();
+    for (int idx = 0; idx < (int)energy_ratios.size(); idx++)
+    {
+        const Element_Energy_Ratio<T_real>& er_struct = energy_ratios[idx];
+        //don't process if energy is 0
+        if (er_struct.ratio == 0.0 || er_struct.energy <= 0.0)
+        {
+            continue;
+        }
+
+        string line_label = "";
+        bool line_kb = false;
+        bool line_normalized = false;
+        switch (er_struct.ptype)
+        {
+        case Element_Param_Type::Kb1_Line:
+        case Element_Param_Type::Kb2_Line:
+            line_label = STR_K_B_LINES;
+            line_kb = true;
+            break;
+        case Element_Param_Type::Ka1_Line:
+        case Element_Param_Type::Ka2_Line:
+            line_label = STR_K_A_LINES;
+            line_normalized = true;
+            break;
+        case Element_Param_Type::La1_Line:
+        case Element_Param_Type::La2_Line:
+        case Element_Param_Type::Lb1_Line:
+        case Element_Param_Type::Lb2_Line:
+        case Element_Param_Type::Lb3_Line:
+        case Element_Param_Type::Lb4_Line:
+        case Element_Param_Type::Lg1_Line:
+        case Element_Param_Type::Lg2_Line:
+        case Element_Param_Type::Lg3_Line:
+        case Element_Param_Type::Lg4_Line:
+        case Element_Param_Type::Ll_Line:
+        case Element_Param_Type::Ln_Line:
+            line_label = STR_L_LINES;
+            line_normalized = true;
+            break;
+        default:
+            break;
+        }
+        if (line_label.length() > 0 && element_to_fit->pileup_element() != nullptr)
+        {
+            line_label = STR_PILEUP_LINES;
+        }
+
+        energy.push_back(er_struct.energy);
+        ratio.push_back(er_struct.ratio);
+        mu_fraction.push_back(er_struct.mu_fraction);
+        ptype.push_back(er_struct.ptype);
+        element_idx.push_back(e);
+        binding_enabled.push_back(element_to_fit->check_binding_energy(incident_energy, idx));
+        is_kb.push_back(line_kb);
+        normalized.push_back(line_normalized);
+        label.push_back(line_label);
+    }
+    line_start.push_back(energy.size());
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+Line_Shape_Params<T_real>::Line_Shape_Params(const Fit_Parameters<T_real>* const fitp)
+{
+    gain = fitp->at(STR_ENERGY_SLOPE).value;
+    sigma_offset_sq = std::pow((fitp->at(STR_FWHM_OFFSET).value / (T_real)2.3548), (T_real)2.0);
+    fwhm_fanoprime = fitp->at(STR_FWHM_FANOPRIME).value;
+    f_step_offset = fitp->at(STR_F_STEP_OFFSET).value;
+    f_step_linear = fitp->at(STR_F_STEP_LINEAR).value;
+    f_tail_offset = fitp->at(STR_F_TAIL_OFFSET).value;
+    f_tail_linear = fitp->at(STR_F_TAIL_LINEAR).value;
+    kb_f_tail_offset = fitp->at(STR_KB_F_TAIL_OFFSET).value;
+    kb_f_tail_linear = fitp->at(STR_KB_F_TAIL_LINEAR).value;
+    gamma_offset = fitp->at(STR_GAMMA_OFFSET).value;
+    gamma_linear = fitp->at(STR_GAMMA_LINEAR).value;
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename T_real>
 Gaussian_Model<T_real>::Gaussian_Model() : Base_Model<T_real>()
 {
     _fit_parameters = _generate_default_fit_parameters();
+    _erfc_accuracy = ERFC_ACCURACY::ERFC_FAST;
 }
 
 // ----------------------------------------------------------------------------
@@ -331,15 +476,22 @@ const Spectra<T_real> Gaussian_Model<T_real>::model_spectrum(const Fit_Parameter
 	ArrayTr<T_real> energy = ArrayTr<T_real>::LinSpaced(energy_range.count(), energy_range.min, energy_range.max);
     ArrayTr<T_real> ev = energy_offset + (energy * energy_slope) + (pow(energy, (T_real)2.0) * energy_quad);
 
-    for(const auto& itr : (*elements_to_fit))
+    const Emission_Line_Table<T_real>& table = _line_table(elements_to_fit, fit_params->value(STR_COHERENT_SCT_ENERGY));
+    if (table.num_lines() > 0)
     {
-        if(itr.first == STR_COHERENT_SCT_AMPLITUDE || itr.first == STR_COMPTON_AMPLITUDE)
+        Line_Shape_Params<T_real> lsp(fit_params);
+        for (size_t e = 0; e < table.num_elements(); e++)
         {
-            continue;
-        }
-        else
-        {
-            agr_spectra += model_spectrum_element(fit_params, itr.second, ev, labeled_spectras);
+            const Fit_Element_Map<T_real>* element_to_fit = table.elements[e];
+            if (false == fit_params->contains(element_to_fit->full_name()))
+            {
+                continue;
+            }
+            T_real pre_faktor = std::pow((T_real)10.0, fit_params->at(element_to_fit->full_name()).value);
+            if (std::isfinite(pre_faktor))
+            {
+                _model_element_lines(lsp, table, e, pre_faktor, ev, agr_spectra, labeled_spectras);
+            }
         }
     }
 
@@ -387,23 +539,29 @@ const Spectra<T_real> Gaussian_Model<T_real>::model_spectrum_mp(const Fit_Parame
     ArrayTr<T_real> energy = ArrayTr<T_real>::LinSpaced(energy_range.count(), energy_range.min, energy_range.max);
     ArrayTr<T_real> ev = energy_offset + (energy * energy_slope) + (pow(energy, (T_real)2.0) * energy_quad);
 
-    std::vector<std::string> keys;
-    for (const auto& itr : (*elements_to_fit))
+    const Emission_Line_Table<T_real>& table = _line_table(elements_to_fit, fit_params->value(STR_COHERENT_SCT_ENERGY));
+    if (table.num_lines() > 0)
     {
-        if(itr.first == STR_COHERENT_SCT_AMPLITUDE || itr.first == STR_COMPTON_AMPLITUDE)
+        Line_Shape_Params<T_real> lsp(fit_params);
+        // no omp team when called from thread pool workers (num_threads 1), each thread sums into its own spectra
+        const int n_threads = (int)std::min(this->_num_threads, table.num_elements());
+        std::vector<Spectra<T_real>> thread_spectras(std::max(n_threads, 1), Spectra<T_real>(ev.size()));
+#pragma omp parallel for num_threads(n_threads) schedule(dynamic) if(n_threads > 1)
+        for (int e = 0; e < (int)table.num_elements(); e++)
         {
-            continue;
-        }
-        else
-        {
-            keys.push_back(itr.first);
+            const Fit_Element_Map<T_real>* element_to_fit = table.elements[e];
+            if (false == fit_params->contains(element_to_fit->full_name()))
+            {
+                continue;
+            }
+            T_real pre_faktor = std::pow((T_real)10.0, fit_params->at(element_to_fit->full_name()).value);
+            if (false == std::isfinite(pre_faktor))
+            {
+                continue;
+            }
+            _model_element_lines(lsp, table, e, pre_faktor, ev, thread_spectras[omp_get_thread_num()], nullptr);
         }
-    }
-#pragma omp parallel for
-    for (int i=0; i < (int)keys.size(); i++)
-    {
-        Spectra<T_real> tmp = model_spectrum_element(fit_params, elements_to_fit->at(keys[i]), ev, nullptr);
-#pragma omp critical
+        for (const auto& tmp : thread_spectras)
         {
             agr_spectra += tmp;
         }
@@ -437,133 +595,155 @@ const Spectra<T_real> Gaussian_Model<T_real>::model_spectrum_element(const Fit_P
     if(false == std::isfinite(pre_faktor))
         return spectra_model;
 
-    //T_real fwhm_offset = fitp->value(STR_FWHM_OFFSET);
-    const vector<Element_Energy_Ratio<T_real>> energy_ratios = element_to_fit->energy_ratios();
-
-    //for (const Element_Energy_Ratio& er_struct : element_to_fit->energy_ratios())
-    for (int idx = 0; idx < energy_ratios.size(); idx++)
+    Emission_Line_Table<T_real> table;
+    table.build(element_to_fit, fitp->value(STR_COHERENT_SCT_ENERGY));
+    if (table.num_lines() > 0)
     {
-        const Element_Energy_Ratio<T_real>& er_struct = energy_ratios.at(idx);
-        T_real sigma = std::sqrt(std::pow((fitp->at(STR_FWHM_OFFSET).value / (T_real)2.3548), (T_real)2.0) + (er_struct.energy) * (T_real)2.96 * fitp->at(STR_FWHM_FANOPRIME).value);
-        T_real f_step =  std::abs<T_real>( er_struct.mu_fraction * ( fitp->at(STR_F_STEP_OFFSET).value + (fitp->at(STR_F_STEP_LINEAR).value * er_struct.energy)));
-        T_real f_tail = std::abs<T_real>( fitp->at(STR_F_TAIL_OFFSET).value + (fitp->at(STR_F_TAIL_LINEAR).value * er_struct.mu_fraction));
-        T_real kb_f_tail = std::abs<T_real>(  fitp->at(STR_KB_F_TAIL_OFFSET).value + (fitp->at(STR_KB_F_TAIL_LINEAR).value * er_struct.mu_fraction));
-        T_real value = 1.0;
+        _model_element_lines(Line_Shape_Params<T_real>(fitp), table, 0, pre_faktor, ev, spectra_model, labeled_spectras);
+    }
+    return spectra_model;
+}
 
-        //don't process if energy is 0
-        if (er_struct.ratio == 0.0)
-            continue;
-        if (er_struct.energy <= 0.0)
-            continue;
+// ----------------------------------------------------------------------------
 
-        // gaussian peak shape
-		ArrayTr<T_real> delta_energy = ev - er_struct.energy;
-
-        string label = "";
-
-        T_real incident_energy = fitp->at(STR_COHERENT_SCT_ENERGY).value;
-
-        T_real faktor = T_real(er_struct.ratio * pre_faktor);
-		if (element_to_fit->check_binding_energy(incident_energy, idx))
-		{
-			switch (er_struct.ptype)
-			{
-			case Element_Param_Type::Kb1_Line:
-				label = STR_K_A_LINES;
-			case Element_Param_Type::Kb2_Line:
-				label = STR_K_B_LINES;
-				faktor = faktor / ((T_real)1.0 + kb_f_tail + f_step);
-				break;
-			case Element_Param_Type::Ka1_Line:
-			case Element_Param_Type::Ka2_Line:
-				label = STR_K_A_LINES;
-				faktor = faktor / ((T_real)1.0 + f_tail + f_step);
-				break;
-			case Element_Param_Type::La1_Line:
-			case Element_Param_Type::La2_Line:
-			case Element_Param_Type::Lb1_Line:
-			case Element_Param_Type::Lb2_Line:
-			case Element_Param_Type::Lb3_Line:
-			case Element_Param_Type::Lb4_Line:
-			case Element_Param_Type::Lg1_Line:
-			case Element_Param_Type::Lg2_Line:
-			case Element_Param_Type::Lg3_Line:
-			case Element_Param_Type::Lg4_Line:
-			case Element_Param_Type::Ll_Line:
-			case Element_Param_Type::Ln_Line:
-				label = STR_L_LINES;
-				faktor = faktor / ((T_real)1.0 + f_tail + f_step);
-				break;
-			default:
-				break;
-			}
-		}
-		else
-		{
-			faktor = (T_real)0.0;
-		}
-
-
-        if (labeled_spectras != nullptr && label.length() > 0)
+template<typename T_real>
+void Gaussian_Model<T_real>::model_spectrum_elements(const Fit_Parameters<T_real>* const fitp,
+                                                     const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                     const ArrayTr<T_real> &ev,
+                                                     unordered_map<string, Spectra<T_real>>* element_spectras)
+{
+    const Emission_Line_Table<T_real>& table = _line_table(elements_to_fit, fitp->value(STR_COHERENT_SCT_ENERGY));
+    if (table.num_lines() == 0)
+    {
+        for (const auto& name : table.names)
         {
-            Spectra<T_real> tmp_spec(ev.size());
-            // peak, gauss
-            tmp_spec += faktor * this->peak(fitp->at(STR_ENERGY_SLOPE).value, sigma, delta_energy);
-            ////spectra_model += faktor * (fitp->at(STR_ENERGY_SLOPE).value / ( sigma * SQRT_2xPI ) *  Eigen::exp((T_real)-0.5 * Eigen::pow((delta_energy / sigma), (T_real)2.0) ) );
+            (*element_spectras)[name] = Spectra<T_real>(ev.size());
+        }
+        return;
+    }
 
-            //  peak, step
-            if (f_step > 0.0)
-            {
-                value = faktor * f_step;
-                //value = value * this->step(gain, sigma, delta_energy, er_struct.energy);
-                tmp_spec += value * this->step(fitp->at(STR_ENERGY_SLOPE).value, sigma, delta_energy, er_struct.energy);
-                //counts_arr->step = fit_counts.step + value;
-            }
-            //  peak, tail;; use different tail for K beta vs K alpha lines
-            if (er_struct.ptype == Element_Param_Type::Kb1_Line || er_struct.ptype == Element_Param_Type::Kb2_Line)
+    Line_Shape_Params<T_real> lsp(fitp);
+    for (size_t e = 0; e < table.num_elements(); e++)
+    {
+        const Fit_Element_Map<T_real>* element_to_fit = table.elements[e];
+        Spectra<T_real> spectra_model(ev.size());
+        if (fitp->contains(element_to_fit->full_name()))
+        {
+            T_real pre_faktor = std::pow((T_real)10.0, fitp->at(element_to_fit->full_name()).value);
+            if (std::isfinite(pre_faktor))
             {
-                T_real gamma = std::abs(fitp->at(STR_GAMMA_OFFSET).value + fitp->at(STR_GAMMA_LINEAR).value * (er_struct.energy)) * element_to_fit->width_multi();
-                value = faktor * kb_f_tail;
-                tmp_spec += value * this->tail(fitp->at(STR_ENERGY_SLOPE).value, sigma, delta_energy, gamma);
-                //fit_counts.tail = fit_counts.tail + value;
+                _model_element_lines(lsp, table, e, pre_faktor, ev, spectra_model, nullptr);
             }
+        }
+        (*element_spectras)[table.names[e]] = spectra_model;
+    }
+}
 
-            if (element_to_fit->pileup_element() != nullptr) // check if it is pileup 
-            {
-                (*labeled_spectras)[STR_PILEUP_LINES] += tmp_spec;
-            }
-            else
-            {
-                (*labeled_spectras)[label] += tmp_spec;
-            }
-            spectra_model += tmp_spec;
+// ----------------------------------------------------------------------------
 
+template<typename T_real>
+void Gaussian_Model<T_real>::_model_element_lines(const Line_Shape_Params<T_real>& lsp,
+                                                  const Emission_Line_Table<T_real>& table,
+                                                  size_t element_idx,
+                                                  T_real pre_faktor,
+                                                  const ArrayTr<T_real>& ev,
+                                                  Spectra<T_real>& spectra_model,
+                                                  unordered_map<string, ArrayTr<T_real>>* labeled_spectras) const
+{
+    T_real width_multi = table.elements[element_idx]->width_multi();
+    for (size_t i = table.line_start[element_idx]; i < table.line_start[element_idx + 1]; i++)
+    {
+        // faktor is 0 if the shell can not be excited
+        if (false == table.binding_enabled[i])
+        {
+            continue;
         }
-        else
+
+        const T_real energy = table.energy[i];
+        const T_real mu_fraction = table.mu_fraction[i];
+        T_real sigma = std::sqrt(lsp.sigma_offset_sq + energy * (T_real)2.96 * lsp.fwhm_fanoprime);
+        T_real f_step = std::abs<T_real>(mu_fraction * (lsp.f_step_offset + (lsp.f_step_linear * energy)));
+
+        T_real faktor = table.ratio[i] * pre_faktor;
+        T_real step_faktor = (T_real)0.0;
+        T_real tail_faktor = (T_real)0.0;
+        T_real gamma = (T_real)1.0;
+        if (table.is_kb[i])
         {
-            // peak, gauss
-            spectra_model += faktor * this->peak(fitp->at(STR_ENERGY_SLOPE).value, sigma, delta_energy);
-            ////spectra_model += faktor * (fitp->at(STR_ENERGY_SLOPE).value / ( sigma * SQRT_2xPI ) *  Eigen::exp((T_real)-0.5 * Eigen::pow((delta_energy / sigma), (T_real)2.0) ) );
+            T_real kb_f_tail = std::abs<T_real>(lsp.kb_f_tail_offset + (lsp.kb_f_tail_linear * mu_fraction));
+            faktor = faktor / ((T_real)1.0 + kb_f_tail + f_step);
+            gamma = std::abs(lsp.gamma_offset + lsp.gamma_linear * energy) * width_multi;
+            tail_faktor = faktor * kb_f_tail;
+        }
+        else if (table.normalized[i])
+        {
+            T_real f_tail = std::abs<T_real>(lsp.f_tail_offset + (lsp.f_tail_linear * mu_fraction));
+            faktor = faktor / ((T_real)1.0 + f_tail + f_step);
+        }
+        if (f_step > 0.0)
+        {
+            step_faktor = faktor * f_step;
+        }
 
-            //  peak, step
-            if (f_step > 0.0)
-            {
-                value = faktor * f_step;
-                //value = value * this->step(gain, sigma, delta_energy, er_struct.energy);
-                spectra_model += value * this->step(fitp->at(STR_ENERGY_SLOPE).value, sigma, delta_energy, er_struct.energy);
-                //counts_arr->step = fit_counts.step + value;
-            }
-            //  peak, tail;; use different tail for K beta vs K alpha lines
-            if (er_struct.ptype == Element_Param_Type::Kb1_Line || er_struct.ptype == Element_Param_Type::Kb2_Line)
-            {
-                T_real gamma = std::abs(fitp->at(STR_GAMMA_OFFSET).value + fitp->at(STR_GAMMA_LINEAR).value * (er_struct.energy)) * element_to_fit->width_multi();
-                value = faktor * kb_f_tail;
-                spectra_model += value * this->tail(fitp->at(STR_ENERGY_SLOPE).value, sigma, delta_energy, gamma);
-                //fit_counts.tail = fit_counts.tail + value;
-            }
+        // peak, step and tail in one pass
+        if (labeled_spectras != nullptr && table.label[i].length() > 0)
+        {
+            Spectra<T_real> tmp_spec = this->line_shape(lsp.gain, sigma, ev - energy, faktor, step_faktor, energy, tail_faktor, gamma);
+            (*labeled_spectras)[table.label[i]] += tmp_spec;
+            spectra_model += tmp_spec;
+        }
+        else if (_erfc_accuracy == ERFC_ACCURACY::ERFC_FAST)
+        {
+            // straight into the model, no temporaries
+            _line_shape_kernel(spectra_model.data(), ev, energy, lsp.gain, sigma, faktor, step_faktor, energy, tail_faktor, gamma);
+        }
+        else
+        {
+            spectra_model += this->line_shape(lsp.gain, sigma, ev - energy, faktor, step_faktor, energy, tail_faktor, gamma);
         }
     }
-    return spectra_model;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Gaussian_Model<T_real>::_line_shape_kernel(T_real* counts,
+                                                const ArrayTr<T_real>& ev,
+                                                T_real ev_offset,
+                                                T_real gain,
+                                                T_real sigma,
+                                                T_real peak_faktor,
+                                                T_real step_faktor,
+                                                T_real peak_E,
+                                                T_real tail_faktor,
+                                                T_real gamma) const
+{
+    T_real peak_scale = peak_faktor * gain / (sigma * (T_real)(SQRT_2xPI));
+    T_real step_scale = (T_real)0.0;
+    if (step_faktor > (T_real)0.0)
+    {
+        step_scale = step_faktor * gain / (T_real)2.0 / peak_E;
+    }
+    T_real tail_scale = (T_real)0.0;
+    if (tail_faktor != (T_real)0.0)
+    {
+        tail_scale = tail_faktor * gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5 / pow(gamma, (T_real)2.0));
+    }
+    cpu_kernels<T_real>().line_shape(counts, ev.data(), ev.size(), ev_offset, (T_real)1.0 / sigma, peak_scale, step_scale, tail_scale, (T_real)1.0 / gamma);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+const Emission_Line_Table<T_real>& Gaussian_Model<T_real>::_line_table(const Fit_Element_Map_Dict<T_real>* const elements_to_fit, T_real incident_energy) const
+{
+    // depends only on the elements, so one table per thread is shared by every model instance
+    thread_local Emission_Line_Table<T_real> table;
+    if (false == table.matches(elements_to_fit, incident_energy))
+    {
+        table.build(elements_to_fit, incident_energy);
+    }
+    return table;
 }
 
 // ----------------------------------------------------------------------------
@@ -580,15 +760,8 @@ const ArrayTr<T_real> Gaussian_Model<T_real>::peak(T_real gain, T_real sigma, co
 template<typename T_real>
 const ArrayTr<T_real> Gaussian_Model<T_real>::step(T_real gain, T_real sigma, const ArrayTr<T_real>& delta_energy, T_real peak_E) const
 {
-    //delta_energy = delta_energy.unaryExpr([sigma](T_real v) { return  (T_real)std::erfc(v  /( M_SQRT2*sigma)); } );
-    //return (gain / (T_real)2.0 / peak_E * delta_energy );
-    ArrayTr<T_real>counts(delta_energy.size());
-	for (unsigned int i = 0; i < delta_energy.size(); i++)
-	{
-        counts[i] = gain / (T_real)2.0 / peak_E * std::erfc((T_real)delta_energy[i] / ((T_real)(M_SQRT2) * sigma));
-	}
-    return counts;
-
+    // gain / 2.0 / peak_E * erfc(delta_energy/(M_SQRT2 * sigma))
+    return gain / (T_real)2.0 / peak_E * erfc(delta_energy / ((T_real)(M_SQRT2) * sigma));
 }
 
 // ----------------------------------------------------------------------------
@@ -596,8 +769,64 @@ const ArrayTr<T_real> Gaussian_Model<T_real>::step(T_real gain, T_real sigma, co
 template<typename T_real>
 const ArrayTr<T_real> Gaussian_Model<T_real>::tail(T_real gain, T_real sigma, ArrayTr<T_real> delta_energy, T_real gamma) const
 {
-    delta_energy = delta_energy.unaryExpr([sigma,gamma](T_real v) { return  (v < (T_real)0.0) ? std::exp(v/ (gamma * sigma)) * std::erfc(v / ((T_real)(M_SQRT2)*sigma) + ((T_real)1.0/(gamma*(T_real)(M_SQRT2)))) : std::erfc(v / ((T_real)(M_SQRT2)*sigma) + ((T_real)1.0/(gamma*(T_real)(M_SQRT2)))); } );
-    return( gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5/pow(gamma, (T_real)2.0)) * delta_energy);
+    // exp(delta_energy / (gamma * sigma)) only applies below the peak, min() keeps it 1.0 above without a branch
+    ArrayTr<T_real> counts = Eigen::exp(delta_energy.min((T_real)0.0) / (gamma * sigma)) * erfc(delta_energy / ((T_real)(M_SQRT2)*sigma) + ((T_real)1.0/(gamma*(T_real)(M_SQRT2))));
+    return( gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5/pow(gamma, (T_real)2.0)) * counts);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+const ArrayTr<T_real> Gaussian_Model<T_real>::line_shape(T_real gain,
+                                                         T_real sigma,
+                                                         const ArrayTr<T_real>& delta_energy,
+                                                         T_real peak_faktor,
+                                                         T_real step_faktor,
+                                                         T_real peak_E,
+                                                         T_real tail_faktor,
+                                                         T_real gamma) const
+{
+    if (_erfc_accuracy == ERFC_ACCURACY::ERFC_FAST)
+    {
+        ArrayTr<T_real> counts = ArrayTr<T_real>::Zero(delta_energy.size());
+        _line_shape_kernel(counts.data(), delta_energy, (T_real)0.0, gain, sigma, peak_faktor, step_faktor, peak_E, tail_faktor, gamma);
+        return counts;
+    }
+
+    ArrayTr<T_real> x = delta_energy / sigma;
+
+    // peak, gauss
+    ArrayTr<T_real> counts = (peak_faktor * gain / (sigma * (T_real)(SQRT_2xPI))) * Eigen::exp((T_real)-0.5 * x.square());
+
+    // peak, step
+    if (step_faktor > (T_real)0.0)
+    {
+        counts += (step_faktor * gain / (T_real)2.0 / peak_E) * erfc(x / (T_real)(M_SQRT2));
+    }
+
+    // peak, tail
+    if (tail_faktor != (T_real)0.0)
+    {
+        T_real tail_scale = tail_faktor * gain / (T_real)2.0 / gamma / sigma / exp((T_real)-0.5 / pow(gamma, (T_real)2.0));
+        counts += tail_scale * Eigen::exp(x.min((T_real)0.0) / gamma) * erfc((x / (T_real)(M_SQRT2)) + ((T_real)1.0 / (gamma * (T_real)(M_SQRT2))));
+    }
+    return counts;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+const ArrayTr<T_real> Gaussian_Model<T_real>::erfc(const ArrayTr<T_real>& x) const
+{
+    if (_erfc_accuracy == ERFC_ACCURACY::ERFC_LIBM)
+    {
+        return x.unaryExpr([](T_real v) { return (T_real)std::erfc(v); });
+    }
+
+    // Numerical Recipes erfcc, Chebyshev fit of erfc(|x|), erfc(-x) = 2 - erfc(x)
+    ArrayTr<T_real> r(x.size());
+    cpu_kernels<T_real>().erfc(r.data(), x.data(), x.size());
+    return r;
 }
 
 // ----------------------------------------------------------------------------
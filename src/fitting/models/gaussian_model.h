@@ -60,6 +60,88 @@ namespace models
 
 using namespace data_struct;
 
+/**
+ * @brief The ERFC_ACCURACY enum : how erfc is evaluated for the step and tail shapes.
+ *        ERFC_LIBM calls std::erfc per channel.
+ *        ERFC_FAST evaluates erfc with the cpu dispatched kernel, the default. Float uses the Chebyshev fit from Numerical
+ *        Recipes, absolute error < 4e-7. Double uses the cephes rational fits, fractional error < 1e-14 against libm over
+ *        [-10, 10].
+ */
+enum class ERFC_ACCURACY { ERFC_LIBM, ERFC_FAST };
+
+/**
+ * @brief The Emission_Line_Table struct : every emission line of every fitted element flattened into a structure of arrays.
+ *        Only depends on the element list and the incident energy, so it is rebuilt when one of them changes and not
+ *        per model evaluation. Lines with 0 ratio or energy are left out.
+ */
+template<typename T_real>
+struct DLL_EXPORT Emission_Line_Table
+{
+    Emission_Line_Table() { incident_energy = (T_real)0.0; }
+
+    bool matches(const Fit_Element_Map_Dict<T_real>* const elements_to_fit, T_real incident_energy) const;
+
+    void build(const Fit_Element_Map_Dict<T_real>* const elements_to_fit, T_real incident_energy);
+
+    void build(const Fit_Element_Map<T_real>* const element_to_fit, T_real incident_energy);
+
+    size_t num_elements() const { return elements.size(); }
+
+    size_t num_lines() const { return energy.size(); }
+
+    // per element, lines of element i are [line_start[i], line_start[i+1])
+    std::vector<std::string> names;
+    std::vector<const Fit_Element_Map<T_real>*> elements;
+    std::vector<size_t> revisions;
+    std::vector<size_t> line_start;
+
+    // per line
+    std::vector<T_real> energy;
+    std::vector<T_real> ratio;
+    std::vector<T_real> mu_fraction;
+    std::vector<Element_Param_Type> ptype;
+    std::vector<size_t> element_idx;
+    std::vector<bool> binding_enabled;
+    std::vector<bool> is_kb;
+    // 1 + f_tail + f_step normalization for K alpha and L lines, 1 + kb_f_tail + f_step for K beta, none for the rest
+    std::vector<bool> normalized;
+    // labeled spectra the line is added to, empty if it is not labeled
+    std::vector<std::string> label;
+
+    T_real incident_energy;
+
+protected:
+
+    void _add_element(const std::string& name, const Fit_Element_Map<T_real>* const element_to_fit);
+};
+
+TEMPLATE_STRUCT_DLL_EXPORT Emission_Line_Table<float>;
+TEMPLATE_STRUCT_DLL_EXPORT Emission_Line_Table<double>;
+
+/**
+ * @brief The Line_Shape_Params struct : fit parameters used by every emission line, read once per model evaluation
+ */
+template<typename T_real>
+struct Line_Shape_Params
+{
+    Line_Shape_Params(const Fit_Parameters<T_real>* const fitp);
+
+    T_real gain;
+    T_real sigma_offset_sq;
+    T_real fwhm_fanoprime;
+    T_real f_step_offset;
+    T_real f_step_linear;
+    T_real f_tail_offset;
+    T_real f_tail_linear;
+    T_real kb_f_tail_offset;
+    T_real kb_f_tail_linear;
+    T_real gamma_offset;
+    T_real gamma_linear;
+};
+
+TEMPLATE_STRUCT_DLL_EXPORT Line_Shape_Params<float>;
+TEMPLATE_STRUCT_DLL_EXPORT Line_Shape_Params<double>;
+
 template<typename T_real>
 class DLL_EXPORT Gaussian_Model: public Base_Model<T_real>
 {
@@ -86,6 +168,11 @@ public:
                                                             const ArrayTr<T_real> &ev,
                                                             unordered_map<string, ArrayTr<T_real>>* labeled_spectras);
 
+    virtual void model_spectrum_elements(const Fit_Parameters<T_real>* const fitp,
+                                         const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                         const ArrayTr<T_real> &ev,
+                                         unordered_map<string, Spectra<T_real>>* element_spectras);
+
     void set_fit_params_preset(Fit_Params_Preset lock_macro);
 
     /**
@@ -111,6 +198,28 @@ public:
 
     virtual const ArrayTr<T_real> tail(T_real gain, T_real sigma, ArrayTr<T_real> delta_energy, T_real gamma) const;
 
+    /**
+     * @brief line_shape : peak_faktor * peak + step_faktor * step + tail_faktor * tail of one line evaluated in one pass,
+     *                     sharing delta_energy / sigma between the shapes. A faktor of 0 skips that shape.
+     */
+    const ArrayTr<T_real> line_shape(T_real gain,
+                                     T_real sigma,
+                                     const ArrayTr<T_real>& delta_energy,
+                                     T_real peak_faktor,
+                                     T_real step_faktor,
+                                     T_real peak_E,
+                                     T_real tail_faktor,
+                                     T_real gamma) const;
+
+    /**
+     * @brief erfc : complementary error function of every channel, evaluated with the model's erfc accuracy
+     */
+    const ArrayTr<T_real> erfc(const ArrayTr<T_real>& x) const;
+
+    void set_erfc_accuracy(ERFC_ACCURACY accuracy) { _erfc_accuracy = accuracy; }
+
+    ERFC_ACCURACY erfc_accuracy() const { return _erfc_accuracy; }
+
     virtual const ArrayTr<T_real> elastic_peak(const Fit_Parameters<T_real>* const fitp, const ArrayTr<T_real>& ev, T_real gain) const;
 
     virtual const ArrayTr<T_real> compton_peak(const Fit_Parameters<T_real>* const fitp, const ArrayTr<T_real>& ev, T_real gain) const;
@@ -127,8 +236,41 @@ protected:
 
     Fit_Parameters<T_real> _generate_default_fit_parameters();
 
+    /**
+     * @brief _line_table : per thread line table for elements_to_fit, rebuilt only if it does not match
+     */
+    const Emission_Line_Table<T_real>& _line_table(const Fit_Element_Map_Dict<T_real>* const elements_to_fit, T_real incident_energy) const;
+
+    /**
+     * @brief _model_element_lines : adds the lines of table element element_idx to spectra_model (and labeled_spectras)
+     */
+    void _model_element_lines(const Line_Shape_Params<T_real>& lsp,
+                              const Emission_Line_Table<T_real>& table,
+                              size_t element_idx,
+                              T_real pre_faktor,
+                              const ArrayTr<T_real>& ev,
+                              Spectra<T_real>& spectra_model,
+                              unordered_map<string, ArrayTr<T_real>>* labeled_spectras) const;
+
+    /**
+     * @brief _line_shape_kernel : line_shape of the line at peak_E on ev - ev_offset, added to counts by the cpu dispatched
+     *                             kernel. Only for ERFC_FAST, the kernel has no libm erfc.
+     */
+    void _line_shape_kernel(T_real* counts,
+                            const ArrayTr<T_real>& ev,
+                            T_real ev_offset,
+                            T_real gain,
+                            T_real sigma,
+                            T_real peak_faktor,
+                            T_real step_faktor,
+                            T_real peak_E,
+                            T_real tail_faktor,
+                            T_real gamma) const;
+
     Fit_Parameters<T_real> _fit_parameters;
 
+    ERFC_ACCURACY _erfc_accuracy;
+
 };
 
 TEMPLATE_CLASS_DLL_EXPORT Gaussian_Model<float>;
@@ -0,0 +1,361 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+
+#include "batched_lm_solver.h"
+
+#include <algorithm>
+#include <math.h>
+
+using namespace data_struct;
+
+
+namespace fitting
+{
+namespace optimizers
+{
+
+#define BATCHED_LM_MAX_LAMBDA 1.0e16
+
+template<typename T_real>
+using Batched_LM_Vector = Eigen::Matrix<T_real, Eigen::Dynamic, 1>;
+
+/**
+ * @brief The Batched_LM_Slot struct : state of the pixel being fit in one column of the block
+ */
+template<typename T_real>
+struct Batched_LM_Slot
+{
+    size_t pixel;
+    bool active;
+    bool started;
+    // accepted params, params evaluated this round and the step between them
+    Batched_LM_Vector<T_real> p;
+    Batched_LM_Vector<T_real> trial;
+    Batched_LM_Vector<T_real> step;
+    // J^T * r and sum |r| at p
+    Batched_LM_Vector<T_real> grad;
+    T_real abs_residual;
+    T_real cost;
+    T_real predicted_reduction;
+    T_real lambda;
+    T_real nu;
+    size_t num_evals;
+};
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+Batched_LM_Solver<T_real>::Batched_LM_Solver()
+{
+    _ftol = (T_real)30.0 * std::numeric_limits<T_real>::epsilon();
+    _xtol = _ftol;
+    _gtol = _ftol;
+    _max_evals = 300;
+    _block_size = 16;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+Batched_LM_Solver<T_real>::~Batched_LM_Solver()
+{
+
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Batched_LM_Solver<T_real>::set_basis(const Batched_LM_Matrix<T_real>& basis, const std::vector<T_real>& min_params, const std::vector<T_real>& max_params)
+{
+    _basis = basis;
+    _basis_t = basis.transpose();
+    _gram.noalias() = _basis_t * _basis;
+
+    // keep 10^p finite
+    const T_real max_exp = (T_real)(std::numeric_limits<T_real>::max_exponent10 - 1);
+    _min_params.resize(basis.cols());
+    _max_params.resize(basis.cols());
+    for (size_t k = 0; k < (size_t)basis.cols(); k++)
+    {
+        T_real min_val = (k < min_params.size() && std::isfinite(min_params[k])) ? min_params[k] : -max_exp;
+        T_real max_val = (k < max_params.size() && std::isfinite(max_params[k])) ? max_params[k] : max_exp;
+        _min_params[k] = std::max(min_val, -max_exp);
+        _max_params[k] = std::min(max_val, max_exp);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Batched_LM_Solver<T_real>::set_options(const unordered_map<string, T_real>& options)
+{
+    if (options.count(STR_OPT_FTOL) > 0)
+    {
+        _ftol = options.at(STR_OPT_FTOL);
+    }
+    if (options.count(STR_OPT_XTOL) > 0)
+    {
+        _xtol = options.at(STR_OPT_XTOL);
+    }
+    if (options.count(STR_OPT_GTOL) > 0)
+    {
+        _gtol = options.at(STR_OPT_GTOL);
+    }
+    if (options.count(STR_OPT_MAXITER) > 0)
+    {
+        _max_evals = std::max((size_t)1, (size_t)options.at(STR_OPT_MAXITER));
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Batched_LM_Solver<T_real>::minimize(std::vector<Batched_LM_Pixel<T_real>>& pixels) const
+{
+    const Eigen::Index n_chan = _basis.rows();
+    const Eigen::Index n_par = _basis.cols();
+    const T_real ln10 = (T_real)std::log(10.0);
+
+    if (pixels.size() == 0)
+    {
+        return;
+    }
+
+    const size_t n_slots = std::min(_block_size, pixels.size());
+
+    Batched_LM_Matrix<T_real> spectras(n_chan, n_slots);
+    Batched_LM_Matrix<T_real> backgrounds(n_chan, n_slots);
+    Batched_LM_Matrix<T_real> amplitudes(n_par, n_slots);
+    Batched_LM_Matrix<T_real> models(n_chan, n_slots);
+    Batched_LM_Matrix<T_real> residuals(n_chan, n_slots);
+    Batched_LM_Matrix<T_real> basis_t_residuals(n_par, n_slots);
+    Batched_LM_Vector<T_real> gram_diag = _gram.diagonal();
+
+    std::vector<Batched_LM_Slot<T_real>> slots(n_slots);
+    size_t next_pixel = 0;
+    size_t num_active = 0;
+
+    auto clamp_params = [this, n_par](Batched_LM_Vector<T_real>& params)
+    {
+        for (Eigen::Index k = 0; k < n_par; k++)
+        {
+            params(k) = std::min(std::max(params(k), _min_params[k]), _max_params[k]);
+        }
+    };
+
+    // takes the next pixel from the queue into slot s
+    auto load_slot = [&](size_t s)
+    {
+        Batched_LM_Slot<T_real>& slot = slots[s];
+        slot.active = false;
+        if (next_pixel >= pixels.size())
+        {
+            spectras.col(s).setZero();
+            backgrounds.col(s).setZero();
+            return;
+        }
+        Batched_LM_Pixel<T_real>& pixel = pixels[next_pixel];
+        slot.pixel = next_pixel++;
+        slot.active = true;
+        slot.started = false;
+        slot.trial = Eigen::Map<const Batched_LM_Vector<T_real>>(pixel.params.data(), n_par);
+        clamp_params(slot.trial);
+        slot.step.setZero(n_par);
+        slot.grad.setZero(n_par);
+        slot.lambda = (T_real)1.0e-3;
+        slot.nu = (T_real)2.0;
+        slot.num_evals = 0;
+        spectras.col(s) = pixel.spectra.matrix();
+        backgrounds.col(s) = pixel.background.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; }).matrix();
+        num_active++;
+    };
+
+    // writes the accepted params of slot s back to its pixel
+    auto retire_slot = [&](size_t s, OPTIMIZER_OUTCOME outcome)
+    {
+        Batched_LM_Slot<T_real>& slot = slots[s];
+        Batched_LM_Pixel<T_real>& pixel = pixels[slot.pixel];
+        pixel.params.assign(slot.p.data(), slot.p.data() + n_par);
+        pixel.num_evals = slot.num_evals;
+        pixel.residual = slot.abs_residual;
+        pixel.outcome = outcome;
+        num_active--;
+        load_slot(s);
+    };
+
+    for (size_t s = 0; s < n_slots; s++)
+    {
+        load_slot(s);
+    }
+
+    while (num_active > 0)
+    {
+        // models of every trial in the block in one product
+        for (size_t s = 0; s < n_slots; s++)
+        {
+            if (slots[s].active)
+            {
+                amplitudes.col(s) = (slots[s].trial.array() * ln10).exp().matrix();
+            }
+            else
+            {
+                amplitudes.col(s).setZero();
+            }
+        }
+        models.noalias() = _basis * amplitudes;
+        residuals = spectras - backgrounds - models;
+        if (false == residuals.allFinite())
+        {
+            for (size_t s = 0; s < n_slots; s++)
+            {
+                for (Eigen::Index c = 0; c < n_chan; c++)
+                {
+                    if (false == std::isfinite(residuals(c, s)))
+                    {
+                        residuals(c, s) = std::isfinite(models(c, s)) ? spectras(c, s) : spectras(c, s) - backgrounds(c, s);
+                    }
+                }
+            }
+        }
+        // J^T * r of the block, J = -basis * diag(ln(10) * 10^p)
+        basis_t_residuals.noalias() = _basis_t * residuals;
+
+        for (size_t s = 0; s < n_slots; s++)
+        {
+            Batched_LM_Slot<T_real>& slot = slots[s];
+            if (false == slot.active)
+            {
+                continue;
+            }
+            slot.num_evals++;
+            T_real trial_cost = residuals.col(s).squaredNorm();
+            bool accepted = false;
+            bool converged = false;
+
+            if (false == slot.started)
+            {
+                slot.p = slot.trial;
+                slot.cost = trial_cost;
+                slot.started = true;
+                accepted = true;
+            }
+            else if (trial_cost < slot.cost)
+            {
+                T_real actual_reduction = slot.cost - trial_cost;
+                T_real rho = actual_reduction / std::max(slot.predicted_reduction, std::numeric_limits<T_real>::min());
+                T_real rho_term = (T_real)2.0 * rho - (T_real)1.0;
+                slot.lambda *= std::max((T_real)1.0 / (T_real)3.0, (T_real)1.0 - rho_term * rho_term * rho_term);
+                slot.nu = (T_real)2.0;
+                converged = (actual_reduction <= _ftol * slot.cost && slot.predicted_reduction <= _ftol * slot.cost)
+                            || (slot.step.norm() <= _xtol * (slot.p.norm() + _xtol));
+                slot.p = slot.trial;
+                slot.cost = trial_cost;
+                accepted = true;
+            }
+            else
+            {
+                slot.lambda *= slot.nu;
+                slot.nu *= (T_real)2.0;
+                if (false == std::isfinite(slot.lambda) || slot.lambda > (T_real)BATCHED_LM_MAX_LAMBDA)
+                {
+                    retire_slot(s, OPTIMIZER_OUTCOME::TRAPPED);
+                    continue;
+                }
+            }
+
+            if (accepted)
+            {
+                slot.abs_residual = residuals.col(s).cwiseAbs().sum();
+                Batched_LM_Vector<T_real> scale = ((slot.p.array() * ln10).exp() * ln10).matrix();
+                slot.grad = -(scale.array() * basis_t_residuals.col(s).array()).matrix();
+                // largest cosine between r and a column of J
+                T_real max_cos = (T_real)0.0;
+                T_real r_norm = std::sqrt(slot.cost);
+                for (Eigen::Index k = 0; k < n_par && r_norm > (T_real)0.0; k++)
+                {
+                    if (gram_diag(k) > (T_real)0.0)
+                    {
+                        max_cos = std::max(max_cos, std::abs(basis_t_residuals(k, s)) / (std::sqrt(gram_diag(k)) * r_norm));
+                    }
+                }
+                converged = converged || slot.cost == (T_real)0.0 || max_cos <= _gtol;
+            }
+
+            if (converged)
+            {
+                retire_slot(s, OPTIMIZER_OUTCOME::CONVERGED);
+                continue;
+            }
+            if (slot.num_evals >= _max_evals)
+            {
+                retire_slot(s, OPTIMIZER_OUTCOME::EXHAUSTED);
+                continue;
+            }
+
+            // next trial: (H + lambda * diag(H)) * step = -grad, H = J^T * J
+            Batched_LM_Vector<T_real> scale = ((slot.p.array() * ln10).exp() * ln10).matrix();
+            Batched_LM_Matrix<T_real> hessian = scale.asDiagonal() * _gram * scale.asDiagonal();
+            Batched_LM_Vector<T_real> damping = hessian.diagonal().unaryExpr([](T_real v) { return v > (T_real)0.0 ? v : (T_real)1.0; });
+            hessian.diagonal() += slot.lambda * damping;
+            Batched_LM_Vector<T_real> step = hessian.ldlt().solve(-slot.grad);
+            if (false == step.allFinite())
+            {
+                retire_slot(s, OPTIMIZER_OUTCOME::FOUND_NAN);
+                continue;
+            }
+            slot.predicted_reduction = step.dot(slot.lambda * damping.cwiseProduct(step) - slot.grad);
+            slot.trial = slot.p + step;
+            clamp_params(slot.trial);
+            slot.step = slot.trial - slot.p;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+} //namespace optimizers
+} //namespace fitting
@@ -0,0 +1,149 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+
+
+#ifndef Batched_LM_Solver_H
+#define Batched_LM_Solver_H
+
+#include "fitting/optimizers/optimizer.h"
+#include <Eigen/Cholesky>
+
+namespace fitting
+{
+namespace optimizers
+{
+
+using namespace std;
+using namespace data_struct;
+
+template<typename T_real>
+using Batched_LM_Matrix = Eigen::Matrix<T_real, Eigen::Dynamic, Eigen::Dynamic>;
+
+/**
+ * @brief The Batched_LM_Pixel struct : one spectra fit by Batched_LM_Solver
+ */
+template<typename T_real>
+struct Batched_LM_Pixel
+{
+    // channels of the fit energy range
+    ArrayTr<T_real> spectra;
+    // everything in the model that is not fit: snip background and fixed basis spectra
+    ArrayTr<T_real> background;
+    // log10 amplitude of every basis column. in: initial guess, out: fitted values
+    std::vector<T_real> params;
+    size_t num_evals;
+    // sum of |spectra - model|
+    T_real residual;
+    OPTIMIZER_OUTCOME outcome;
+};
+
+TEMPLATE_STRUCT_DLL_EXPORT Batched_LM_Pixel<float>;
+TEMPLATE_STRUCT_DLL_EXPORT Batched_LM_Pixel<double>;
+
+/**
+ * @brief The Batched_LM_Solver class : Levenberg-Marquardt for models that are a sum of fixed basis spectra,
+ *        model = background + sum_k 10^p_k * basis_k (the matrix fit model).
+ *        A block of pixels is advanced in lockstep: the models and gradients of the whole block are two matrix products,
+ *        every pixel keeps its own damping and retires once converged, its slot is refilled with the next pixel.
+ *        The jacobian is analytic, basis^T * basis is computed once for all pixels.
+ */
+template<typename T_real>
+class DLL_EXPORT Batched_LM_Solver
+{
+public:
+
+    Batched_LM_Solver();
+
+    ~Batched_LM_Solver();
+
+    /**
+     * @brief set_basis : basis spectra as columns (channels x params) with the bounds of each log10 amplitude
+     */
+    void set_basis(const Batched_LM_Matrix<T_real>& basis, const std::vector<T_real>& min_params, const std::vector<T_real>& max_params);
+
+    /**
+     * @brief set_options : STR_OPT_FTOL, STR_OPT_XTOL, STR_OPT_GTOL and STR_OPT_MAXITER (model evaluations per pixel)
+     */
+    void set_options(const unordered_map<string, T_real>& options);
+
+    void set_block_size(size_t block_size) { _block_size = std::max((size_t)1, block_size); }
+
+    size_t num_params() const { return (size_t)_basis.cols(); }
+
+    void minimize(std::vector<Batched_LM_Pixel<T_real>>& pixels) const;
+
+protected:
+
+    Batched_LM_Matrix<T_real> _basis;
+
+    Batched_LM_Matrix<T_real> _basis_t;
+
+    // basis^T * basis
+    Batched_LM_Matrix<T_real> _gram;
+
+    std::vector<T_real> _min_params;
+
+    std::vector<T_real> _max_params;
+
+    T_real _ftol;
+
+    T_real _xtol;
+
+    T_real _gtol;
+
+    size_t _max_evals;
+
+    size_t _block_size;
+};
+
+TEMPLATE_CLASS_DLL_EXPORT Batched_LM_Solver<float>;
+TEMPLATE_CLASS_DLL_EXPORT Batched_LM_Solver<double>;
+
+} //namespace optimizers
+
+} //namespace fitting
+
+#endif // Batched_LM_Solver_H
@@ -44,6 +44,7 @@
 -***/
 
 #include "lmfit_optimizer.h"
+#include "core/cpu_dispatch.h"
 
 #include <iostream>
 #include <algorithm>
@@ -77,9 +78,9 @@ void residuals_lmfit( const T_real *par, int m_dat, const void *data, T_real *fv
     ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
 
     // Calculate residuals
+    cpu_kernels<T_real>().residual(fvec, ud->spectra.data(), ud->spectra_model.data(), ud->weights.data(), m_dat);
     for (int i = 0; i < m_dat; i++ )
     {
-		fvec[i] = (ud->spectra[i] - ud->spectra_model[i]) * ud->weights[i];
 		if (std::isfinite(fvec[i]) == false)
 		{
 			logE << "\n\n\n";
@@ -113,9 +114,9 @@ void general_residuals_lmfit( const T_real *par, int m_dat, const void *data, T_
 	// Used to check for nan's here but there were some cases where the optimizer would return nan found. So moved to after subract of model
     ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
     // Calculate residuals
+    cpu_kernels<T_real>().residual(fvec, ud->spectra.data(), ud->spectra_model.data(), ud->weights.data(), m_dat);
     for (int i = 0; i < m_dat; i++ )
     {
-        fvec[i] = ( ud->spectra[i] - ud->spectra_model[i] ) * ud->weights[i];
 		if (std::isfinite(fvec[i]) == false)
 		{
 			fvec[i] = ud->spectra[i];
@@ -143,21 +144,8 @@ void quantification_residuals_lmfit( const T_real *par, int m_dat, const void *d
     //Model spectra based on new fit parameters
 
     //Calculate residuals
-    std::unordered_map<std::string, T_real> result_map = ud->quantification_model->model_calibrationcurve(ud->quant_map, par[0]);
-
-    int idx = 0;
-    for(auto& itr : ud->quant_map)
-    {
-		if (std::isfinite(result_map[itr.first]) == false)
-		{
-			fvec[idx] = itr.second.e_cal_ratio;
-		}
-		else
-		{
-			fvec[idx] = itr.second.e_cal_ratio - result_map[itr.first];
-		}
-        idx++;
-    }
+    ud->quantification_model->model_calibrationcurve(ud->calib_coefs, par[0], ud->calib_curve);
+    Eigen::Map<ArrayTr<T_real>>(fvec, ud->calib_curve.size()) = ud->e_cal_ratios - ud->calib_curve;
 }
 
 
@@ -399,10 +387,7 @@ OPTIMIZER_OUTCOME LMFit_Optimizer<T_real>::minimize_quantification(Fit_Parameter
 
     if (quant_map != nullptr)
     {
-        for (const auto& itr : *quant_map)
-        {
-            ud.quant_map[itr.first] = *(itr.second);
-        }
+        quantification_model->calibration_coefficients(*quant_map, ud.calib_coefs, ud.e_cal_ratios);
     }
     ud.quantification_model = quantification_model;
     ud.fit_parameters = fit_params;
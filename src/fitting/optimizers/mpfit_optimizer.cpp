@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "mpfit_optimizer.h"
+#include "core/cpu_dispatch.h"
 
 #include <iostream>
 #include <algorithm>
@@ -81,9 +82,9 @@ int residuals_mpfit(int m, int params_size, T_real *params, T_real *dy, T_real *
     ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
 
     //Calculate residuals
+    cpu_kernels<T_real>().residual(dy, ud->spectra.data(), ud->spectra_model.data(), ud->weights.data(), m);
     for (int i=0; i<m; i++)
     {
-		dy[i] = (ud->spectra[i] - ud->spectra_model[i]) * ud->weights[i];
 		if (std::isfinite(dy[i]) == false)
 		{
 			logE << "\n\n\n";
@@ -120,9 +121,9 @@ int gen_residuals_mpfit(int m, int params_size, T_real *params, T_real *dy, T_re
     // Remove nan's and inf's
     ud->spectra_model = (ArrayTr<T_real>)ud->spectra_model.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
     // Calculate residuals
+    cpu_kernels<T_real>().residual(dy, ud->spectra.data(), ud->spectra_model.data(), ud->weights.data(), m);
     for (int i=0; i<m; i++)
     {
-        dy[i] = ( ud->spectra[i] - ud->spectra_model[i] ) * ud->weights[i];
 		if (std::isfinite(dy[i]) == false)
 		{
 			dy[i] = ud->spectra[i];
@@ -152,21 +153,8 @@ int quantification_residuals_mpfit(int m, int params_size, T_real *params, T_rea
     //Model spectra based on new fit parameters
 
     //Calculate residuals
-    std::unordered_map<std::string, T_real> result_map = ud->quantification_model->model_calibrationcurve(ud->quant_map, params[0]);
-
-    int idx = 0;
-    for(auto& itr : ud->quant_map)
-    {
-		if (std::isfinite(result_map[itr.first]) == false)
-		{
-			dy[idx] = itr.second.e_cal_ratio;
-		}
-		else
-		{
-			dy[idx] = itr.second.e_cal_ratio - result_map[itr.first];
-		}
-        idx++;
-    }
+    ud->quantification_model->model_calibrationcurve(ud->calib_coefs, params[0], ud->calib_curve);
+    Eigen::Map<ArrayTr<T_real>>(dy, ud->calib_curve.size()) = ud->e_cal_ratios - ud->calib_curve;
 
     return 0;
 }
@@ -591,10 +579,7 @@ OPTIMIZER_OUTCOME MPFit_Optimizer<T_real>::minimize_quantification(Fit_Parameter
 
     if (quant_map != nullptr)
     {
-        for (const auto& itr : *quant_map)
-        {
-            ud.quant_map[itr.first] = *(itr.second);
-        }
+        quantification_model->calibration_coefficients(*quant_map, ud.calib_coefs, ud.e_cal_ratios);
     }
     ud.quantification_model = quantification_model;
     ud.fit_parameters = fit_params;
@@ -131,7 +131,10 @@ struct Quant_User_Data
 {
     quantification::models::Quantification_Model<T_real>* quantification_model;
     Fit_Parameters<T_real>* fit_parameters;
-    std::unordered_map<std::string, Element_Quant<T_real>> quant_map;
+    // per element calibration coefficients and measured e_cal ratios, built once per minimize_quantification
+    ArrayTr<T_real> calib_coefs;
+    ArrayTr<T_real> e_cal_ratios;
+    ArrayTr<T_real> calib_curve;
 };
 
 TEMPLATE_STRUCT_DLL_EXPORT Quant_User_Data<float>;
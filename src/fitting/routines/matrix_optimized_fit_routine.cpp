@@ -54,14 +54,16 @@ namespace routines
 {
 
 template<typename T_real>
-std::mutex Matrix_Optimized_Fit_Routine<T_real>::_int_spec_mutex;
+std::atomic<size_t> Matrix_Optimized_Fit_Routine<T_real>::_next_instance_id(0);
 
 // ----------------------------------------------------------------------------
 
 template<typename T_real>
 Matrix_Optimized_Fit_Routine<T_real>::Matrix_Optimized_Fit_Routine() : Param_Optimized_Fit_Routine<T_real>()
 {
-
+    // never reused, so the accumulator a thread cached for a deleted routine never matches again
+    _instance_id = _next_instance_id++;
+    _batch_size = 1;
 }
 
 // ----------------------------------------------------------------------------
@@ -147,7 +149,6 @@ unordered_map<string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_real>::_ge
 
     for(const auto& itr : (*elements_to_fit))
     {
-        Fit_Element_Map<T_real>* element = itr.second;
         // Set value to 0.0 . This is the pre_faktor in gauss_tails_model. we do 10.0 ^ pre_faktor = 1.0
         if( false == fit_parameters.contains(itr.first) )
         {
@@ -158,8 +159,8 @@ unordered_map<string, Spectra<T_real>> Matrix_Optimized_Fit_Routine<T_real>::_ge
         {
             fit_parameters[itr.first].value = 0.0;
         }
-        element_spectra[itr.first] = model->model_spectrum_element(&fit_parameters, element, ev, nullptr);
     }
+    model->model_spectrum_elements(&fit_parameters, elements_to_fit, ev, &element_spectra);
 
     //i = elements_to_fit->size();
     // scattering:
@@ -221,6 +222,14 @@ void Matrix_Optimized_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>
         std::lock_guard<std::mutex> lock(_int_spec_mutex);
         _integrated_fitted_spectra.setZero(energy_range.count());
         _integrated_background.setZero(energy_range.count());
+        // zero in place, threads keep pointers to their accumulator
+        for (auto& itr : _thread_accumulators)
+        {
+            itr.second.fitted_spectra.setZero(energy_range.count());
+            itr.second.background.setZero(energy_range.count());
+            itr.second.max_channels_spectra.setZero(0);
+            itr.second.max_10_channels_spectra.setZero(0);
+        }
     }
 
 }
@@ -228,42 +237,208 @@ void Matrix_Optimized_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>
 // ----------------------------------------------------------------------------
 
 template<typename T_real>
-OPTIMIZER_OUTCOME Matrix_Optimized_Fit_Routine<T_real>:: fit_spectra(const models::Base_Model<T_real>* const model,
-                                                            const Spectra<T_real>* const spectra,
-                                                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
-                                                            std::unordered_map<std::string, T_real>& out_counts)
+Integrated_Spectra_Accumulator<T_real>* Matrix_Optimized_Fit_Routine<T_real>::_get_thread_accumulator()
+{
+    // single entry per thread, the accumulators themselves are owned and freed by the routine
+    thread_local size_t cached_instance_id = (size_t)-1;
+    thread_local Integrated_Spectra_Accumulator<T_real>* cached_accumulator = nullptr;
+
+    if (cached_instance_id == _instance_id)
+    {
+        return cached_accumulator;
+    }
+
+    // first fit on this thread, or another routine ran on it in between
+    std::lock_guard<std::mutex> lock(_int_spec_mutex);
+    auto itr = _thread_accumulators.find(std::this_thread::get_id());
+    if (itr == _thread_accumulators.end())
+    {
+        itr = _thread_accumulators.emplace(std::this_thread::get_id(), Integrated_Spectra_Accumulator<T_real>()).first;
+        itr->second.fitted_spectra.setZero(this->_energy_range.count());
+        itr->second.background.setZero(this->_energy_range.count());
+    }
+    cached_instance_id = _instance_id;
+    cached_accumulator = &itr->second;
+    return cached_accumulator;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::_add_max_channels(Integrated_Spectra_Accumulator<T_real>* accumulator, const Spectra<T_real>* const spectra)
+{
+    //we don't know the spectra size during initlaize() will have to resize here
+    if (accumulator->max_channels_spectra.size() < spectra->size())
+    {
+        accumulator->max_channels_spectra.setZero(spectra->size());
+    }
+    if (accumulator->max_10_channels_spectra.size() < spectra->size())
+    {
+        accumulator->max_10_channels_spectra.setZero(spectra->size());
+    }
+
+    // single pass keeping the top 10 channels sorted high to low, first index wins a tie like maxCoeff
+    const int max_count = 10;
+    int max_idx[max_count];
+    T_real max_val[max_count];
+    int found = 0;
+    for (int i = 0; i < spectra->size(); i++)
+    {
+        T_real val = (*spectra)[i];
+        if (found == max_count && false == (val > max_val[max_count - 1]))
+        {
+            continue;
+        }
+        int pos = (found < max_count) ? found++ : max_count - 1;
+        while (pos > 0 && val > max_val[pos - 1])
+        {
+            max_val[pos] = max_val[pos - 1];
+            max_idx[pos] = max_idx[pos - 1];
+            pos--;
+        }
+        max_val[pos] = val;
+        max_idx[pos] = i;
+    }
+
+    if (found > 0)
+    {
+        accumulator->max_channels_spectra[max_idx[0]] += max_val[0];
+    }
+    for (int i = 0; i < found; i++)
+    {
+        accumulator->max_10_channels_spectra[max_idx[i]] += max_val[i];
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::reduce_integrated_spectra()
 {
+    std::lock_guard<std::mutex> lock(_int_spec_mutex);
+    for (auto& itr : _thread_accumulators)
+    {
+        Integrated_Spectra_Accumulator<T_real>& accumulator = itr.second;
+        if (accumulator.fitted_spectra.size() == _integrated_fitted_spectra.size())
+        {
+            _integrated_fitted_spectra += accumulator.fitted_spectra;
+            accumulator.fitted_spectra.setZero();
+        }
+        if (accumulator.background.size() == _integrated_background.size())
+        {
+            _integrated_background += accumulator.background;
+            accumulator.background.setZero();
+        }
+        if (accumulator.max_channels_spectra.size() > 0)
+        {
+            if (_max_channels_spectra.size() < accumulator.max_channels_spectra.size())
+            {
+                _max_channels_spectra.setZero(accumulator.max_channels_spectra.size());
+            }
+            _max_channels_spectra.head(accumulator.max_channels_spectra.size()) += accumulator.max_channels_spectra;
+            accumulator.max_channels_spectra.setZero();
+        }
+        if (accumulator.max_10_channels_spectra.size() > 0)
+        {
+            if (_max_10_channels_spectra.size() < accumulator.max_10_channels_spectra.size())
+            {
+                _max_10_channels_spectra.setZero(accumulator.max_10_channels_spectra.size());
+            }
+            _max_10_channels_spectra.head(accumulator.max_10_channels_spectra.size()) += accumulator.max_10_channels_spectra;
+            accumulator.max_10_channels_spectra.setZero();
+        }
+    }
+}
 
-    Fit_Parameters<T_real> fit_params = model->fit_parameters();
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::_prepare_fit(const models::Base_Model<T_real>* const model,
+                                                        const Spectra<T_real>* const spectra,
+                                                        const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                        Fit_Parameters<T_real>& fit_params,
+                                                        ArrayTr<T_real>& background)
+{
+    fit_params = model->fit_parameters();
     //Add fit param for number of iterations
     fit_params.add_parameter(Fit_Param<T_real>(STR_NUM_ITR, 0.0));
     fit_params.add_parameter(Fit_Param<T_real>(STR_RESIDUAL, 0.0));
     this->_add_elements_to_fit_parameters(&fit_params, spectra, elements_to_fit);
     this->_calc_and_update_coherent_amplitude(&fit_params, spectra);
+
+    if(fit_params.contains(STR_SNIP_WIDTH))
+    {
+        ArrayTr<T_real> bkg = snip_background<T_real>(spectra,
+                                     fit_params.value(STR_ENERGY_OFFSET),
+                                     fit_params.value(STR_ENERGY_SLOPE),
+                                     fit_params.value(STR_ENERGY_QUADRATIC),
+                                     fit_params.value(STR_SNIP_WIDTH),
+                                     this->_energy_range.min,
+                                     this->_energy_range.max);
+        background = bkg.segment(this->_energy_range.min, this->_energy_range.count());
+    }
+    else
+    {
+        background.setZero(this->_energy_range.count());
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::_save_fit(const Fit_Parameters<T_real>& fit_params,
+                                                     const ArrayTr<T_real>& background,
+                                                     const Spectra<T_real>* const spectra,
+                                                     const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                     std::unordered_map<std::string, T_real>& out_counts,
+                                                     Integrated_Spectra_Accumulator<T_real>* accumulator)
+{
+    //Save the counts from fit parameters into fit count dict for each element
+    for (auto el_itr : *elements_to_fit)
+    {
+        T_real value =  fit_params.at(el_itr.first).value;
+        //convert from log10
+        value = std::pow((T_real)10.0, value);
+        out_counts[el_itr.first] = value;
+    }
+
+    out_counts[STR_NUM_ITR] = fit_params.at(STR_NUM_ITR).value;
+    out_counts[STR_RESIDUAL] = fit_params.at(STR_RESIDUAL).value;
+
+    //model fit spectra
+    Spectra<T_real> model_spectra(this->_energy_range.count());
+    this->model_spectrum(&fit_params, &this->_energy_range, &model_spectra);
+
+    model_spectra += background;
+    model_spectra = (ArrayTr<T_real>)model_spectra.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
+
+    //integrate results into this thread's accumulator, reduced by reduce_integrated_spectra()
+    if (accumulator->fitted_spectra.size() != model_spectra.size())
+    {
+        // energy range changed since the accumulator was created
+        accumulator->fitted_spectra.setZero(model_spectra.size());
+        accumulator->background.setZero(model_spectra.size());
+    }
+    accumulator->fitted_spectra += model_spectra;
+    accumulator->background += background;
+    _add_max_channels(accumulator, spectra);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+OPTIMIZER_OUTCOME Matrix_Optimized_Fit_Routine<T_real>:: fit_spectra(const models::Base_Model<T_real>* const model,
+                                                            const Spectra<T_real>* const spectra,
+                                                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                            std::unordered_map<std::string, T_real>& out_counts)
+{
     OPTIMIZER_OUTCOME ret_val = OPTIMIZER_OUTCOME::FAILED;
 
     if(this->_optimizer != nullptr)
     {
-        //todo : snip background here and pass to optimizer, then add to integrated background to save in h5
-        
+        Fit_Parameters<T_real> fit_params;
         ArrayTr<T_real> background;
-        
-        
-        if(fit_params.contains(STR_SNIP_WIDTH))
-        {
-            ArrayTr<T_real> bkg = snip_background<T_real>(spectra,
-                                         fit_params.value(STR_ENERGY_OFFSET),
-                                         fit_params.value(STR_ENERGY_SLOPE),
-                                         fit_params.value(STR_ENERGY_QUADRATIC),
-                                         fit_params.value(STR_SNIP_WIDTH),
-                                         this->_energy_range.min,
-                                         this->_energy_range.max);
-            background = bkg.segment(this->_energy_range.min, this->_energy_range.count());
-        }
-        else
-        {
-            background.setZero(this->_energy_range.count());
-        }
+        _prepare_fit(model, spectra, elements_to_fit, fit_params, background);
 
         std::function<void(const Fit_Parameters<T_real>* const, const  Range* const, Spectra<T_real>*)> gen_func = std::bind(&Matrix_Optimized_Fit_Routine<T_real>::model_spectrum, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
 
@@ -272,67 +447,113 @@ OPTIMIZER_OUTCOME Matrix_Optimized_Fit_Routine<T_real>:: fit_spectra(const model
         unordered_map<string, T_real> saved_options = this->_optimizer->get_options();        
         this->_optimizer->set_options(opt_options);
 
-
         ret_val = this->_optimizer->minimize_func(&fit_params, spectra, this->_energy_range, &background, gen_func);
-        //Save the counts from fit parameters into fit count dict for each element
-        for (auto el_itr : *elements_to_fit)
+
+        _save_fit(fit_params, background, spectra, elements_to_fit, out_counts, _get_thread_accumulator());
+
+        this->_optimizer->set_options(saved_options);
+    }
+
+    return ret_val;
+
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Matrix_Optimized_Fit_Routine<T_real>::fit_spectra_block(const models::Base_Model<T_real>* const model,
+                                                             const std::vector<const Spectra<T_real>*>& spectras,
+                                                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                             std::vector<std::unordered_map<std::string, T_real>>& out_counts)
+{
+    out_counts.resize(spectras.size());
+    if (spectras.size() == 0)
+    {
+        return;
+    }
+
+    std::vector<Fit_Parameters<T_real>> fit_params(spectras.size());
+    std::vector<ArrayTr<T_real>> backgrounds(spectras.size());
+    for (size_t i = 0; i < spectras.size(); i++)
+    {
+        _prepare_fit(model, spectras[i], elements_to_fit, fit_params[i], backgrounds[i]);
+    }
+
+    // fit parameters are the element models that are not fixed, fixed ones are part of the background
+    std::vector<std::string> param_names;
+    std::vector<T_real> min_params;
+    std::vector<T_real> max_params;
+    std::vector<std::string> fixed_names;
+    for (const auto& itr : _element_models)
+    {
+        if (false == fit_params[0].contains(itr.first))
+        {
+            continue;
+        }
+        const Fit_Param<T_real>& param = fit_params[0].at(itr.first);
+        if (param.bound_type == E_Bound_Type::FIXED)
         {
-            T_real value =  fit_params.at(el_itr.first).value;
-            //convert from log10
-            value = std::pow((T_real)10.0, value);
-            out_counts[el_itr.first] = value;
+            fixed_names.push_back(itr.first);
+            continue;
         }
+        param_names.push_back(itr.first);
+        bool has_min = (param.bound_type == E_Bound_Type::LIMITED_LO_HI || param.bound_type == E_Bound_Type::LIMITED_LO);
+        bool has_max = (param.bound_type == E_Bound_Type::LIMITED_LO_HI || param.bound_type == E_Bound_Type::LIMITED_HI);
+        min_params.push_back(has_min ? param.min_val : -std::numeric_limits<T_real>::infinity());
+        max_params.push_back(has_max ? param.max_val : std::numeric_limits<T_real>::infinity());
+    }
+
+    optimizers::Batched_LM_Matrix<T_real> basis(this->_energy_range.count(), param_names.size());
+    for (size_t k = 0; k < param_names.size(); k++)
+    {
+        basis.col(k) = _element_models.at(param_names[k]).matrix();
+    }
 
-        out_counts[STR_NUM_ITR] = fit_params.at(STR_NUM_ITR).value;
-        out_counts[STR_RESIDUAL] = fit_params.at(STR_RESIDUAL).value;
-
-		//get max and top 10 max channels
-		vector<pair<int, T_real> > max_map;
-		data_struct::Spectra<T_real> max_vals = *spectra;
-		typename data_struct::Spectra<T_real>::Index idx;
-		for (int i = 0; i < 10; i++)
-		{
-			T_real max_val = max_vals.maxCoeff(&idx);
-			max_map.push_back({ idx, max_val });
-			max_vals[idx] = 0;
-		}
-
-		//model fit spectra
-        Spectra<T_real> model_spectra(this->_energy_range.count());
-        this->model_spectrum(&fit_params, &this->_energy_range, &model_spectra);
-        
-        model_spectra += background;
-        model_spectra = (ArrayTr<T_real>)model_spectra.unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
-
-		//lock and integrate results
-		{
-            std::lock_guard<std::mutex> lock(_int_spec_mutex);
-            _integrated_fitted_spectra.add(model_spectra);
-            _integrated_background.add(background);
-
-			//we don't know the spectra size during initlaize() will have to resize here
-			if (_max_channels_spectra.size() < spectra->size())
-			{
-				_max_channels_spectra.setZero(spectra->size());
-			}
-			if (_max_10_channels_spectra.size() < spectra->size())
-			{
-				_max_10_channels_spectra.setZero(spectra->size());
-			}
-
-			_max_channels_spectra[max_map[0].first] += max_map[0].second;
-
-			for (auto &itr : max_map)
-			{
-				_max_10_channels_spectra[itr.first] += itr.second;
-			}
+    //set num iter to 300, same as fit_spectra
+    unordered_map<string, T_real> opt_options{ {STR_OPT_MAXITER, 300.}, {STR_OPT_FTOL, 1.0e-11 }, {STR_OPT_GTOL, 1.0e-11 } };
+    if (this->_optimizer != nullptr)
+    {
+        unordered_map<string, T_real> optimizer_options = this->_optimizer->get_options();
+        if (optimizer_options.count(STR_OPT_XTOL) > 0)
+        {
+            opt_options[STR_OPT_XTOL] = optimizer_options.at(STR_OPT_XTOL);
         }
+    }
 
-        this->_optimizer->set_options(saved_options);
+    optimizers::Batched_LM_Solver<T_real> solver;
+    solver.set_basis(basis, min_params, max_params);
+    solver.set_options(opt_options);
+    solver.set_block_size(_batch_size);
+
+    std::vector<optimizers::Batched_LM_Pixel<T_real>> pixels(spectras.size());
+    for (size_t i = 0; i < spectras.size(); i++)
+    {
+        optimizers::Batched_LM_Pixel<T_real>& pixel = pixels[i];
+        pixel.spectra = spectras[i]->segment(this->_energy_range.min, this->_energy_range.count());
+        pixel.background = backgrounds[i];
+        for (const auto& name : fixed_names)
+        {
+            pixel.background += std::pow((T_real)10.0, fit_params[i].at(name).value) * _element_models.at(name);
+        }
+        for (const auto& name : param_names)
+        {
+            pixel.params.push_back(fit_params[i].at(name).value);
+        }
     }
 
-    return ret_val;
+    solver.minimize(pixels);
 
+    Integrated_Spectra_Accumulator<T_real>* accumulator = _get_thread_accumulator();
+    for (size_t i = 0; i < spectras.size(); i++)
+    {
+        for (size_t k = 0; k < param_names.size(); k++)
+        {
+            fit_params[i][param_names[k]].value = pixels[i].params[k];
+        }
+        fit_params[i][STR_NUM_ITR].value = (T_real)pixels[i].num_evals;
+        fit_params[i][STR_RESIDUAL].value = pixels[i].residual;
+        _save_fit(fit_params[i], backgrounds[i], spectras[i], elements_to_fit, out_counts[i], accumulator);
+    }
 }
 
 // ----------------------------------------------------------------------------
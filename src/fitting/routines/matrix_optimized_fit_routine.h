@@ -51,8 +51,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #define Matrix_Optimized_Fit_Routine_H
 
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <atomic>
 
 #include "fitting/routines/param_optimized_fit_routine.h"
+#include "fitting/optimizers/batched_lm_solver.h"
 #include "data_struct/fit_parameters.h"
 
 namespace fitting
@@ -63,6 +67,18 @@ namespace routines
 using namespace data_struct;
 using namespace std;
 
+/**
+ * @brief The Integrated_Spectra_Accumulator struct : integrated spectra summed by a single fitting thread
+ */
+template<typename T_real>
+struct Integrated_Spectra_Accumulator
+{
+    ArrayTr<T_real> fitted_spectra;
+    ArrayTr<T_real> background;
+    ArrayTr<T_real> max_channels_spectra;
+    ArrayTr<T_real> max_10_channels_spectra;
+};
+
 /**
  * @brief The Matrix_Optimized_Fit_Routine class : Matrix fit model
  */
@@ -79,6 +95,24 @@ public:
                                           const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                           std::unordered_map<std::string, T_real>& out_counts);
 
+    /**
+     * @brief fit_spectra_block : same results as fit_spectra for every spectra, but the pixels are fit by
+     *                            Batched_LM_Solver in lockstep blocks of batch_size instead of one optimizer call each
+     */
+    void fit_spectra_block(const models::Base_Model<T_real>* const model,
+                           const std::vector<const Spectra<T_real>*>& spectras,
+                           const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                           std::vector<std::unordered_map<std::string, T_real>>& out_counts);
+
+    /**
+     * @brief set_batch_size : > 1 fits with Batched_LM_Solver instead of the optimizer set with set_optimizer().
+     *                         Default 1. Num_Iter then counts the pixel's LM steps (analytic jacobian)
+     *                         instead of the optimizer's function evaluations.
+     */
+    void set_batch_size(size_t batch_size) { _batch_size = std::max((size_t)1, batch_size); }
+
+    size_t batch_size() const { return _batch_size; }
+
     virtual std::string get_name() { return STR_FIT_GAUSS_MATRIX; }
 
     virtual void initialize(models::Base_Model<T_real>* const model,
@@ -97,8 +131,31 @@ public:
 
 	const Spectra<T_real>& max_10_integrated_spectra() { return _max_10_channels_spectra; }
 
+    /**
+     * @brief reduce_integrated_spectra : Sum the per thread accumulators into the integrated spectra.
+     *                                    Call once fitting is done and before reading the integrated spectra.
+     */
+    void reduce_integrated_spectra();
+
 protected:
 
+    Integrated_Spectra_Accumulator<T_real>* _get_thread_accumulator();
+
+    void _prepare_fit(const models::Base_Model<T_real>* const model,
+                      const Spectra<T_real>* const spectra,
+                      const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                      Fit_Parameters<T_real>& fit_params,
+                      ArrayTr<T_real>& background);
+
+    void _save_fit(const Fit_Parameters<T_real>& fit_params,
+                   const ArrayTr<T_real>& background,
+                   const Spectra<T_real>* const spectra,
+                   const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                   std::unordered_map<std::string, T_real>& out_counts,
+                   Integrated_Spectra_Accumulator<T_real>* accumulator);
+
+    void _add_max_channels(Integrated_Spectra_Accumulator<T_real>* accumulator, const Spectra<T_real>* const spectra);
+
     unordered_map<string, Spectra<T_real>> _generate_element_models(models::Base_Model<T_real>* const model,
                                                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                             struct Range energy_range);
@@ -110,7 +167,16 @@ protected:
 
     unordered_map<string, Spectra<T_real>> _element_models;
 
-    static std::mutex _int_spec_mutex;
+    // one accumulator per fitting thread, owned by the routine. map nodes don't move so the address cached by each thread stays valid
+    std::unordered_map<std::thread::id, Integrated_Spectra_Accumulator<T_real> > _thread_accumulators;
+
+    std::mutex _int_spec_mutex;
+
+    size_t _batch_size;
+
+    size_t _instance_id;
+
+    static std::atomic<size_t> _next_instance_id;
 
 };
 
@@ -246,12 +246,10 @@ OPTIMIZER_OUTCOME NNLS_Fit_Routine<T_real>::fit_spectra(const models::Base_Model
     out_counts[STR_NUM_ITR] = static_cast<T_real>(num_iter);
     out_counts[STR_RESIDUAL] = npg;
 
-	//lock and integrate results
-	{
-		std::lock_guard<std::mutex> lock(this->_int_spec_mutex);
-		this->_integrated_fitted_spectra.add(spectra_model);
-        this->_integrated_background.add(background);
-	}
+    //integrate results into this thread's accumulator, reduced by reduce_integrated_spectra()
+    Integrated_Spectra_Accumulator<T_real>* accumulator = this->_get_thread_accumulator();
+    accumulator->fitted_spectra += spectra_model;
+    accumulator->background += background;
 
     if (num_iter == solver.getMaxit())
     {
@@ -59,7 +59,9 @@ namespace routines
 template<typename T_real>
 ROI_Fit_Routine<T_real>::ROI_Fit_Routine() : Base_Fit_Routine<T_real>()
 {
-
+    _initialized_elements = nullptr;
+    _initialized_energy_offset = 0;
+    _initialized_energy_slope = 0;
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -72,41 +74,127 @@ ROI_Fit_Routine<T_real>::~ROI_Fit_Routine()
 
 // --------------------------------------------------------------------------------------------------------------------
 
+template<typename T_real>
+bool ROI_Fit_Routine<T_real>::is_initialized_for(const models::Base_Model<T_real>* const model,
+                                                 const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                                 const struct Range energy_range) const
+{
+    if (model == nullptr || _initialized_elements == nullptr || _initialized_elements != elements_to_fit || _roi_windows.size() != elements_to_fit->size())
+    {
+        return false;
+    }
+    const Fit_Parameters<T_real>& fitp = model->fit_parameters();
+    return (fitp.value(STR_ENERGY_OFFSET) == _initialized_energy_offset
+            && fitp.value(STR_ENERGY_SLOPE) == _initialized_energy_slope
+            && energy_range.min == _initialized_energy_range.min
+            && energy_range.max == _initialized_energy_range.max);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+template<typename T_real>
+void ROI_Fit_Routine<T_real>::_clamp_window(const ROI_Window& window, unsigned int n_mca_channels, unsigned int& left_roi, size_t& spec_size) const
+{
+    unsigned int right_roi = window.right_roi;
+    left_roi = window.left_roi;
+    if (right_roi >= n_mca_channels)
+    {
+        right_roi = n_mca_channels - 2;
+    }
+    if (left_roi > right_roi)
+    {
+        left_roi = right_roi - 1;
+    }
+    spec_size = (right_roi - left_roi) + 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
 template<typename T_real>
 optimizers::OPTIMIZER_OUTCOME ROI_Fit_Routine<T_real>::fit_spectra(const models::Base_Model<T_real>* const model,
                                                             const Spectra<T_real>* const spectra,
                                                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                                             std::unordered_map<std::string, T_real>& out_counts)
  {    
-    Fit_Parameters<T_real> fitp = model->fit_parameters();
     unsigned int n_mca_channels = spectra->size();
-
+    unsigned int left_roi = 0;
+    size_t spec_size = 0;
+    const Fit_Parameters<T_real>& fitp = model->fit_parameters();
     T_real energy_offset = fitp.value(STR_ENERGY_OFFSET);
     T_real energy_slope = fitp.value(STR_ENERGY_SLOPE);
+    struct Range energy_range = get_energy_range(fitp.value(STR_MIN_ENERGY_TO_FIT), fitp.value(STR_MAX_ENERGY_TO_FIT), spectra->size(), energy_offset, energy_slope);
+
+    if (is_initialized_for(model, elements_to_fit, energy_range))
+    {
+        for (const auto& window : _roi_windows)
+        {
+            _clamp_window(window, n_mca_channels, left_roi, spec_size);
+            out_counts[window.name] = spectra->segment(left_roi, spec_size).sum();
+        }
+        return optimizers::OPTIMIZER_OUTCOME::CONVERGED;
+    }
+
+    // not initialized for these elements and calibration, calculate the windows per spectra
     for(const auto& e_itr : *elements_to_fit)
     {
-        unsigned int left_roi = 0;
-        unsigned int right_roi = 0;
         Fit_Element_Map<T_real>* element = e_itr.second;
         if (element != nullptr)
         {
-            left_roi = static_cast<unsigned int>(std::round(((element->center() - element->width()) - energy_offset) / energy_slope));
-            right_roi = static_cast<unsigned int>(std::round(((element->center() + element->width()) - energy_offset) / energy_slope));
+            ROI_Window window;
+            window.left_roi = static_cast<unsigned int>(std::round(((element->center() - element->width()) - energy_offset) / energy_slope));
+            window.right_roi = static_cast<unsigned int>(std::round(((element->center() + element->width()) - energy_offset) / energy_slope));
+            _clamp_window(window, n_mca_channels, left_roi, spec_size);
+            out_counts[e_itr.first] = spectra->segment(left_roi, spec_size).sum();
+        }
+    }
+    return optimizers::OPTIMIZER_OUTCOME::CONVERGED;
+}
 
-            if (right_roi >= n_mca_channels)
-            {
-                right_roi = n_mca_channels - 2;
-            }
-            if (left_roi > right_roi)
+// --------------------------------------------------------------------------------------------------------------------
+
+template<typename T_real>
+bool ROI_Fit_Routine<T_real>::fit_spectra_line(const models::Base_Model<T_real>* const model,
+                                               const Spectra_Line<T_real>* const spectra_line,
+                                               const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                                               const struct Range energy_range,
+                                               Fit_Count_Tensor<T_real>* out_fit_counts,
+                                               size_t row)
+{
+    if (false == is_initialized_for(model, elements_to_fit, energy_range) || spectra_line->size() == 0)
+    {
+        return false;
+    }
+
+    // look up the output planes once per row instead of once per pixel
+    std::vector<int> window_planes;
+    for (const auto& window : _roi_windows)
+    {
+        window_planes.push_back(out_fit_counts->plane_index(window.name));
+    }
+    // planes start at zero, a roi fit has no iterations, residual or scatter amplitudes to store
+    int total_fy_plane = out_fit_counts->plane_index(STR_TOTAL_FLUORESCENCE_YIELD);
+
+    unsigned int left_roi = 0;
+    size_t spec_size = 0;
+    for (size_t col = 0; col < spectra_line->size(); col++)
+    {
+        const Spectra<T_real>& spectra = (*spectra_line)[col];
+        unsigned int n_mca_channels = spectra.size();
+        T_real elapsed_livetime = spectra.elapsed_livetime();
+        for (size_t w = 0; w < _roi_windows.size(); w++)
+        {
+            if (window_planes[w] > -1)
             {
-                left_roi = right_roi - 1;
+                _clamp_window(_roi_windows[w], n_mca_channels, left_roi, spec_size);
+                out_fit_counts->at(window_planes[w], row, col) = spectra.segment(left_roi, spec_size).sum() / elapsed_livetime;
             }
-
-            size_t spec_size = (right_roi - left_roi) + 1;
-            out_counts[e_itr.first] = spectra->segment(left_roi, spec_size).sum();
+        }
+        if (total_fy_plane > -1)
+        {
+            out_fit_counts->at(total_fy_plane, row, col) = spectra.sum() / elapsed_livetime;
         }
     }
-    return optimizers::OPTIMIZER_OUTCOME::CONVERGED;
+    return true;
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -116,7 +204,32 @@ void ROI_Fit_Routine<T_real>::initialize(models::Base_Model<T_real>* const model
                                  const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                                  const struct Range energy_range)
 {
-    //N/A
+    _roi_windows.clear();
+    _initialized_elements = nullptr;
+    if (model == nullptr || elements_to_fit == nullptr)
+    {
+        return;
+    }
+
+    const Fit_Parameters<T_real>& fitp = model->fit_parameters();
+    T_real energy_offset = fitp.value(STR_ENERGY_OFFSET);
+    T_real energy_slope = fitp.value(STR_ENERGY_SLOPE);
+    for (const auto& e_itr : *elements_to_fit)
+    {
+        Fit_Element_Map<T_real>* element = e_itr.second;
+        if (element != nullptr)
+        {
+            ROI_Window window;
+            window.name = e_itr.first;
+            window.left_roi = static_cast<unsigned int>(std::round(((element->center() - element->width()) - energy_offset) / energy_slope));
+            window.right_roi = static_cast<unsigned int>(std::round(((element->center() + element->width()) - energy_offset) / energy_slope));
+            _roi_windows.push_back(window);
+        }
+    }
+    _initialized_elements = elements_to_fit;
+    _initialized_energy_offset = energy_offset;
+    _initialized_energy_slope = energy_slope;
+    _initialized_energy_range = energy_range;
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -51,6 +51,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define ROI_Fit_Routine_H
 
 #include "fitting/routines/base_fit_routine.h"
+#include "data_struct/spectra_line.h"
 
 namespace fitting
 {
@@ -59,6 +60,16 @@ namespace routines
 
 using namespace data_struct;
 
+///
+/// \brief The ROI_Window struct : channel bounds of an element roi, before clamping to the spectra size
+///
+struct ROI_Window
+{
+    std::string name;
+    unsigned int left_roi;
+    unsigned int right_roi;
+};
+
 template<typename T_real>
 class DLL_EXPORT ROI_Fit_Routine: public Base_Fit_Routine<T_real>
 {
@@ -79,8 +90,39 @@ public:
                             const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
                             const struct Range energy_range);
 
+    /**
+     * @brief fit_spectra_line : Sum the roi windows of a whole row of spectra straight into the counts per sec maps.
+     *                           Requires initialize to be called with the same model calibration, elements_to_fit and energy_range.
+     * @return false if the roi windows were not initialized for them
+     */
+    bool fit_spectra_line(const models::Base_Model<T_real>* const model,
+                          const Spectra_Line<T_real>* const spectra_line,
+                          const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                          const struct Range energy_range,
+                          Fit_Count_Tensor<T_real>* out_fit_counts,
+                          size_t row);
+
+    /**
+     * @brief is_initialized_for : true if the cached roi windows were computed for elements_to_fit, the energy
+     *                             offset and slope of the model and energy_range.
+     */
+    bool is_initialized_for(const models::Base_Model<T_real>* const model,
+                            const Fit_Element_Map_Dict<T_real>* const elements_to_fit,
+                            const struct Range energy_range) const;
+
 protected:
 
+    void _clamp_window(const ROI_Window& window, unsigned int n_mca_channels, unsigned int& left_roi, size_t& spec_size) const;
+
+    std::vector<ROI_Window> _roi_windows;
+
+    const Fit_Element_Map_Dict<T_real>* _initialized_elements;
+
+    T_real _initialized_energy_offset;
+
+    T_real _initialized_energy_slope;
+
+    struct Range _initialized_energy_range;
 
 
 
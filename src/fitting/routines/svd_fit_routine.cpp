@@ -147,12 +147,10 @@ optimizers::OPTIMIZER_OUTCOME SVD_Fit_Routine<T_real>::fit_spectra(const models:
         }
     }
 
-    //lock and integrate results
-    {
-        std::lock_guard<std::mutex> lock(this->_int_spec_mutex);
-        this->_integrated_fitted_spectra.add(spectra_model);
-        //_integrated_background.add(background);
-    }
+    //integrate results into this thread's accumulator, reduced by reduce_integrated_spectra()
+    Integrated_Spectra_Accumulator<T_real>* accumulator = this->_get_thread_accumulator();
+    accumulator->fitted_spectra += spectra_model;
+    //accumulator->background += background;
 
     out_counts[STR_RESIDUAL] = (_fitmatrix * result - rhs).norm();
 
@@ -704,6 +704,22 @@ DLL_EXPORT bool load_parameters_override(std::string path, Params_Override<T_rea
                         value.erase(std::remove(value.begin(), value.end(), ' '), value.end());
                         params_override->theta_pv = value;
                     }
+                    else if (tag == "COMPRESSION" || tag == "SPECTRA_COMPRESSION")
+                    {
+                        std::string value;
+                        std::getline(strstream, value);
+                        value.erase(std::remove(value.begin(), value.end(), '\n'), value.end());
+                        value.erase(std::remove(value.begin(), value.end(), '\r'), value.end());
+                        value.erase(std::remove(value.begin(), value.end(), ' '), value.end());
+                        if (tag == "COMPRESSION")
+                        {
+                            params_override->compression = value;
+                        }
+                        else
+                        {
+                            params_override->spectra_compression = value;
+                        }
+                    }
                 }
                 catch (std::exception& e)
                 {
@@ -979,6 +995,15 @@ DLL_EXPORT bool save_parameters_override(std::string path, Params_Override<T_rea
         out_stream << "DS_AMP_SENS_NUM: " << params_override->ds_amp_sens_num << "\n";
         out_stream << "DS_AMP_SENS_UNIT: " << params_override->ds_amp_sens_unit << "\n";
         out_stream << "THETA_PV: " << params_override->theta_pv << "\n";
+        out_stream << "    hdf5 output compression: none, deflate:<0-9>, lz4, zstd:<1-22>, blosc:<0-9>. Prefix with shuffle+ to shuffle bytes first. SPECTRA_COMPRESSION is used for mca_arr\n";
+        if (params_override->compression.length() > 0)
+        {
+            out_stream << "COMPRESSION: " << params_override->compression << "\n";
+        }
+        if (params_override->spectra_compression.length() > 0)
+        {
+            out_stream << "SPECTRA_COMPRESSION: " << params_override->spectra_compression << "\n";
+        }
         out_stream << "    the lines (if any) below will override the detector names built in to maps. please modify only if you are sure you understand the effect\n";
         out_stream.close();
         return true;
@@ -0,0 +1,629 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#include "element_info_cache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "data_struct/element_info.h"
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#define ELEMENT_CACHE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+namespace io
+{
+namespace file
+{
+
+static const char ELEMENT_CACHE_MAGIC[8] = { 'X', 'R', 'F', 'E', 'L', 'E', 'M', '\0' };
+static const uint32_t ELEMENT_CACHE_BYTE_ORDER = 0x01020304;
+static const size_t ELEMENT_CACHE_NAME_LEN = 16;
+static const size_t ELEMENT_CACHE_KEY_LEN = 8;
+
+struct Element_Cache_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t henke_size;
+    uint64_t henke_hash;
+    uint64_t csv_size;
+    uint64_t csv_hash;
+    int64_t henke_mtime;
+    int64_t csv_mtime;
+    uint32_t num_energies;
+    uint32_t num_elements;
+};
+
+// ----------------------------------------------------------------------------
+
+static bool stat_source(const std::string& filename, uint64_t* out_size, int64_t* out_mtime)
+{
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0)
+    {
+        return false;
+    }
+    *out_size = (uint64_t)file_stat.st_size;
+    *out_mtime = (int64_t)file_stat.st_mtime;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static bool hash_source(const std::string& filename, uint64_t* out_hash)
+{
+    std::ifstream file_stream(filename, std::ios::binary);
+    if (false == file_stream.good())
+    {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file_stream.rdbuf();
+    const std::string data = buffer.str();
+
+    // FNV-1a 64
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : data)
+    {
+        hash ^= (uint64_t)(unsigned char)c;
+        hash *= 1099511628211ULL;
+    }
+    *out_hash = hash;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static bool fill_header(Element_Cache_Header* header, const std::string& henke_filename, const std::string& csv_filename)
+{
+    std::memset(header, 0, sizeof(Element_Cache_Header));
+    std::memcpy(header->magic, ELEMENT_CACHE_MAGIC, sizeof(ELEMENT_CACHE_MAGIC));
+    header->version = ELEMENT_INFO_CACHE_VERSION;
+    header->byte_order = ELEMENT_CACHE_BYTE_ORDER;
+    return stat_source(henke_filename, &header->henke_size, &header->henke_mtime)
+        && stat_source(csv_filename, &header->csv_size, &header->csv_mtime)
+        && hash_source(henke_filename, &header->henke_hash)
+        && hash_source(csv_filename, &header->csv_hash);
+}
+
+// ----------------------------------------------------------------------------
+// Writer
+
+class Cache_Writer
+{
+public:
+
+    template<typename T>
+    void put(const T& val)
+    {
+        const char* ptr = (const char*)&val;
+        _buf.insert(_buf.end(), ptr, ptr + sizeof(T));
+    }
+
+    bool put_str(const std::string& str, size_t len)
+    {
+        if (str.length() >= len)
+        {
+            return false;
+        }
+        std::vector<char> fixed(len, '\0');
+        std::memcpy(fixed.data(), str.c_str(), str.length());
+        _buf.insert(_buf.end(), fixed.begin(), fixed.end());
+        return true;
+    }
+
+    void put_floats(const std::vector<float>& vec)
+    {
+        const char* ptr = (const char*)vec.data();
+        _buf.insert(_buf.end(), ptr, ptr + (vec.size() * sizeof(float)));
+    }
+
+    const std::vector<char>& buffer() const { return _buf; }
+
+private:
+
+    std::vector<char> _buf;
+};
+
+// ----------------------------------------------------------------------------
+
+static bool write_table(Cache_Writer& writer, const std::unordered_map<std::string, double>& table_d, const std::unordered_map<std::string, float>& table_f)
+{
+    writer.put((uint32_t)table_d.size());
+    for (const auto& itr : table_d)
+    {
+        const auto f_itr = table_f.find(itr.first);
+        if (f_itr == table_f.end() || false == writer.put_str(itr.first, ELEMENT_CACHE_KEY_LEN))
+        {
+            return false;
+        }
+        writer.put(itr.second);
+        writer.put(f_itr->second);
+        writer.put((uint32_t)0);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+DLL_EXPORT bool save_element_info_cache(const std::string& cache_filename, const std::string& henke_filename, const std::string& csv_filename)
+{
+    data_struct::Element_Info_Map<float>* map_f = data_struct::Element_Info_Map<float>::inst();
+    data_struct::Element_Info_Map<double>* map_d = data_struct::Element_Info_Map<double>::inst();
+
+    Element_Cache_Header header;
+    if (false == fill_header(&header, henke_filename, csv_filename))
+    {
+        return false;
+    }
+    if (map_f->_energies != map_d->_energies)
+    {
+        return false;
+    }
+    header.num_energies = (uint32_t)map_d->_energies.size();
+    for (const auto& itr : map_d->elements())
+    {
+        if (itr.second != nullptr)
+        {
+            header.num_elements++;
+        }
+    }
+
+    Cache_Writer writer;
+    writer.put(header);
+    writer.put_floats(map_d->_energies);
+
+    for (const auto& itr : map_d->elements())
+    {
+        const data_struct::Element_Info<double>* element_d = itr.second;
+        if (element_d == nullptr)
+        {
+            continue;
+        }
+        const auto f_itr = map_f->elements().find(itr.first);
+        if (f_itr == map_f->elements().end() || f_itr->second == nullptr)
+        {
+            return false;
+        }
+        const data_struct::Element_Info<float>* element_f = f_itr->second;
+
+        // key the element was registered under in the name lookup, csv may rename elements that henke added
+        std::string name_key = element_d->name;
+        if (element_d->number > 0 && element_d->number < (int)(sizeof(data_struct::Element_Symbols) / sizeof(std::string)))
+        {
+            const std::string& symbol = data_struct::Element_Symbols[element_d->number];
+            if (map_d->contains(symbol) && map_d->get_element(symbol) == element_d)
+            {
+                name_key = symbol;
+            }
+        }
+
+        writer.put((int32_t)element_d->number);
+        if (false == writer.put_str(element_d->name, ELEMENT_CACHE_NAME_LEN) || false == writer.put_str(name_key, ELEMENT_CACHE_NAME_LEN))
+        {
+            return false;
+        }
+        writer.put(element_d->density);
+        writer.put(element_d->mass);
+        writer.put(element_f->density);
+        writer.put(element_f->mass);
+
+        if (false == write_table(writer, element_d->xrf, element_f->xrf)
+            || false == write_table(writer, element_d->xrf_abs_yield, element_f->xrf_abs_yield)
+            || false == write_table(writer, element_d->yieldD, element_f->yieldD)
+            || false == write_table(writer, element_d->bindingE, element_f->bindingE)
+            || false == write_table(writer, element_d->jump, element_f->jump))
+        {
+            return false;
+        }
+
+        if (element_d->f2_atomic_scattering_imaginary.size() != element_d->f1_atomic_scattering_real.size()
+            || element_d->extra_f1.size() != element_d->extra_energies.size()
+            || element_d->extra_f2.size() != element_d->extra_energies.size())
+        {
+            return false;
+        }
+        writer.put((uint32_t)element_d->f1_atomic_scattering_real.size());
+        writer.put_floats(element_d->f1_atomic_scattering_real);
+        writer.put_floats(element_d->f2_atomic_scattering_imaginary);
+        writer.put((uint32_t)element_d->extra_energies.size());
+        writer.put_floats(element_d->extra_energies);
+        writer.put_floats(element_d->extra_f1);
+        writer.put_floats(element_d->extra_f2);
+    }
+
+    // write to a temp file and rename so concurrent processes never map a partial cache.
+    // the pid keeps processes apart, the thread id keeps threads of one process apart.
+#if defined(_WIN32)
+    const long pid = (long)_getpid();
+#else
+    const long pid = (long)getpid();
+#endif
+    std::stringstream tmp_name;
+    tmp_name << cache_filename << ".tmp" << pid << "_" << std::hash<std::thread::id>()(std::this_thread::get_id());
+    const std::string tmp_filename = tmp_name.str();
+    std::FILE* fptr = std::fopen(tmp_filename.c_str(), "wb");
+    if (fptr == nullptr)
+    {
+        return false;
+    }
+    const std::vector<char>& buf = writer.buffer();
+    bool ok = (std::fwrite(buf.data(), 1, buf.size(), fptr) == buf.size());
+    ok = (std::fclose(fptr) == 0) && ok;
+    if (ok)
+    {
+        std::remove(cache_filename.c_str());
+        ok = (std::rename(tmp_filename.c_str(), cache_filename.c_str()) == 0);
+    }
+    if (false == ok)
+    {
+        std::remove(tmp_filename.c_str());
+    }
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// Reader
+
+class Cache_Reader
+{
+public:
+
+    Cache_Reader(const char* data, size_t size) : _data(data), _size(size), _pos(0) {}
+
+    template<typename T>
+    bool get(T* out_val)
+    {
+        if (_pos + sizeof(T) > _size)
+        {
+            return false;
+        }
+        std::memcpy(out_val, _data + _pos, sizeof(T));
+        _pos += sizeof(T);
+        return true;
+    }
+
+    bool get_str(std::string* out_str, size_t len)
+    {
+        if (_pos + len > _size || _data[_pos + len - 1] != '\0')
+        {
+            return false;
+        }
+        *out_str = std::string(_data + _pos);
+        _pos += len;
+        return true;
+    }
+
+    bool get_floats(std::vector<float>* out_vec, size_t count, bool apply)
+    {
+        const size_t bytes = count * sizeof(float);
+        if (_pos + bytes > _size)
+        {
+            return false;
+        }
+        if (apply)
+        {
+            out_vec->resize(count);
+            if (count > 0)
+            {
+                std::memcpy(out_vec->data(), _data + _pos, bytes);
+            }
+        }
+        _pos += bytes;
+        return true;
+    }
+
+    bool at_end() const { return _pos == _size; }
+
+private:
+
+    const char* _data;
+    size_t _size;
+    size_t _pos;
+};
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+static bool read_table(Cache_Reader& reader, std::unordered_map<std::string, T_real>* table, bool apply)
+{
+    uint32_t count;
+    if (false == reader.get(&count))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        std::string key;
+        double val_d;
+        float val_f;
+        uint32_t pad;
+        if (false == reader.get_str(&key, ELEMENT_CACHE_KEY_LEN) || false == reader.get(&val_d) || false == reader.get(&val_f) || false == reader.get(&pad))
+        {
+            return false;
+        }
+        if (apply)
+        {
+            (*table)[key] = std::is_same<T_real, float>::value ? (T_real)val_f : (T_real)val_d;
+        }
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+// Walks the records after the header. With apply == false it only validates the layout so a bad cache never leaves a map half filled.
+template<typename T_real>
+static bool read_elements(const char* data, size_t size, bool apply)
+{
+    data_struct::Element_Info_Map<T_real>* element_map = data_struct::Element_Info_Map<T_real>::inst();
+    Cache_Reader reader(data, size);
+    Element_Cache_Header header;
+    if (false == reader.get(&header) || false == reader.get_floats(&element_map->_energies, header.num_energies, apply))
+    {
+        return false;
+    }
+
+    data_struct::Element_Info<T_real> scratch;
+    for (uint32_t e = 0; e < header.num_elements; e++)
+    {
+        int32_t number;
+        std::string name;
+        std::string name_key;
+        double density_d, mass_d;
+        float density_f, mass_f;
+        if (false == reader.get(&number)
+            || false == reader.get_str(&name, ELEMENT_CACHE_NAME_LEN)
+            || false == reader.get_str(&name_key, ELEMENT_CACHE_NAME_LEN)
+            || false == reader.get(&density_d)
+            || false == reader.get(&mass_d)
+            || false == reader.get(&density_f)
+            || false == reader.get(&mass_f))
+        {
+            return false;
+        }
+
+        data_struct::Element_Info<T_real>* element = &scratch;
+        if (apply)
+        {
+            element = element_map->get_element(number);
+            if (element == nullptr)
+            {
+                element = new data_struct::Element_Info<T_real>();
+                element->number = number;
+                element->name = name_key;
+                element_map->add_element(element);
+            }
+            element->number = number;
+            element->name = name;
+            element->density = std::is_same<T_real, float>::value ? (T_real)density_f : (T_real)density_d;
+            element->mass = std::is_same<T_real, float>::value ? (T_real)mass_f : (T_real)mass_d;
+        }
+
+        if (false == read_table(reader, &element->xrf, apply)
+            || false == read_table(reader, &element->xrf_abs_yield, apply)
+            || false == read_table(reader, &element->yieldD, apply)
+            || false == read_table(reader, &element->bindingE, apply)
+            || false == read_table(reader, &element->jump, apply))
+        {
+            return false;
+        }
+
+        uint32_t num_f;
+        uint32_t num_extra;
+        if (false == reader.get(&num_f)
+            || false == reader.get_floats(&element->f1_atomic_scattering_real, num_f, apply)
+            || false == reader.get_floats(&element->f2_atomic_scattering_imaginary, num_f, apply)
+            || false == reader.get(&num_extra)
+            || false == reader.get_floats(&element->extra_energies, num_extra, apply)
+            || false == reader.get_floats(&element->extra_f1, num_extra, apply)
+            || false == reader.get_floats(&element->extra_f2, num_extra, apply))
+        {
+            return false;
+        }
+    }
+
+    return reader.at_end();
+}
+
+// ----------------------------------------------------------------------------
+
+// On a match with a source touched since the cache was written, out_touched is set and out_header holds the header to write back.
+static bool check_header(const char* data, size_t size, const std::string& henke_filename, const std::string& csv_filename, bool* out_touched, Element_Cache_Header* out_header)
+{
+    *out_touched = false;
+    Element_Cache_Header header;
+    Element_Cache_Header expected;
+    if (size < sizeof(Element_Cache_Header))
+    {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(Element_Cache_Header));
+    if (std::memcmp(header.magic, ELEMENT_CACHE_MAGIC, sizeof(ELEMENT_CACHE_MAGIC)) != 0
+        || header.version != ELEMENT_INFO_CACHE_VERSION
+        || header.byte_order != ELEMENT_CACHE_BYTE_ORDER)
+    {
+        return false;
+    }
+    if (false == stat_source(henke_filename, &expected.henke_size, &expected.henke_mtime)
+        || false == stat_source(csv_filename, &expected.csv_size, &expected.csv_mtime))
+    {
+        return false;
+    }
+    if (header.henke_size != expected.henke_size || header.csv_size != expected.csv_size)
+    {
+        return false;
+    }
+    if (header.henke_mtime == expected.henke_mtime && header.csv_mtime == expected.csv_mtime)
+    {
+        return true;
+    }
+    // touched since the cache was written, the contents decide
+    if (false == hash_source(henke_filename, &expected.henke_hash) || false == hash_source(csv_filename, &expected.csv_hash))
+    {
+        return false;
+    }
+    if (header.henke_hash != expected.henke_hash || header.csv_hash != expected.csv_hash)
+    {
+        return false;
+    }
+    *out_touched = true;
+    *out_header = header;
+    out_header->henke_mtime = expected.henke_mtime;
+    out_header->csv_mtime = expected.csv_mtime;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+static bool load_from_buffer(const char* data, size_t size, const std::string& henke_filename, const std::string& csv_filename, bool* out_touched, Element_Cache_Header* out_header)
+{
+    if (false == check_header(data, size, henke_filename, csv_filename, out_touched, out_header))
+    {
+        return false;
+    }
+    if (false == read_elements<double>(data, size, false))
+    {
+        return false;
+    }
+    read_elements<float>(data, size, true);
+    read_elements<double>(data, size, true);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+// Best effort, so the next start can skip hashing the touched source again. Only the mtimes change, a concurrent reader
+// of the old header sees the same contents either way.
+static void write_header_mtimes(const std::string& cache_filename, const Element_Cache_Header& header)
+{
+    std::FILE* fptr = std::fopen(cache_filename.c_str(), "r+b");
+    if (fptr == nullptr)
+    {
+        return;
+    }
+    std::fwrite(&header, sizeof(Element_Cache_Header), 1, fptr);
+    std::fclose(fptr);
+}
+
+// ----------------------------------------------------------------------------
+
+DLL_EXPORT bool load_element_info_cache(const std::string& cache_filename, const std::string& henke_filename, const std::string& csv_filename)
+{
+#ifdef ELEMENT_CACHE_MMAP
+    int fd = open(cache_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    const size_t map_size = (size_t)file_stat.st_size;
+    void* map_ptr = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_ptr == MAP_FAILED)
+    {
+        return false;
+    }
+    bool touched = false;
+    Element_Cache_Header header;
+    bool ret_val = load_from_buffer((const char*)map_ptr, map_size, henke_filename, csv_filename, &touched, &header);
+    munmap(map_ptr, map_size);
+    if (ret_val && touched)
+    {
+        write_header_mtimes(cache_filename, header);
+    }
+    return ret_val;
+#else
+    std::ifstream file_stream(cache_filename, std::ios::binary);
+    if (false == file_stream.good())
+    {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file_stream.rdbuf();
+    const std::string data = buffer.str();
+    file_stream.close();
+    bool touched = false;
+    Element_Cache_Header header;
+    if (false == load_from_buffer(data.data(), data.size(), henke_filename, csv_filename, &touched, &header))
+    {
+        return false;
+    }
+    if (touched)
+    {
+        write_header_mtimes(cache_filename, header);
+    }
+    return true;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+} //namespace file
+} //namespace io
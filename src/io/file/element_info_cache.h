@@ -0,0 +1,72 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+#ifndef _ELEMENT_INFO_CACHE_H
+#define _ELEMENT_INFO_CACHE_H
+
+#include <string>
+#include "core/defines.h"
+
+namespace io
+{
+namespace file
+{
+
+// Binary snapshot of Element_Info_Map<float> and Element_Info_Map<double> so startup can skip parsing henke.xdr and xrf_library.csv.
+// The file is a flat little endian layout: header, energies, then one record per element. The header stores the size, mtime
+// and a FNV-1a checksum of both source files. The cache is used when sizes and mtimes match; when only an mtime differs the
+// sources are hashed and the checksums decide.
+#define ELEMENT_INFO_CACHE_VERSION 2
+
+/// \brief Fill both element maps from cache_filename. Returns false if the cache is missing, stale or malformed.
+DLL_EXPORT bool load_element_info_cache(const std::string& cache_filename, const std::string& henke_filename, const std::string& csv_filename);
+
+/// \brief Write both element maps (already loaded from henke_filename and csv_filename) to cache_filename.
+DLL_EXPORT bool save_element_info_cache(const std::string& cache_filename, const std::string& henke_filename, const std::string& csv_filename);
+
+} //namespace file
+} //namespace io
+
+#endif
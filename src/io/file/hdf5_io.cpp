@@ -95,6 +95,73 @@ hsize_t max_dims_3d[3] = { H5S_UNLIMITED, H5S_UNLIMITED, H5S_UNLIMITED };
 
 //-----------------------------------------------------------------------------
 
+bool parse_h5_compression(std::string str, H5_Compression& out_compression)
+{
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    str.erase(std::remove_if(str.begin(), str.end(), ::isspace), str.end());
+
+    H5_Compression compression;
+    compression.shuffle = false;
+    if (str.compare(0, 8, "shuffle+") == 0)
+    {
+        compression.shuffle = true;
+        str = str.substr(8);
+    }
+
+    std::string name = str;
+    int level = -1;
+    size_t idx = str.find(':');
+    if (idx != std::string::npos)
+    {
+        name = str.substr(0, idx);
+        try
+        {
+            level = std::stoi(str.substr(idx + 1));
+        }
+        catch (std::exception&)
+        {
+            logE << "Could not parse compression level: " << str << "\n";
+            return false;
+        }
+    }
+
+    if (name == "none")
+    {
+        compression.filter = H5_COMP_NONE;
+        compression.level = 0;
+    }
+    else if (name == "deflate" || name == "gzip")
+    {
+        compression.filter = H5_COMP_DEFLATE;
+        compression.level = (level < 0) ? 7 : std::min(level, 9);
+    }
+    else if (name == "lz4")
+    {
+        compression.filter = H5_COMP_LZ4;
+        compression.level = 0;
+    }
+    else if (name == "zstd")
+    {
+        compression.filter = H5_COMP_ZSTD;
+        compression.level = (level < 0) ? 3 : std::min(level, 22);
+    }
+    else if (name == "blosc")
+    {
+        compression.filter = H5_COMP_BLOSC;
+        compression.level = (level < 0) ? 5 : std::min(level, 9);
+    }
+    else
+    {
+        logE << "Unknown compression filter: " << name << ". Use none, deflate, lz4, zstd, or blosc\n";
+        return false;
+    }
+
+    out_compression = compression;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
 HDF5_IO* HDF5_IO::_this_inst(nullptr);
 
 
@@ -106,6 +173,12 @@ HDF5_IO::HDF5_IO()
 	hid_t status;
     status = H5Eset_auto(H5E_DEFAULT, nullptr, nullptr);
     _cur_file_id = -1;
+    _async_thread = nullptr;
+    _async_max_jobs = HDF5_ASYNC_MAX_JOBS;
+    _async_running = false;
+    _async_busy = false;
+    _default_compression = H5_Compression();
+    _compress_threads = 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -125,6 +198,7 @@ HDF5_IO* HDF5_IO::inst()
 
 HDF5_IO::~HDF5_IO()
 {
+    stop_async_saves();
 	_cur_file_id = -1;
 	_cur_filename = "";
 }
@@ -236,7 +310,7 @@ bool HDF5_IO::_create_memory_space(int rank, const hsize_t* count, hid_t& out_id
 
 //-----------------------------------------------------------------------------
 
-bool HDF5_IO::_open_h5_dataset(const std::string& name, hid_t data_type, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece)
+bool HDF5_IO::_open_h5_dataset(const std::string& name, hid_t data_type, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece, bool contiguous)
 {
     out_id = H5Dopen(parent_id, name.c_str(), H5P_DEFAULT);
     if (out_id < 0)
@@ -257,12 +331,16 @@ bool HDF5_IO::_open_h5_dataset(const std::string& name, hid_t data_type, hid_t p
         default:
             return false;
         }
-        out_dataspece = H5Screate_simple(dims_size, dims, max_dims);
+        // contiguous datasets have fixed dims and no filters, but are read back in one pass when loaded
+        out_dataspece = H5Screate_simple(dims_size, dims, contiguous ? nullptr : max_dims);
         _global_close_map.push({ out_dataspece, H5O_DATASPACE });
 
         hid_t dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
-        H5Pset_chunk(dcpl_id, dims_size, chunk_dims);
-        H5Pset_deflate(dcpl_id, 7);
+        if (false == contiguous)
+        {
+            H5Pset_chunk(dcpl_id, dims_size, chunk_dims);
+            _set_dcpl_compression(dcpl_id, name);
+        }
         _global_close_map.push({ dcpl_id, H5O_PROPERTY });
 
         out_id = H5Dcreate(parent_id, name.c_str(), data_type, out_dataspece, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
@@ -293,6 +371,20 @@ bool HDF5_IO::_open_h5_dataset(const std::string& name, hid_t data_type, hid_t p
             }
             if (expand)
             {
+                hid_t dcpl_id = H5Dget_create_plist(out_id);
+                H5D_layout_t layout = H5Pget_layout(dcpl_id);
+                H5Pclose(dcpl_id);
+                if (layout != H5D_CHUNKED)
+                {
+                    // fixed size dataset, replace it with a new one
+                    delete[]tmp_dims;
+                    if (H5Ldelete(parent_id, name.c_str(), H5P_DEFAULT) < 0)
+                    {
+                        logE << "Failed to replace dataset [" << name << "]\n";
+                        return false;
+                    }
+                    return _open_h5_dataset(name, data_type, parent_id, dims_size, dims, chunk_dims, out_id, out_dataspece, contiguous);
+                }
                 herr_t err = H5Dset_extent(out_id, dims);
                 if (err < 0)
                 {
@@ -376,13 +468,266 @@ void HDF5_IO::_close_h5_objects(std::stack<std::pair<hid_t, H5_OBJECTS> >  &clos
 
 //-----------------------------------------------------------------------------
 
+void HDF5_IO::start_async_saves(size_t max_queued_jobs)
+{
+    if (_async_thread != nullptr)
+    {
+        stop_async_saves();
+    }
+    _async_max_jobs = std::max(max_queued_jobs, (size_t)1);
+    _async_running = true;
+    _async_busy = false;
+    _async_thread = new std::thread(&HDF5_IO::_async_save_thread, this);
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::async_save(std::function<void()> job)
+{
+    if (_async_thread == nullptr || std::this_thread::get_id() == _async_thread->get_id())
+    {
+        job();
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_async_mutex);
+        _async_condition.wait(lock, [this] { return _async_jobs.size() < _async_max_jobs; });
+        _async_jobs.emplace(std::move(job));
+    }
+    _async_condition.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::flush_async_saves()
+{
+    if (_async_thread == nullptr || std::this_thread::get_id() == _async_thread->get_id())
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_async_mutex);
+    _async_condition.wait(lock, [this] { return _async_jobs.empty() && false == _async_busy; });
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::stop_async_saves()
+{
+    if (_async_thread == nullptr)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_async_mutex);
+        _async_running = false;
+    }
+    _async_condition.notify_all();
+    _async_thread->join();
+    delete _async_thread;
+    _async_thread = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::async_end_save_seq()
+{
+    if (_async_thread == nullptr)
+    {
+        end_save_seq();
+        return;
+    }
+
+    // _cur_filename can be changed by set_filename() before this job runs, so log the name now
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        filename = _cur_filename;
+    }
+    async_save([this, filename]()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        logI << "closing file " << filename << "\n";
+        _end_save_seq(false);
+    });
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::_async_save_thread()
+{
+    //disable hdf print to std err, error stack is per thread
+    H5Eset_auto(H5E_DEFAULT, nullptr, nullptr);
+
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(_async_mutex);
+            _async_condition.wait(lock, [this] { return false == _async_running || false == _async_jobs.empty(); });
+            if (false == _async_running && _async_jobs.empty())
+            {
+                return;
+            }
+            job = std::move(_async_jobs.front());
+            _async_jobs.pop();
+            _async_busy = true;
+        }
+        _async_condition.notify_all();
+
+        try
+        {
+            job();
+        }
+        catch (std::exception& e)
+        {
+            logE << "Async save job failed: " << e.what() << "\n";
+        }
+        catch (...)
+        {
+            logE << "Async save job failed with unknown exception\n";
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(_async_mutex);
+            _async_busy = false;
+        }
+        _async_condition.notify_all();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::set_compression(const H5_Compression& compression)
+{
+    // queued saves read the compression when they run
+    flush_async_saves();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _default_compression = compression;
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::set_dataset_compression(const std::string& dataset_name, const H5_Compression& compression)
+{
+    flush_async_saves();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dataset_compression[dataset_name] = compression;
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::clear_dataset_compression(const std::string& dataset_name)
+{
+    flush_async_saves();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _dataset_compression.erase(dataset_name);
+}
+
+//-----------------------------------------------------------------------------
+
+const H5_Compression& HDF5_IO::_get_compression(const std::string& dataset_name)
+{
+    const auto& itr = _dataset_compression.find(dataset_name);
+    if (itr != _dataset_compression.end())
+    {
+        return itr->second;
+    }
+    return _default_compression;
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::_set_dcpl_compression(hid_t dcpl_id, const std::string& dataset_name)
+{
+    const H5_Compression& compression = _get_compression(dataset_name);
+
+    if (compression.filter == H5_COMP_NONE)
+    {
+        return;
+    }
+
+    H5Z_filter_t filter_id = H5Z_FILTER_DEFLATE;
+    std::vector<unsigned int> cd_values;
+    switch (compression.filter)
+    {
+    case H5_COMP_LZ4:
+        filter_id = H5Z_FILTER_LZ4_ID;
+        cd_values = { 0 }; // default block size
+        break;
+    case H5_COMP_ZSTD:
+        filter_id = H5Z_FILTER_ZSTD_ID;
+        cd_values = { compression.level };
+        break;
+    case H5_COMP_BLOSC:
+        filter_id = H5Z_FILTER_BLOSC_ID;
+        // 0-3 are filled in by the filter, then level, shuffle, compressor (0 = blosclz)
+        cd_values = { 0, 0, 0, 0, compression.level, (unsigned int)compression.shuffle, 0 };
+        break;
+    default:
+        break;
+    }
+
+    if (filter_id != H5Z_FILTER_DEFLATE && H5Zfilter_avail(filter_id) <= 0)
+    {
+        logW << "HDF5 filter plugin " << filter_id << " not available, check HDF5_PLUGIN_PATH. Using shuffle+deflate for " << dataset_name << "\n";
+        filter_id = H5Z_FILTER_DEFLATE;
+    }
+
+    if (filter_id == H5Z_FILTER_DEFLATE)
+    {
+        if (compression.shuffle || compression.filter != H5_COMP_DEFLATE)
+        {
+            H5Pset_shuffle(dcpl_id);
+        }
+        H5Pset_deflate(dcpl_id, (compression.filter == H5_COMP_DEFLATE) ? compression.level : 4);
+    }
+    else
+    {
+        // blosc does its own shuffle
+        if (compression.shuffle && filter_id != H5Z_FILTER_BLOSC_ID)
+        {
+            H5Pset_shuffle(dcpl_id);
+        }
+        H5Pset_filter(dcpl_id, filter_id, H5Z_FLAG_OPTIONAL, cd_values.size(), cd_values.data());
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool HDF5_IO::start_save_seq(bool force_new_file)
+{
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        filename = _cur_filename;
+    }
+    return start_save_seq(filename, force_new_file, false);
+}
+
+//-----------------------------------------------------------------------------
+
+void HDF5_IO::set_filename(std::string fname)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cur_filename = fname;
+}
+
+//-----------------------------------------------------------------------------
+
 bool HDF5_IO::start_save_seq(const std::string filename, bool force_new_file, bool open_file_only)
 {
+    // queued saves still write to _cur_file_id
+    flush_async_saves();
+    std::lock_guard<std::mutex> lock(_mutex);
 
     if (_cur_file_id > -1)
     {
         logI<<" file already open, calling close() before opening new file. "<<"\n";
-        end_save_seq();
+        _end_save_seq();
+        _cur_filename = "";
     }
 
     if(false == force_new_file)
@@ -412,6 +757,21 @@ bool HDF5_IO::start_save_seq(const std::string filename, bool force_new_file, bo
 //-----------------------------------------------------------------------------
 
 bool HDF5_IO::end_save_seq(bool loginfo)
+{
+    flush_async_saves();
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_end_save_seq(loginfo))
+    {
+        _cur_filename = "";
+        return true;
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HDF5_IO::_end_save_seq(bool loginfo)
 {
 
     if(_cur_file_id > 0)
@@ -493,7 +853,6 @@ bool HDF5_IO::end_save_seq(bool loginfo)
         logW<<" could not close file because none is open"<<"\n";
         return false;
     }
-    _cur_filename = "";
     return true;
 
 }
@@ -754,7 +1113,7 @@ bool HDF5_IO::generate_avg(std::string avg_filename, std::vector<std::string> fi
         H5Pclose(ocpypl_id);
         H5Gclose(dst_maps_grp_id);
         _cur_file_id = file_id;
-        end_save_seq();
+        _end_save_seq();
     }
     else
     {
@@ -764,7 +1123,7 @@ bool HDF5_IO::generate_avg(std::string avg_filename, std::vector<std::string> fi
     for(auto& f_id : hdf5_file_ids)
     {
         _cur_file_id = f_id;
-        end_save_seq(false);
+        _end_save_seq(false);
     }
 
     logI<<"closing file"<<"\n";
@@ -1153,27 +1512,248 @@ void HDF5_IO::_generate_avg_integrated_spectra(hid_t src_analyzed_grp_id, hid_t
 
 //-----------------------------------------------------------------------------
 
-bool HDF5_IO::generate_stream_dataset(std::string dataset_directory,
+bool HDF5_IO::_generate_stream_dataset(std::string dataset_directory,
                                       std::string dataset_name,
+                                      size_t d_hash,
                                       int detector_num,
                                       size_t height,
-                                      size_t width)
+                                      size_t width,
+                                      size_t spectra_size,
+                                      hid_t data_type)
 {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_get_stream_dataset(d_hash, detector_num) != nullptr)
+    {
+        logW << "Stream dataset " << dataset_name << " detector " << detector_num << " is already open.\n";
+        return true;
+    }
 
     std::string str_detector_num = std::to_string(detector_num);
-    std::string full_save_path = dataset_directory+ DIR_END_CHAR+"img.dat"+ DIR_END_CHAR +dataset_name+".h5"+str_detector_num;
-    //io::file::HDF5_IO::inst()->set_filename(full_save_path);
+    std::string full_save_path = dataset_directory + "img.dat" + DIR_END_CHAR + dataset_name + ".h5" + str_detector_num;
 
+    Stream_HDF5_Struct stream;
+    hid_t maps_grp_id, spec_grp_id;
+    // rows are appended as they are saved, height is only used as a chunk hint for the scalers
+    hsize_t dims_out[3] = { spectra_size, 0, width };
+    hsize_t chunk_dims[3] = { spectra_size, 1, width };
+    hsize_t dims_time_out[2] = { 0, width };
+    hsize_t chunk_dims_times[2] = { 1, width };
 
-    return false;
+    stream.width = width;
+    stream.spectra_size = spectra_size;
+    stream.rows_saved = 0;
+
+    logI << "Creating file " << full_save_path << " rows: " << height << " cols: " << width << "\n";
+    stream.file_id = H5Fcreate(full_save_path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (stream.file_id < 0)
+    {
+        logE << "creating file " << full_save_path << "\n";
+        return false;
+    }
+    stream.close_map.push({ stream.file_id, H5O_FILE });
+
+    maps_grp_id = H5Gcreate(stream.file_id, STR_MAPS.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (maps_grp_id < 0)
+    {
+        logE << "creating group " << STR_MAPS << "\n";
+        _close_h5_objects(stream.close_map);
+        return false;
+    }
+    stream.close_map.push({ maps_grp_id, H5O_GROUP });
+
+    spec_grp_id = H5Gcreate(maps_grp_id, STR_SPECTRA.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (spec_grp_id < 0)
+    {
+        logE << "creating group " << STR_SPECTRA << "\n";
+        _close_h5_objects(stream.close_map);
+        return false;
+    }
+    stream.close_map.push({ spec_grp_id, H5O_GROUP });
+
+    if (false == _create_stream_dataset(&stream, "mca_arr", data_type, spec_grp_id, 3, dims_out, chunk_dims, stream.mca_dset_id)
+        || false == _create_stream_dataset(&stream, STR_ELAPSED_REAL_TIME, data_type, spec_grp_id, 2, dims_time_out, chunk_dims_times, stream.ert_dset_id)
+        || false == _create_stream_dataset(&stream, STR_ELAPSED_LIVE_TIME, data_type, spec_grp_id, 2, dims_time_out, chunk_dims_times, stream.elt_dset_id)
+        || false == _create_stream_dataset(&stream, STR_INPUT_COUNTS, data_type, spec_grp_id, 2, dims_time_out, chunk_dims_times, stream.incnt_dset_id)
+        || false == _create_stream_dataset(&stream, STR_OUTPUT_COUNTS, data_type, spec_grp_id, 2, dims_time_out, chunk_dims_times, stream.outcnt_dset_id))
+    {
+        _close_h5_objects(stream.close_map);
+        return false;
+    }
+
+    H5Fflush(stream.file_id, H5F_SCOPE_LOCAL);
+
+    _stream_datasets[d_hash].emplace(detector_num, stream);
+
+    return true;
 }
 
+//-----------------------------------------------------------------------------
+
+Stream_HDF5_Struct* HDF5_IO::_get_stream_dataset(size_t d_hash, size_t detector_num)
+{
+    auto itr = _stream_datasets.find(d_hash);
+    if (itr == _stream_datasets.end())
+    {
+        return nullptr;
+    }
+    auto det_itr = itr->second.find(detector_num);
+    if (det_itr == itr->second.end())
+    {
+        return nullptr;
+    }
+    return &(det_itr->second);
+}
+
+//-----------------------------------------------------------------------------
+
+bool HDF5_IO::_create_stream_dataset(Stream_HDF5_Struct* stream, const std::string& name, hid_t data_type, hid_t parent_id, int rank, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id)
+{
+    hsize_t* max_dims;
+    switch (rank)
+    {
+    case 1:
+        max_dims = &max_dims_1d[0];
+        break;
+    case 2:
+        max_dims = &max_dims_2d[0];
+        break;
+    case 3:
+        max_dims = &max_dims_3d[0];
+        break;
+    default:
+        return false;
+    }
+
+    hid_t dataspace_id = H5Screate_simple(rank, dims, max_dims);
+    hid_t dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl_id, rank, chunk_dims);
+    _set_dcpl_compression(dcpl_id, name);
+
+    out_id = H5Dcreate(parent_id, name.c_str(), data_type, dataspace_id, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+    H5Pclose(dcpl_id);
+    H5Sclose(dataspace_id);
+    if (out_id < 0)
+    {
+        logE << "creating dataset " << name << "\n";
+        return false;
+    }
+    stream->close_map.push({ out_id, H5O_DATASET });
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HDF5_IO::_create_stream_fit_dataset(Stream_HDF5_Struct* stream, const std::string& fit_name, const std::vector<std::string>& channel_names, hid_t data_type)
+{
+    hid_t maps_grp_id, xrf_grp_id, fit_grp_id, dset_id, dset_ch_id, dset_un_id;
+    hid_t filetype, memtype;
+    herr_t status;
+    hsize_t dims_out[3] = { channel_names.size(), 0, stream->width };
+    hsize_t chunk_dims[3] = { 1, 1, stream->width };
+    hsize_t count[1] = { channel_names.size() };
+    std::string units = "cts/s";
+
+    maps_grp_id = H5Gopen(stream->file_id, STR_MAPS.c_str(), H5P_DEFAULT);
+    if (maps_grp_id < 0)
+    {
+        logE << "opening group " << STR_MAPS << "\n";
+        return false;
+    }
+    stream->close_map.push({ maps_grp_id, H5O_GROUP });
+
+    xrf_grp_id = H5Gopen(maps_grp_id, STR_XRF_ANALYZED.c_str(), H5P_DEFAULT);
+    if (xrf_grp_id < 0)
+    {
+        xrf_grp_id = H5Gcreate(maps_grp_id, STR_XRF_ANALYZED.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    }
+    if (xrf_grp_id < 0)
+    {
+        logE << "creating group " << STR_XRF_ANALYZED << "\n";
+        return false;
+    }
+    stream->close_map.push({ xrf_grp_id, H5O_GROUP });
+
+    fit_grp_id = H5Gcreate(xrf_grp_id, fit_name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (fit_grp_id < 0)
+    {
+        logE << "creating group " << fit_name << "\n";
+        return false;
+    }
+    stream->close_map.push({ fit_grp_id, H5O_GROUP });
+
+    if (false == _create_stream_dataset(stream, STR_COUNTS_PER_SEC, data_type, fit_grp_id, 3, dims_out, chunk_dims, dset_id))
+    {
+        return false;
+    }
+
+    // channel names and units never change while streaming so write them once
+    filetype = H5Tcopy(H5T_C_S1);
+    H5Tset_size(filetype, 256);
+    memtype = H5Tcopy(H5T_C_S1);
+    H5Tset_size(memtype, 256);
+
+    hid_t dataspace_ch_id = H5Screate_simple(1, count, nullptr);
+    dset_ch_id = H5Dcreate(fit_grp_id, STR_CHANNEL_NAMES.c_str(), filetype, dataspace_ch_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    dset_un_id = H5Dcreate(fit_grp_id, STR_CHANNEL_UNITS.c_str(), filetype, dataspace_ch_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+
+    std::vector<char> names_buf(channel_names.size() * 256, '\0');
+    std::vector<char> units_buf(channel_names.size() * 256, '\0');
+    for (size_t i = 0; i < channel_names.size(); i++)
+    {
+        channel_names[i].copy(&names_buf[i * 256], 255);
+        if (channel_names[i] != STR_NUM_ITR && channel_names[i] != STR_RESIDUAL)
+        {
+            units.copy(&units_buf[i * 256], 255);
+        }
+    }
+
+    if (dset_ch_id > -1)
+    {
+        status = H5Dwrite(dset_ch_id, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, (void*)names_buf.data());
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << fit_name << "/" << STR_CHANNEL_NAMES << "\n";
+        }
+        H5Dclose(dset_ch_id);
+    }
+    if (dset_un_id > -1)
+    {
+        status = H5Dwrite(dset_un_id, memtype, H5S_ALL, H5S_ALL, H5P_DEFAULT, (void*)units_buf.data());
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << fit_name << "/" << STR_CHANNEL_UNITS << "\n";
+        }
+        H5Dclose(dset_un_id);
+    }
+    H5Sclose(dataspace_ch_id);
+    H5Tclose(memtype);
+    H5Tclose(filetype);
+
+    stream->fit_dset_ids[fit_name] = dset_id;
+    stream->fit_channel_names[fit_name] = channel_names;
+
+    return true;
+}
 
 //-----------------------------------------------------------------------------
 
 bool HDF5_IO::close_dataset(size_t d_hash)
 {
-    return false;
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto itr = _stream_datasets.find(d_hash);
+    if (itr == _stream_datasets.end())
+    {
+        return false;
+    }
+    for (auto& det_itr : itr->second)
+    {
+        H5Fflush(det_itr.second.file_id, H5F_SCOPE_LOCAL);
+        _close_h5_objects(det_itr.second.close_map);
+    }
+    _stream_datasets.erase(itr);
+    return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2330,7 +2910,7 @@ void HDF5_IO::add_v9_layout(std::string dataset_file)
     _close_h5_objects(_global_close_map);
 
     _cur_file_id = file_id;
-    end_save_seq();
+    _end_save_seq();
     _cur_file_id = saved_file_id;
 
 }
@@ -2869,7 +3449,7 @@ void HDF5_IO::add_exchange_layout(std::string dataset_file)
     _close_h5_objects(_global_close_map);
 
     _cur_file_id = file_id;
-    end_save_seq();
+    _end_save_seq();
     logI<<"closing file"<<"\n";
 
     _cur_file_id = saved_file_id;
@@ -51,9 +51,14 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <list>
+#include <algorithm>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <future>
+#include <thread>
+#include <functional>
+#include <condition_variable>
 #include <map>
 #include <stack>
 #include <type_traits>
@@ -71,6 +76,21 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "data_struct/scaler_lookup.h"
 
 #include "csv_io.h"
+
+#if defined(_BUILD_WITH_ZLIB) && H5_VERSION_GE(1,10,3)
+#define H5_PRECOMPRESS_CHUNKS
+#include <zlib.h>
+#include <atomic>
+#endif
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#define H5_MMAP_READ
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace io
 {
 namespace file
@@ -80,12 +100,47 @@ namespace file
 
 #define HDF5_EXCHANGE_VERSION 1.0
 
+// number of rows saved by save_stream_row between file flushes
+#define HDF5_STREAM_FLUSH_ROWS 10
+
+// max write jobs queued for the async save thread before async_save blocks
+#define HDF5_ASYNC_MAX_JOBS 16
+
+// target size of a mca_arr chunk, kept under the default 1MB chunk cache so per pixel reads stay cached
+#define HDF5_SPECTRA_CHUNK_BYTES (512 * 1024)
+
+// max bytes of compressed chunks held in memory before they are handed to hdf5
+#define HDF5_PRECOMPRESS_BATCH_BYTES (64 * 1024 * 1024)
+
+// emd spectrum stream: events read per block and frame aligned segments of a block histogrammed in parallel
+#define HDF5_EMD_READ_BLOCK (4 * 1024 * 1024)
+#define HDF5_EMD_SEGMENTS 64
+#define HDF5_EMD_FRAME_DELIM 65535
+
+// registered hdf5 plugin filter id's, loaded from HDF5_PLUGIN_PATH when available
+#define H5Z_FILTER_BLOSC_ID 32001
+#define H5Z_FILTER_LZ4_ID 32004
+#define H5Z_FILTER_ZSTD_ID 32015
+
 enum H5_OBJECTS{H5O_FILE, H5O_GROUP, H5O_DATASPACE, H5O_DATASET, H5O_ATTRIBUTE, H5O_PROPERTY};
 
 enum H5_SPECTRA_LAYOUTS {MAPS_RAW, MAPS_V9, MAPS_V10, XSPRESS, APS_SEC20};
 
 enum GSE_CARS_SAVE_VER {UNKNOWN, XRFMAP, XRMMAP};
 
+enum H5_COMPRESSION_FILTER {H5_COMP_NONE, H5_COMP_DEFLATE, H5_COMP_LZ4, H5_COMP_ZSTD, H5_COMP_BLOSC};
+
+struct H5_Compression
+{
+    H5_Compression() : filter(H5_COMP_DEFLATE), level(7), shuffle(false) {}
+    H5_COMPRESSION_FILTER filter;
+    unsigned int level;
+    bool shuffle;
+};
+
+// parse "none", "deflate:7", "shuffle+deflate:4", "zstd:3", "shuffle+lz4", "blosc:5"
+DLL_EXPORT bool parse_h5_compression(std::string str, H5_Compression& out_compression);
+
 using ROI_Vec = std::vector<std::pair<unsigned int, unsigned int>>;
 
 template<typename T_real>
@@ -180,6 +235,23 @@ struct Detector_HDF5_Struct
     T_real* buffer;
 };
 
+struct Stream_HDF5_Struct
+{
+    hid_t    file_id;
+    hid_t    mca_dset_id;
+    hid_t    elt_dset_id;
+    hid_t    ert_dset_id;
+    hid_t    incnt_dset_id;
+    hid_t    outcnt_dset_id;
+    size_t   width;
+    size_t   spectra_size;
+    size_t   rows_saved;
+    // by fit routine name
+    std::map<std::string, hid_t> fit_dset_ids;
+    std::map<std::string, std::vector<std::string> > fit_channel_names;
+    std::stack<std::pair<hid_t, H5_OBJECTS> > close_map;
+};
+
 class DLL_EXPORT HDF5_IO
 {
 public:
@@ -203,7 +275,7 @@ public:
 
         logI << path << " detector : " << detector_num << "\n";
 
-        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, memoryspace_meta_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
+        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
         hid_t    dataspace_lt_id, dataspace_rt_id, dataspace_inct_id, dataspace_outct_id;
         herr_t   error;
         std::string detector_path;
@@ -309,15 +381,14 @@ public:
 
         memoryspace_id = H5Screate_simple(2, count_row, nullptr);
         close_map.push({ memoryspace_id, H5O_DATASPACE });
-        memoryspace_meta_id = H5Screate_simple(1, count_meta, nullptr);
-        close_map.push({ memoryspace_meta_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset_row, nullptr, count_row, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
 
-        T_real live_time = 1.0;
-        T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
+        // read the whole row of each meta dataset at once
+        std::vector<T_real> live_time_row;
+        std::vector<T_real> real_time_row;
+        std::vector<T_real> in_cnt_row;
+        std::vector<T_real> out_cnt_row;
+        count_meta[2] = spec_vol->cols();
 
         offset_meta[0] = detector_num;
         for (size_t row = 0; row < spec_vol->rows(); row++)
@@ -330,26 +401,19 @@ public:
 
             if (error > -1)
             {
+                _read_h5d_block<T_real>(dset_lt_id, dataspace_lt_id, 3, offset_meta, count_meta, live_time_row);
+                _read_h5d_block<T_real>(dset_rt_id, dataspace_rt_id, 3, offset_meta, count_meta, real_time_row);
+                _read_h5d_block<T_real>(dset_incnt_id, dataspace_inct_id, 3, offset_meta, count_meta, in_cnt_row);
+                _read_h5d_block<T_real>(dset_outcnt_id, dataspace_outct_id, 3, offset_meta, count_meta, out_cnt_row);
+
                 for (size_t col = 0; col < spec_vol->cols(); col++)
                 {
-                    offset_meta[2] = col;
                     data_struct::Spectra<T_real>* spectra = &((*spec_vol)[row][col]);
 
-                    H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, &live_time);
-                    spectra->elapsed_livetime(live_time);
-
-                    H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_rt_id, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, &real_time);
-                    spectra->elapsed_realtime(real_time);
-
-                    H5Sselect_hyperslab(dataspace_inct_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_incnt_id, memoryspace_meta_id, dataspace_inct_id, H5P_DEFAULT, &in_cnt);
-                    spectra->input_counts(in_cnt);
-
-                    H5Sselect_hyperslab(dataspace_outct_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_outcnt_id, memoryspace_meta_id, dataspace_outct_id, H5P_DEFAULT, &out_cnt);
-                    spectra->output_counts(out_cnt);
+                    spectra->elapsed_livetime(live_time_row[col]);
+                    spectra->elapsed_realtime(real_time_row[col]);
+                    spectra->input_counts(in_cnt_row[col]);
+                    spectra->output_counts(out_cnt_row[col]);
 
                     spectra->recalc_elapsed_livetime();
 
@@ -398,7 +462,7 @@ public:
 
         std::stack<std::pair<hid_t, H5_OBJECTS> > close_map;
 
-        hid_t    file_id, maps_grp_id, memoryspace_id, memoryspace_meta_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
+        hid_t    file_id, maps_grp_id, memoryspace_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
         hid_t    dataspace_lt_id, dataspace_rt_id, dataspace_inct_id, dataspace_outct_id;
         herr_t   error = -1;
         std::string detector_path;
@@ -505,14 +569,23 @@ public:
         count[1] = 1; //1 row
 
         memoryspace_id = H5Screate_simple(2, count_row, nullptr);
-        memoryspace_meta_id = H5Screate_simple(1, count_meta, nullptr);
+        close_map.push({ memoryspace_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset_row, nullptr, count_row, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
 
-        T_real live_time = 1.0;
-        T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
+        // read the whole row of each meta dataset at once, for all detectors: [detector][col]
+        std::vector<T_real> live_time_row;
+        std::vector<T_real> real_time_row;
+        std::vector<T_real> in_cnt_row;
+        std::vector<T_real> out_cnt_row;
+        size_t max_detector_num = 0;
+        for (size_t detector_num : detector_num_arr)
+        {
+            max_detector_num = std::max(max_detector_num, detector_num);
+        }
+        count_meta[0] = max_detector_num + 1;
+        count_meta[2] = count_row[1];
+        offset_meta[0] = 0;
+        offset_meta[2] = 0;
 
         for (size_t row = 0; row < dims_in[1]; row++)
         {
@@ -527,30 +600,22 @@ public:
 
             if (error > -1)
             {
+                _read_h5d_block<T_real>(dset_lt_id, dataspace_lt_id, 3, offset_meta, count_meta, live_time_row);
+                _read_h5d_block<T_real>(dset_rt_id, dataspace_rt_id, 3, offset_meta, count_meta, real_time_row);
+                _read_h5d_block<T_real>(dset_incnt_id, dataspace_inct_id, 3, offset_meta, count_meta, in_cnt_row);
+                _read_h5d_block<T_real>(dset_outcnt_id, dataspace_outct_id, 3, offset_meta, count_meta, out_cnt_row);
+
                 for (size_t col = 0; col < count_row[1]; col++)
                 {
-                    offset_meta[2] = col;
-
                     for (size_t detector_num : detector_num_arr)
                     {
-                        offset_meta[0] = detector_num;
+                        size_t meta_idx = (detector_num * count_meta[2]) + col;
                         data_struct::Spectra<T_real>* spectra = new data_struct::Spectra<T_real>(dims_in[0]);
 
-                        H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, &live_time);
-                        spectra->elapsed_livetime(live_time);
-
-                        H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_rt_id, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, &real_time);
-                        spectra->elapsed_realtime(real_time);
-
-                        H5Sselect_hyperslab(dataspace_inct_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_incnt_id, memoryspace_meta_id, dataspace_inct_id, H5P_DEFAULT, &in_cnt);
-                        spectra->input_counts(in_cnt);
-
-                        H5Sselect_hyperslab(dataspace_outct_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_outcnt_id, memoryspace_meta_id, dataspace_outct_id, H5P_DEFAULT, &out_cnt);
-                        spectra->output_counts(out_cnt);
+                        spectra->elapsed_livetime(live_time_row[meta_idx]);
+                        spectra->elapsed_realtime(real_time_row[meta_idx]);
+                        spectra->input_counts(in_cnt_row[meta_idx]);
+                        spectra->output_counts(out_cnt_row[meta_idx]);
 
                         for (size_t s = 0; s < count_row[0]; s++)
                         {
@@ -917,7 +982,7 @@ public:
 
         logI << path << " frames : " << frame_num << "\n";
 
-        hid_t    file_id, maps_grp_id, memoryspace_id, spectra_grp_id, dataset_id, acqui_id, frame_id, meta_id;
+        hid_t    file_id, maps_grp_id, spectra_grp_id, dataset_id, acqui_id, frame_id, meta_id;
         hid_t    image_grp_id, image_hash_grp_id, image_id, image_ds_id;
         hid_t    dataspace_id, dataspace_acqui_id, dataspace_frame_id, dataspace_meta_id;
         herr_t   error;
@@ -1026,156 +1091,158 @@ public:
 
         spec_vol->resize_and_zero(height, width, samples);
 
-        hsize_t rank;
-        rank = H5Sget_simple_extent_ndims(dataspace_id);
-        unsigned short* buffer;
-        hsize_t* dims_in = new hsize_t[rank];
-        hsize_t* offset = new hsize_t[rank];
-        hsize_t* count = new hsize_t[rank];
-        hsize_t* chunk_dims = new hsize_t[rank];
-        int status_n = H5Sget_simple_extent_dims(dataspace_id, &dims_in[0], nullptr);
-        if (status_n < 0)
+        int rank = H5Sget_simple_extent_ndims(dataspace_id);
+        if (rank < 1)
         {
             _close_h5_objects(close_map);
-            logE << "Getting dataset rank for MAPS_RAW/" << detector_path << "\n";
+            logE << "Getting dataset rank for SpectrumStream/" << str_grp_name << "/Data\n";
             return false;
         }
+        std::vector<hsize_t> dims_in(rank);
+        std::vector<hsize_t> chunk_dims(rank);
+        H5Sget_simple_extent_dims(dataspace_id, dims_in.data(), nullptr);
 
-        for (hsize_t i = 0; i < rank; i++)
+        // read whole hdf5 chunks, enough of them to keep the histogram threads busy
+        size_t block_size = HDF5_EMD_READ_BLOCK;
+        hid_t dcpl_id = H5Dget_create_plist(dataset_id);
+        close_map.push({ dcpl_id, H5O_PROPERTY });
+        if (H5Pget_chunk(dcpl_id, rank, chunk_dims.data()) > 0 && chunk_dims[0] > 0)
         {
-            offset[i] = 0;
-            count[i] = dims_in[i];
+            block_size = ((HDF5_EMD_READ_BLOCK + chunk_dims[0] - 1) / chunk_dims[0]) * chunk_dims[0];
         }
 
-        hid_t dcpl_id = H5Dget_create_plist(dataset_id);
-        error = H5Pget_chunk(dcpl_id, rank, chunk_dims);
-        buffer = new unsigned short[chunk_dims[0]];
-
-        if (start_offset > count[0])
+        if (start_offset > dims_in[0])
         {
-            logW << "frame start offset: " << start_offset << " > dataset count: " << count[0] << ". Setting start offset = 0\n.";
+            logW << "frame start offset: " << start_offset << " > dataset count: " << dims_in[0] << ". Setting start offset = 0\n.";
             start_offset = 0;
         }
 
-        memoryspace_id = H5Screate_simple(2, chunk_dims, nullptr);
-        close_map.push({ memoryspace_id, H5O_DATASPACE });
-        H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset, nullptr, chunk_dims, nullptr);
-
-        size_t read_leftover = (count[0] - start_offset) % chunk_dims[0];
-        size_t read_amt = (count[0] - start_offset) / chunk_dims[0];
+        auto read_block = [dataset_id, dataspace_id, &dims_in](hsize_t block_offset, size_t block_len, unsigned short* buffer) -> bool
+        {
+            std::vector<hsize_t> offset(dims_in.size(), 0);
+            std::vector<hsize_t> count(dims_in);
+            offset[0] = block_offset;
+            count[0] = block_len;
+            hid_t memoryspace_id = H5Screate_simple((int)count.size(), count.data(), nullptr);
+            H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset.data(), nullptr, count.data(), nullptr);
+            herr_t err = H5Dread(dataset_id, H5T_NATIVE_USHORT, memoryspace_id, dataspace_id, H5P_DEFAULT, buffer);
+            H5Sclose(memoryspace_id);
+            return err > -1;
+        };
 
-        int row = 0;
-        int col = 0;
+        const size_t num_pixels = (size_t)height * (size_t)width;
+        // frames (pixels) completed so far, the events before the next delimiter belong to this pixel
+        size_t frame = 0;
 
-        offset[0] = start_offset; // start of frame offset
-        T_real incnt = 0.0;
-        T_real outcnt = 0.0;
-        T_real elt = 1.0; // TODO: read from metadata
-        data_struct::Spectra<T_real>* spectra = &((*spec_vol)[row][col]);
-        for (size_t i = 0; i < read_amt; i++)
+        // histogram a block of the event stream. Segment starts are moved past the next delimiter so every
+        // frame is summed by one segment, the delimiters before a segment give the pixel it starts on.
+        auto histogram_block = [&](const unsigned short* buffer, size_t block_len)
         {
+            std::vector<size_t> seg_start(HDF5_EMD_SEGMENTS + 1, block_len);
+            std::vector<size_t> seg_frame(HDF5_EMD_SEGMENTS + 1, 0);
+            seg_start[0] = 0;
+            for (size_t s = 1; s < HDF5_EMD_SEGMENTS; s++)
+            {
+                size_t pos = std::max(seg_start[s - 1], (s * block_len) / HDF5_EMD_SEGMENTS);
+                while (pos < block_len && buffer[pos] != HDF5_EMD_FRAME_DELIM)
+                {
+                    pos++;
+                }
+                seg_start[s] = std::min(pos + 1, block_len);
+            }
 
-            H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, chunk_dims, nullptr);
-            error = H5Dread(dataset_id, H5T_NATIVE_USHORT, memoryspace_id, dataspace_id, H5P_DEFAULT, buffer);
-            offset[0] += chunk_dims[0];
+#pragma omp parallel for schedule(static)
+            for (int s = 0; s < HDF5_EMD_SEGMENTS; s++)
+            {
+                seg_frame[s + 1] = std::count(buffer + seg_start[s], buffer + seg_start[s + 1], (unsigned short)HDF5_EMD_FRAME_DELIM);
+            }
+            seg_frame[0] = frame;
+            for (size_t s = 1; s <= HDF5_EMD_SEGMENTS; s++)
+            {
+                seg_frame[s] += seg_frame[s - 1];
+            }
 
-            if (error > -1)
+#pragma omp parallel for schedule(dynamic)
+            for (int s = 0; s < HDF5_EMD_SEGMENTS; s++)
             {
-                for (hsize_t j = 0; j < chunk_dims[0]; j++)
+                size_t pixel = seg_frame[s];
+                if (pixel >= num_pixels)
                 {
-                    //check for delim to move to new spectra
-                    if (buffer[j] == 65535)
+                    continue;
+                }
+                data_struct::Spectra<T_real>* spectra = &((*spec_vol)[pixel / width][pixel % width]);
+                for (size_t j = seg_start[s]; j < seg_start[s + 1]; j++)
+                {
+                    const unsigned short val = buffer[j];
+                    if (val == HDF5_EMD_FRAME_DELIM)
                     {
-                        col++;
-                        if (col >= width)
-                        {
-                            col = 0;
-                            row++;
-                            logI << "Reading row " << row << " of " << height << "\n";
-                        }
-                        if (row >= height)
+                        pixel++;
+                        if (pixel >= num_pixels)
                         {
-                            delete[] dims_in;
-                            delete[] offset;
-                            delete[] count;
-                            delete[] chunk_dims;
-                            delete[] buffer;
-
-                            _close_h5_objects(close_map);
-
-                            end = std::chrono::system_clock::now();
-                            std::chrono::duration<double> elapsed_seconds = end - start;
-                            //std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-
-                            logI << "elapsed time: " << elapsed_seconds.count() << "s" << "\n";
-
-                            return true;
+                            break;
                         }
-                        spectra->input_counts(incnt);
-                        spectra->output_counts(outcnt);
-                        spectra->elapsed_livetime(elt);
-                        incnt = 0.0;
-                        outcnt = 0.0;
-                        spectra = &((*spec_vol)[row][col]);
+                        spectra = &((*spec_vol)[pixel / width][pixel % width]);
                     }
-                    else
+                    else if (val < samples)
                     {
-                        (*spectra)[buffer[j]] += 1.0;
-                        incnt += 1.0;
-                        outcnt += 1.0;
+                        (*spectra)[val] += 1.0;
                     }
                 }
             }
-            else
+            frame = seg_frame[HDF5_EMD_SEGMENTS];
+        };
+
+        // double buffered, the next block is read while this one is histogrammed
+        size_t cur = 0;
+        hsize_t block_offset = start_offset;
+        size_t block_len = std::min((hsize_t)block_size, dims_in[0] - block_offset);
+        std::unique_ptr<unsigned short[]> buffers[2] = { std::unique_ptr<unsigned short[]>(new unsigned short[block_len + 1]),
+                                                         std::unique_ptr<unsigned short[]>(new unsigned short[block_len + 1]) };
+        bool block_read = (block_len > 0) ? read_block(block_offset, block_len, buffers[cur].get()) : false;
+        size_t logged_row = 0;
+        while (block_len > 0 && frame < num_pixels)
+        {
+            hsize_t next_offset = block_offset + block_len;
+            size_t next_len = std::min((hsize_t)block_size, dims_in[0] - next_offset);
+            std::future<bool> next_read;
+            if (next_len > 0)
             {
-                logE << "reading chunk " << i << " of " << read_amt << "\n";
+                next_read = std::async(std::launch::async, read_block, next_offset, next_len, buffers[1 - cur].get());
             }
 
-        }
-
-        chunk_dims[0] = read_leftover;
-        H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, chunk_dims, nullptr);
-        //offset[0] = 0;
-        //H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset, nullptr, chunk_dims, nullptr);
-        error = H5Dread(dataset_id, H5T_NATIVE_USHORT, memoryspace_id, dataspace_id, H5P_DEFAULT, buffer);
-        if (error > -1)
-        {
-            for (hsize_t j = 0; j < read_leftover; j++)
+            if (block_read)
             {
-                //check for delim to move to new spectra
-                if (buffer[j] == 65535)
-                {
-                    col++;
-                    if (col >= width)
-                    {
-                        col = 0;
-                        row++;
-                        logI << "Reading row " << row << " of " << height << "\n";
-                    }
-                    if (row >= height)
-                    {
-                        col = 0;
-                        row = 0;
-                    }
-                    spectra = &((*spec_vol)[row][col]);
-                }
-                else
-                {
-                    (*spectra)[buffer[j]] += 1.0;
-                }
+                histogram_block(buffers[cur].get(), block_len);
+            }
+            else
+            {
+                logE << "reading events " << block_offset << " to " << block_offset + block_len << "\n";
             }
+            if (frame / width > logged_row)
+            {
+                logged_row = std::min(frame / width, (size_t)height);
+                logI << "Reading row " << logged_row << " of " << height << "\n";
+            }
+
+            block_read = (next_len > 0) ? next_read.get() : false;
+            block_offset = next_offset;
+            block_len = next_len;
+            cur = 1 - cur;
         }
-        else
+
+        // every event of a pixel is one count, livetime is not in the stream
+        T_real elt = 1.0; // TODO: read from metadata
+        size_t completed = std::min(frame, num_pixels);
+#pragma omp parallel for schedule(static)
+        for (long long p = 0; p < (long long)completed; p++)
         {
-            logE << "reading last chunk \n";
+            data_struct::Spectra<T_real>& spectra = (*spec_vol)[p / width][p % width];
+            T_real cnt = spectra.sum();
+            spectra.input_counts(cnt);
+            spectra.output_counts(cnt);
+            spectra.elapsed_livetime(elt);
         }
 
-        delete[] dims_in;
-        delete[] offset;
-        delete[] count;
-        delete[] chunk_dims;
-        delete[] buffer;
-
         _close_h5_objects(close_map);
 
         end = std::chrono::system_clock::now();
@@ -1201,7 +1268,7 @@ public:
         logI << path << " detector : " << detector_num << "\n";
 
         std::stack<std::pair<hid_t, H5_OBJECTS> > close_map;
-        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, scaler_grp_id, memoryspace_id, memoryspace_meta_id, dset_lt_id;
+        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, scaler_grp_id, memoryspace_id, dset_lt_id;
         //hid_t    dset_incnt_id, dset_outcnt_id, dset_rt_id;
         hid_t    dataspace_lt_id;
         //hid_t dataspace_inct_id, dataspace_outct_id;
@@ -1276,12 +1343,9 @@ public:
 
         memoryspace_id = H5Screate_simple(3, count_row, nullptr);
         close_map.push({ memoryspace_id, H5O_DATASPACE });
-        memoryspace_meta_id = H5Screate_simple(1, count_meta, nullptr);
-        close_map.push({ memoryspace_meta_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset_row, nullptr, count_row, nullptr);
-        //H5Sselect_hyperslab (memoryspace_meta_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
 
-        T_real live_time = 1.0;
+        std::vector<T_real> live_time_row;
         //T_real real_time = 1.0;
         //T_real in_cnt = 1.0;
         //T_real out_cnt = 1.0;
@@ -1296,15 +1360,14 @@ public:
 
         if (error > -1)
         {
+            count_meta[0] = dims_in[0];
+            _read_h5d_block<T_real>(dset_lt_id, dataspace_lt_id, 1, offset_meta, count_meta, live_time_row);
 
             for (size_t col = 0; col < dims_in[0]; col++)
             {
-                offset_meta[0] = col;
                 data_struct::Spectra<T_real>* spectra = &((*spec_row)[col]);
 
-                H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                error = _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, &live_time);
-                spectra->elapsed_livetime(live_time * 0.000000125);
+                spectra->elapsed_livetime(live_time_row[col] * 0.000000125);
 
                 //H5Sselect_hyperslab (dataspace_rt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
                 //error = H5Dread(dset_rt_id, H5T_NATIVE_REAL, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, &real_time);
@@ -1371,7 +1434,7 @@ public:
                 logI << path << " detector : " << detector_num << "\n";
             }
         }
-        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, memoryspace_meta_id, dset_detectors_id, memoryspace_id2;
+        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, dset_detectors_id;
         //hid_t    dset_xpos_id, dset_ypos_id, dataspace_xpos_id, dataspace_ypos_id;
         hid_t    dataspace_detectors_id;
         hid_t    attr_detector_names_id, attr_timebase_id;
@@ -1586,19 +1649,50 @@ public:
         memoryspace_id = H5Screate_simple(2, count_row, nullptr);
         close_map.push({ memoryspace_id, H5O_DATASPACE });
 
-        memoryspace_id2 = H5Screate_simple(2, count2, nullptr);
-        close_map.push({ memoryspace_id2, H5O_DATASPACE });
-
-        memoryspace_meta_id = H5Screate_simple(1, count_meta, nullptr);
-        close_map.push({ memoryspace_meta_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset_row, nullptr, count_row, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-
-        T_real live_time = 1.0;
-        //T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
 
+        // meta data is read a row at a time, 2020 version has a [row][col] dataset per scaler, older has [row][col][scaler]
+        hid_t elt_space_id = -1;
+        hid_t incnt_space_id = -1;
+        hid_t outcnt_space_id = -1;
+        if (elt_id > -1)
+        {
+            elt_space_id = H5Dget_space(elt_id);
+            close_map.push({ elt_space_id, H5O_DATASPACE });
+        }
+        if (incnt_id > -1)
+        {
+            incnt_space_id = H5Dget_space(incnt_id);
+            close_map.push({ incnt_space_id, H5O_DATASPACE });
+        }
+        if (outcnt_id > -1)
+        {
+            outcnt_space_id = H5Dget_space(outcnt_id);
+            close_map.push({ outcnt_space_id, H5O_DATASPACE });
+        }
+        std::vector<T_real> live_time_row;
+        std::vector<T_real> in_cnt_row;
+        std::vector<T_real> out_cnt_row;
+        std::vector<T_real> detectors_row;
+        herr_t elt_error = -1;
+        herr_t incnt_error = -1;
+        herr_t outcnt_error = -1;
+        size_t num_scalers = 1;
+        if (false == confocal_ver_2020)
+        {
+            hsize_t det_dims_in[3] = { 0,0,0 };
+            if (H5Sget_simple_extent_dims(dataspace_detectors_id, &det_dims_in[0], nullptr) == 3)
+            {
+                num_scalers = det_dims_in[2];
+            }
+            count_meta[1] = dims_in[1];
+            count_meta[2] = num_scalers;
+        }
+        offset2[1] = 0;
+        count2[1] = dims_in[1];
+        const size_t elt_idx = detector_lookup[elt_str];
+        const size_t incnt_idx = detector_lookup[incnt_str];
+        const size_t outcnt_idx = detector_lookup[outcnt_str];
 
         for (size_t row = 0; row < dims_in[0]; row++)
         {
@@ -1610,55 +1704,53 @@ public:
 
             if (error > -1)
             {
-                for (size_t col = 0; col < dims_in[1]; col++)
+                offset2[0] = row;
+                if (confocal_ver_2020)
                 {
-                    offset_meta[1] = col;
+                    if (elt_id > -1)
+                    {
+                        elt_error = _read_h5d_block<T_real>(elt_id, elt_space_id, 2, offset2, count2, live_time_row);
+                    }
+                    if (incnt_id > -1)
+                    {
+                        incnt_error = _read_h5d_block<T_real>(incnt_id, incnt_space_id, 2, offset2, count2, in_cnt_row);
+                    }
+                    if (outcnt_id > -1)
+                    {
+                        outcnt_error = _read_h5d_block<T_real>(outcnt_id, outcnt_space_id, 2, offset2, count2, out_cnt_row);
+                    }
+                }
+                else
+                {
+                    _read_h5d_block<T_real>(dset_detectors_id, dataspace_detectors_id, 3, offset_meta, count_meta, detectors_row);
+                }
 
+                for (size_t col = 0; col < dims_in[1]; col++)
+                {
                     data_struct::Spectra<T_real>* spectra = &((*spec_vol)[row][col]);
 
-
-
                     if (confocal_ver_2020)
                     {
-                        offset2[0] = row;
-                        offset2[1] = col;
-                        H5Sselect_hyperslab(memoryspace_id2, H5S_SELECT_SET, offset2, nullptr, count2, nullptr);
-                        if (elt_id > -1)
+                        if (elt_error > -1)
                         {
-                            error = _read_h5d<T_real>(elt_id, memoryspace_id2, memoryspace_id2, H5P_DEFAULT, &live_time);
-                            el_time = live_time / time_base;
+                            el_time = live_time_row[col] / time_base;
                             spectra->elapsed_livetime(el_time);
                         }
-                        if (incnt_id > -1)
+                        if (incnt_error > -1)
                         {
-                            error = _read_h5d<T_real>(incnt_id, memoryspace_id2, memoryspace_id2, H5P_DEFAULT, &in_cnt);
-                            in_cnt *= 1000.0;
-                            spectra->input_counts(in_cnt);
+                            spectra->input_counts(in_cnt_row[col] * 1000.0);
                         }
-                        if (outcnt_id > -1)
+                        if (outcnt_error > -1)
                         {
-                            error = _read_h5d<T_real>(outcnt_id, memoryspace_id2, memoryspace_id2, H5P_DEFAULT, &out_cnt);
-                            out_cnt *= 1000.0;
-                            spectra->output_counts(out_cnt);
+                            spectra->output_counts(out_cnt_row[col] * 1000.0);
                         }
                     }
                     else
                     {
-                        offset_meta[2] = detector_lookup[elt_str];
-                        H5Sselect_hyperslab(dataspace_detectors_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_detectors_id, memoryspace_meta_id, dataspace_detectors_id, H5P_DEFAULT, &live_time);
-                        el_time = live_time / time_base;
+                        el_time = detectors_row[(col * num_scalers) + elt_idx] / time_base;
                         spectra->elapsed_livetime(el_time);
-
-                        offset_meta[2] = detector_lookup[incnt_str];
-                        H5Sselect_hyperslab(dataspace_detectors_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_detectors_id, memoryspace_meta_id, dataspace_detectors_id, H5P_DEFAULT, &in_cnt);
-                        spectra->input_counts(in_cnt * 1000.0);
-
-                        offset_meta[2] = detector_lookup[outcnt_str];
-                        H5Sselect_hyperslab(dataspace_detectors_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                        error = _read_h5d<T_real>(dset_detectors_id, memoryspace_meta_id, dataspace_detectors_id, H5P_DEFAULT, &out_cnt);
-                        spectra->output_counts(out_cnt * 1000.0);
+                        spectra->input_counts(detectors_row[(col * num_scalers) + incnt_idx] * 1000.0);
+                        spectra->output_counts(detectors_row[(col * num_scalers) + outcnt_idx] * 1000.0);
                     }
 
                     for (size_t s = 0; s < dims_in[2]; s++)
@@ -1704,7 +1796,7 @@ public:
         {
             logI << path << " detector : " << detector_num << "\n";
         }
-        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, memoryspace_meta_id, dset_detectors_id;
+        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id;
         hid_t    dset_xypos_id, dataspace_xypos_id;
         hid_t	 livetime_id, realtime_id, inpcounts_id, outcounts_id;
         hid_t    livetime_dataspace_id, realtime_dataspace_id, inpcounts_dataspace_id, outcounts_dataspace_id;
@@ -1888,16 +1980,14 @@ public:
 
         memoryspace_id = H5Screate_simple(2, count_row, nullptr);
         close_map.push({ memoryspace_id, H5O_DATASPACE });
-        memoryspace_meta_id = H5Screate_simple(1, count_meta, nullptr);
-        close_map.push({ memoryspace_meta_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset_row, nullptr, count_row, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-
-        T_real live_time = 1.0;
-        T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
 
+        // read the whole row of each meta dataset at once
+        std::vector<T_real> live_time_row;
+        std::vector<T_real> real_time_row;
+        std::vector<T_real> in_cnt_row;
+        std::vector<T_real> out_cnt_row;
+        count_meta[1] = dims_in[1];
 
         for (size_t row = 0; row < dims_in[0]; row++)
         {
@@ -1909,36 +1999,30 @@ public:
 
             if (error > -1) //no error
             {
+                herr_t rt_error = _read_h5d_block<T_real>(realtime_id, realtime_dataspace_id, 2, offset_meta, count_meta, real_time_row);
+                herr_t lt_error = _read_h5d_block<T_real>(livetime_id, livetime_dataspace_id, 2, offset_meta, count_meta, live_time_row);
+                herr_t incnt_error = _read_h5d_block<T_real>(inpcounts_id, inpcounts_dataspace_id, 2, offset_meta, count_meta, in_cnt_row);
+                herr_t outcnt_error = _read_h5d_block<T_real>(outcounts_id, outcounts_dataspace_id, 2, offset_meta, count_meta, out_cnt_row);
+
                 for (size_t col = 0; col < dims_in[1]; col++)
                 {
-                    offset_meta[1] = col;
-
                     data_struct::Spectra<T_real>* spectra = &((*spec_vol)[row][col]);
 
-                    H5Sselect_hyperslab(livetime_dataspace_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    H5Sselect_hyperslab(realtime_dataspace_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    H5Sselect_hyperslab(inpcounts_dataspace_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    H5Sselect_hyperslab(outcounts_dataspace_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-
-                    error = _read_h5d<T_real>(realtime_id, memoryspace_meta_id, realtime_dataspace_id, H5P_DEFAULT, &real_time);
-                    if (error > -1)
+                    if (rt_error > -1)
                     {
-                        spectra->elapsed_realtime(real_time);
+                        spectra->elapsed_realtime(real_time_row[col]);
                     }
-                    error = _read_h5d<T_real>(livetime_id, memoryspace_meta_id, livetime_dataspace_id, H5P_DEFAULT, &live_time);
-                    if (error > -1)
+                    if (lt_error > -1)
                     {
-                        spectra->elapsed_livetime(live_time);
+                        spectra->elapsed_livetime(live_time_row[col]);
                     }
-                    error = _read_h5d<T_real>(inpcounts_id, memoryspace_meta_id, inpcounts_dataspace_id, H5P_DEFAULT, &in_cnt);
-                    if (error > -1)
+                    if (incnt_error > -1)
                     {
-                        spectra->input_counts(in_cnt);
+                        spectra->input_counts(in_cnt_row[col]);
                     }
-                    error = _read_h5d<T_real>(outcounts_id, memoryspace_meta_id, outcounts_dataspace_id, H5P_DEFAULT, &out_cnt);
-                    if (error > -1)
+                    if (outcnt_error > -1)
                     {
-                        spectra->output_counts(out_cnt);
+                        spectra->output_counts(out_cnt_row[col]);
                     }
 
                     //spectra->recalc_elapsed_livetime();
@@ -2460,7 +2544,7 @@ public:
 
         logI << path << " detector : " << detector_num << "\n";
 
-        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, memoryspace_meta_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
+        hid_t    file_id, dset_id, dataspace_id, maps_grp_id, memoryspace_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
         hid_t    dataspace_lt_id, dataspace_rt_id, dataspace_inct_id, dataspace_outct_id;
         herr_t   error;
         std::string detector_path;
@@ -2562,14 +2646,15 @@ public:
         }
 
         memoryspace_id = H5Screate_simple(2, count_row, nullptr);
-        memoryspace_meta_id = H5Screate_simple(1, count_meta, nullptr);
+        close_map.push({ memoryspace_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset_row, nullptr, count_row, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
 
-        T_real live_time = 1.0;
-        T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
+        // meta data is [detector][row][col], read a whole row per dataset
+        std::vector<T_real> live_time_row;
+        std::vector<T_real> real_time_row;
+        std::vector<T_real> in_cnt_row;
+        std::vector<T_real> out_cnt_row;
+        count_meta[2] = count_row[1];
 
         T_real live_time_total = 0.0;
         T_real real_time_total = 0.0;
@@ -2587,25 +2672,17 @@ public:
 
             if (error > -1)
             {
+                _read_h5d_block<T_real>(dset_lt_id, dataspace_lt_id, 3, offset_meta, count_meta, live_time_row);
+                _read_h5d_block<T_real>(dset_rt_id, dataspace_rt_id, 3, offset_meta, count_meta, real_time_row);
+                _read_h5d_block<T_real>(dset_incnt_id, dataspace_inct_id, 3, offset_meta, count_meta, in_cnt_row);
+                _read_h5d_block<T_real>(dset_outcnt_id, dataspace_outct_id, 3, offset_meta, count_meta, out_cnt_row);
+
                 for (size_t col = 0; col < count_row[1]; col++)
                 {
-                    offset_meta[2] = col;
-
-                    H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, &live_time);
-                    live_time_total += live_time;
-
-                    H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_rt_id, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, &real_time);
-                    real_time_total += real_time;
-
-                    H5Sselect_hyperslab(dataspace_inct_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_incnt_id, memoryspace_meta_id, dataspace_inct_id, H5P_DEFAULT, &in_cnt);
-                    in_cnt_total += in_cnt;
-
-                    H5Sselect_hyperslab(dataspace_outct_id, H5S_SELECT_SET, offset_meta, nullptr, count_meta, nullptr);
-                    error = _read_h5d<T_real>(dset_outcnt_id, memoryspace_meta_id, dataspace_outct_id, H5P_DEFAULT, &out_cnt);
-                    out_cnt_total += out_cnt;
+                    live_time_total += live_time_row[col];
+                    real_time_total += real_time_row[col];
+                    in_cnt_total += in_cnt_row[col];
+                    out_cnt_total += out_cnt_row[col];
 
                     for (size_t s = 0; s < count_row[0]; s++)
                     {
@@ -2662,7 +2739,7 @@ public:
 
         logI << path << "\n";
 
-        hid_t    file_id, dset_id, dataspace_id, spec_grp_id, memoryspace_id, memoryspace_meta_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
+        hid_t    file_id, dset_id, dataspace_id, spec_grp_id, memoryspace_id, dset_incnt_id, dset_outcnt_id, dset_rt_id, dset_lt_id;
         hid_t    dataspace_lt_id, dataspace_rt_id, dataspace_inct_id, dataspace_outct_id;
         herr_t   error;
         hsize_t dims_in[3] = { 0,0,0 };
@@ -2745,49 +2822,49 @@ public:
         count[2] = 1;
 
         memoryspace_id = H5Screate_simple(3, count, nullptr);
-        memoryspace_meta_id = H5Screate_simple(2, count_time, nullptr);
+        close_map.push({ memoryspace_id, H5O_DATASPACE });
         H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
 
-        T_real live_time = 1.0;
-        T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
+        bool read_contiguous = _read_contiguous_spectra_volume(path, file_id, dset_id, dims_in, spectra_volume, row_idx_start, row_idx_end, col_idx_start, col_idx_end);
 
-        //offset[1] = row;
+        // read the requested column range of each meta dataset once per row
+        std::vector<T_real> live_time_row;
+        std::vector<T_real> real_time_row;
+        std::vector<T_real> in_cnt_row;
+        std::vector<T_real> out_cnt_row;
+        offset_time[1] = col_idx_start;
+        count_time[1] = col_idx_end - col_idx_start;
 
         for (size_t row = (size_t)row_idx_start; row < (size_t)row_idx_end; row++)
         {
             offset[1] = row;
             offset_time[0] = row;
+
+            _read_h5d_block<T_real>(dset_rt_id, dataspace_rt_id, 2, offset_time, count_time, real_time_row);
+            _read_h5d_block<T_real>(dset_lt_id, dataspace_lt_id, 2, offset_time, count_time, live_time_row);
+            _read_h5d_block<T_real>(dset_incnt_id, dataspace_inct_id, 2, offset_time, count_time, in_cnt_row);
+            _read_h5d_block<T_real>(dset_outcnt_id, dataspace_outct_id, 2, offset_time, count_time, out_cnt_row);
+
             for (size_t col = (size_t)col_idx_start; col < (size_t)col_idx_end; col++)
             {
                 data_struct::Spectra<T_real>* spectra = &((*spectra_volume)[row][col]);
-                offset[2] = col;
-                offset_time[1] = col;
-                H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-
-                //error = H5Dread (dset_id, H5T_NATIVE_REAL, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&(*spectra)[0]);
-                error = _read_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)spectra->data());
-                if (error > 0)
+                size_t meta_idx = col - col_idx_start;
+                if (false == read_contiguous)
                 {
-                    logW << "Counld not read row " << row << " col " << col << "\n";
-                }
-
-                H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-                H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-                H5Sselect_hyperslab(dataspace_inct_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-                H5Sselect_hyperslab(dataspace_outct_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-
-                error = _read_h5d<T_real>(dset_rt_id, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, (void*)&real_time);
-                error = _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, (void*)&live_time);
-                error = _read_h5d<T_real>(dset_incnt_id, memoryspace_meta_id, dataspace_inct_id, H5P_DEFAULT, (void*)&in_cnt);
-                error = _read_h5d<T_real>(dset_outcnt_id, memoryspace_meta_id, dataspace_outct_id, H5P_DEFAULT, (void*)&out_cnt);
+                    offset[2] = col;
+                    H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+                    //error = H5Dread (dset_id, H5T_NATIVE_REAL, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&(*spectra)[0]);
+                    error = _read_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)spectra->data());
+                    if (error > 0)
+                    {
+                        logW << "Counld not read row " << row << " col " << col << "\n";
+                    }
+                }
 
-                spectra->elapsed_livetime(live_time);
-                spectra->elapsed_realtime(real_time);
-                spectra->input_counts(in_cnt);
-                spectra->output_counts(out_cnt);
+                spectra->elapsed_livetime(live_time_row[meta_idx]);
+                spectra->elapsed_realtime(real_time_row[meta_idx]);
+                spectra->input_counts(in_cnt_row[meta_idx]);
+                spectra->output_counts(out_cnt_row[meta_idx]);
             }
         }
 
@@ -2827,6 +2904,24 @@ public:
 
     template<typename T_real>
     bool load_integrated_spectra_analyzed_h5_roi(std::string path, data_struct::Spectra<T_real>* int_spectra, ROI_Vec& roi)
+    {
+        std::map<int, ROI_Vec> rois;
+        std::map<int, data_struct::Spectra<T_real>> int_spectras;
+        rois[0] = roi;
+        if (false == load_integrated_spectra_analyzed_h5_rois(path, rois, &int_spectras))
+        {
+            return false;
+        }
+        *int_spectra = int_spectras[0];
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------
+
+    // Integrates every roi of a .roi file in one pass over mca_arr. A label image maps each pixel to the
+    // rois it belongs to and only rows that have roi pixels are read.
+    template<typename T_real>
+    bool load_integrated_spectra_analyzed_h5_rois(std::string path, std::map<int, ROI_Vec>& rois, std::map<int, data_struct::Spectra<T_real>>* int_spectras)
     {
         std::lock_guard<std::mutex> lock(_mutex);
 
@@ -2839,13 +2934,12 @@ public:
 
         logI << path << "\n";
 
-        hid_t    file_id, dset_id, dataspace_id, spec_grp_id, memoryspace_id, memoryspace_meta_id, dset_incnt_id, dset_outcnt_id;
-        hid_t   memoryspace_1;
-        hid_t    dset_rt_id, dset_lt_id, dset_scalers, dset_scaler_names;
-        hid_t    dataspace_lt_id, dataspace_rt_id, dataspace_inct_id, dataspace_outct_id, dataspace_scalers, dataspace_scaler_names;
+        hid_t    file_id, dset_id, dataspace_id, spec_grp_id, dset_incnt_id = -1, dset_outcnt_id = -1;
+        hid_t   memoryspace_1 = -1;
+        hid_t    dset_rt_id = -1, dset_lt_id = -1, dset_scalers = -1, dset_scaler_names = -1;
+        hid_t    dataspace_lt_id = -1, dataspace_rt_id = -1, dataspace_inct_id = -1, dataspace_outct_id = -1, dataspace_scalers = -1, dataspace_scaler_names = -1;
         herr_t   error;
         hsize_t dims_in[3] = { 0,0,0 };
-        hsize_t offset[3] = { 0,0,0 };
         hsize_t count[3] = { 1,1,1 };
         hsize_t offset_time[2] = { 0,0 };
         hsize_t count_time[2] = { 1,1 };
@@ -2895,6 +2989,7 @@ public:
             unsigned int status_n = H5Sget_simple_extent_dims(dataspace_scaler_names, &dims_out[0], nullptr);
             char tmp_name[256] = { 0 };
             memoryspace_1 = H5Screate_simple(1, count, nullptr);
+            close_map.push({ memoryspace_1, H5O_DATASPACE });
             for (hsize_t idx = 0; idx < dims_out[0]; idx++)
             {
                 offset_1[0] = idx;
@@ -2964,106 +3059,124 @@ public:
             return false;
         }
 
-        for (int i = 0; i < rank; i++)
-        {
 
-            offset[i] = 0;
-            count[i] = dims_in[i];
+        // roi pixels are scattered so read the full meta maps once instead of one value per pixel
+        std::vector<T_real> live_time_map;
+        std::vector<T_real> real_time_map;
+        std::vector<T_real> in_cnt_map;
+        std::vector<T_real> out_cnt_map;
+        if (is_v9)
+        {
+            hsize_t offset_scaler[3] = { 0, 0, 0 };
+            hsize_t count_scaler[3] = { 1, dims_in[1], dims_in[2] };
+            offset_scaler[0] = elt_off;
+            _read_h5d_block<T_real>(dset_scalers, dataspace_scalers, 3, offset_scaler, count_scaler, live_time_map);
+            offset_scaler[0] = ert_off;
+            _read_h5d_block<T_real>(dset_scalers, dataspace_scalers, 3, offset_scaler, count_scaler, real_time_map);
+            offset_scaler[0] = in_off;
+            _read_h5d_block<T_real>(dset_scalers, dataspace_scalers, 3, offset_scaler, count_scaler, in_cnt_map);
+            offset_scaler[0] = out_off;
+            _read_h5d_block<T_real>(dset_scalers, dataspace_scalers, 3, offset_scaler, count_scaler, out_cnt_map);
         }
-
-
-        int_spectra->resize(dims_in[0]);
-        int_spectra->setZero(dims_in[0]);
-
-        count[0] = dims_in[0];
-        count[1] = 1;
-        count[2] = 1;
-
-        memoryspace_id = H5Screate_simple(3, count, nullptr);
-        memoryspace_meta_id = H5Screate_simple(2, count_time, nullptr);
-        H5Sselect_hyperslab(memoryspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-        H5Sselect_hyperslab(memoryspace_meta_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-
-        T_real live_time = 1.0;
-        T_real real_time = 1.0;
-        T_real in_cnt = 1.0;
-        T_real out_cnt = 1.0;
-
-
-        for (auto& itr : roi)
+        else
         {
-            hsize_t xoffset = itr.first;
-            hsize_t yoffset = itr.second;
-            
-            offset[0] = 0;
-            offset[1] = yoffset;
-            offset_time[0] = yoffset;
-            offset[2] = xoffset;
-            offset_time[1] = xoffset;
-
-            count[0] = dims_in[0];
+            count_time[0] = dims_in[1];
+            count_time[1] = dims_in[2];
+            _read_h5d_block<T_real>(dset_rt_id, dataspace_rt_id, 2, offset_time, count_time, real_time_map);
+            _read_h5d_block<T_real>(dset_lt_id, dataspace_lt_id, 2, offset_time, count_time, live_time_map);
+            _read_h5d_block<T_real>(dset_incnt_id, dataspace_inct_id, 2, offset_time, count_time, in_cnt_map);
+            _read_h5d_block<T_real>(dset_outcnt_id, dataspace_outct_id, 2, offset_time, count_time, out_cnt_map);
+        }
 
-            H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+        size_t height = dims_in[1];
+        size_t width = dims_in[2];
 
-            data_struct::Spectra<T_real> spectra;
-            spectra.resize(dims_in[0]);
+        // each labeled pixel points at the list of rois it is in, so overlapping rois still get every pixel
+        std::vector<int> label_img(height * width, -1);
+        std::vector<std::vector<int>> label_sets;
+        std::map<std::vector<int>, int> label_set_idx;
+        std::vector<bool> row_has_roi(height, false);
+        for (auto& roi_itr : rois)
+        {
+            data_struct::Spectra<T_real>& int_spectra = (*int_spectras)[roi_itr.first];
+            int_spectra.resize(dims_in[0]);
+            int_spectra.setZero(dims_in[0]);
 
-            error = _read_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)spectra.data());
-            if (error > 0)
+            for (auto& itr : roi_itr.second)
             {
-                logW << "Counld not read row " << yoffset << " col " << xoffset << "\n";
+                hsize_t xoffset = itr.first;
+                hsize_t yoffset = itr.second;
+                if (yoffset >= height || xoffset >= width)
+                {
+                    logW << "Roi " << roi_itr.first << " row " << yoffset << " col " << xoffset << " is outside of the dataset\n";
+                    continue;
+                }
+                size_t meta_idx = (yoffset * width) + xoffset;
+                std::vector<int> label_set;
+                if (label_img[meta_idx] > -1)
+                {
+                    label_set = label_sets[label_img[meta_idx]];
+                }
+                label_set.push_back(roi_itr.first);
+                auto set_itr = label_set_idx.find(label_set);
+                if (set_itr == label_set_idx.end())
+                {
+                    label_img[meta_idx] = (int)label_sets.size();
+                    label_set_idx[label_set] = (int)label_sets.size();
+                    label_sets.push_back(label_set);
+                }
+                else
+                {
+                    label_img[meta_idx] = set_itr->second;
+                }
+                row_has_roi[yoffset] = true;
             }
+        }
 
-            if (is_v9)
+        hsize_t offset_row[3] = { 0, 0, 0 };
+        hsize_t count_row[3] = { dims_in[0], 1, width };
+        std::vector<T_real> row_buffer;
+        data_struct::Spectra<T_real> spectra(dims_in[0]);
+        for (size_t row = 0; row < height; row++)
+        {
+            if (false == row_has_roi[row])
             {
-                count[0] = 1;
-
-                offset[0] = elt_off;
-                H5Sselect_hyperslab(dataspace_scalers, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-                error = _read_h5d<T_real>(dset_scalers, memoryspace_meta_id, dataspace_scalers, H5P_DEFAULT, (void*)&live_time);
-                if (error > 0)
-                    live_time = 0;
-
-                offset[0] = ert_off;
-                H5Sselect_hyperslab(dataspace_scalers, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-                error = _read_h5d<T_real>(dset_scalers, memoryspace_meta_id, dataspace_scalers, H5P_DEFAULT, (void*)&real_time);
-                if (error > 0)
-                    real_time = 0;
-
-                offset[0] = in_off;
-                H5Sselect_hyperslab(dataspace_scalers, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-                error = _read_h5d<T_real>(dset_scalers, memoryspace_meta_id, dataspace_scalers, H5P_DEFAULT, (void*)&in_cnt);
-                if (error > 0)
-                    in_cnt = 0;
-
-                offset[0] = out_off;
-                H5Sselect_hyperslab(dataspace_scalers, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-                error = _read_h5d<T_real>(dset_scalers, memoryspace_meta_id, dataspace_scalers, H5P_DEFAULT, (void*)&out_cnt);
-                if (error > 0)
-                    out_cnt = 0;
+                continue;
             }
-            else
+            offset_row[1] = row;
+            if (_read_h5d_block<T_real>(dset_id, dataspace_id, 3, offset_row, count_row, row_buffer, (T_real)0.0) < 0)
             {
-                H5Sselect_hyperslab(dataspace_lt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-                H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-                H5Sselect_hyperslab(dataspace_inct_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-                H5Sselect_hyperslab(dataspace_outct_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
-
-                error = _read_h5d<T_real>(dset_rt_id, memoryspace_meta_id, dataspace_rt_id, H5P_DEFAULT, (void*)&real_time);
-                error = _read_h5d<T_real>(dset_lt_id, memoryspace_meta_id, dataspace_lt_id, H5P_DEFAULT, (void*)&live_time);
-                error = _read_h5d<T_real>(dset_incnt_id, memoryspace_meta_id, dataspace_inct_id, H5P_DEFAULT, (void*)&in_cnt);
-                error = _read_h5d<T_real>(dset_outcnt_id, memoryspace_meta_id, dataspace_outct_id, H5P_DEFAULT, (void*)&out_cnt);
+                logW << "Counld not read row " << row << "\n";
+                continue;
             }
 
-            spectra.elapsed_livetime(live_time);
-            spectra.elapsed_realtime(real_time);
-            spectra.input_counts(in_cnt);
-            spectra.output_counts(out_cnt);
+            for (size_t col = 0; col < width; col++)
+            {
+                size_t meta_idx = (row * width) + col;
+                if (label_img[meta_idx] < 0)
+                {
+                    continue;
+                }
+                for (hsize_t ch = 0; ch < dims_in[0]; ch++)
+                {
+                    spectra(ch) = row_buffer[(ch * width) + col];
+                }
+                spectra.elapsed_livetime(live_time_map[meta_idx]);
+                spectra.elapsed_realtime(real_time_map[meta_idx]);
+                spectra.input_counts(in_cnt_map[meta_idx]);
+                spectra.output_counts(out_cnt_map[meta_idx]);
 
-            int_spectra->add(spectra);
+                for (int roi_id : label_sets[label_img[meta_idx]])
+                {
+                    (*int_spectras)[roi_id].add(spectra);
+                }
+            }
         }
 
-        int_spectra->recalc_elapsed_livetime();
+        for (auto& itr : *int_spectras)
+        {
+            itr.second.recalc_elapsed_livetime();
+        }
 
         _close_h5_objects(close_map);
 
@@ -3456,11 +3569,25 @@ public:
 
     bool generate_avg(std::string avg_filename, std::vector<std::string> files_to_avg);
 
+    template<typename T_real>
     bool generate_stream_dataset(std::string dataset_directory,
                                  std::string dataset_name,
+                                 size_t d_hash,
                                  int detector_num,
                                  size_t height,
-                                 size_t width);
+                                 size_t width,
+                                 size_t spectra_size)
+    {
+        if (std::is_same<T_real, float>::value)
+        {
+            return _generate_stream_dataset(dataset_directory, dataset_name, d_hash, detector_num, height, width, spectra_size, H5T_INTEL_F32);
+        }
+        else if (std::is_same<T_real, double>::value)
+        {
+            return _generate_stream_dataset(dataset_directory, dataset_name, d_hash, detector_num, height, width, spectra_size, H5T_INTEL_F64);
+        }
+        return false;
+    }
 
     //-----------------------------------------------------------------------------
 
@@ -4050,17 +4177,217 @@ public:
     //-----------------------------------------------------------------------------
 
     template<typename T_real>
-    bool save_stream_row(size_t d_hash, size_t detector_num, size_t row, std::vector< data_struct::Spectra<T_real>* >  *spectra_row)
+    bool save_stream_row(size_t d_hash,
+                         size_t detector_num,
+                         size_t row,
+                         std::vector< data_struct::Spectra<T_real>* >  *spectra_row,
+                         const std::unordered_map<std::string, data_struct::Fit_Count_Dict<T_real> >* fit_counts_row = nullptr)
     {
-        return false;
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Stream_HDF5_Struct* stream = _get_stream_dataset(d_hash, detector_num);
+        if (stream == nullptr)
+        {
+            logE << "Stream dataset was never generated. Call generate_stream_dataset() before this function." << "\n";
+            return false;
+        }
+        if (spectra_row == nullptr)
+        {
+            return false;
+        }
+
+        herr_t status = 0;
+        hid_t memoryspace_id, dataspace_id;
+        size_t width = stream->width;
+        size_t rows = std::max(stream->rows_saved, row + 1);
+        hsize_t dims_out[3] = { stream->spectra_size, rows, width };
+        hsize_t offset[3] = { 0, row, 0 };
+        hsize_t count[3] = { stream->spectra_size, 1, width };
+        hsize_t dims_time_out[2] = { rows, width };
+        hsize_t offset_time[2] = { row, 0 };
+        hsize_t count_time[2] = { 1, width };
+
+        // transpose the row into the [samples][rows][cols] layout of mca_arr, missing pixels are left as zeros
+        std::vector<T_real> buffer(stream->spectra_size * width, (T_real)0.0);
+        std::vector<T_real> real_time(width, (T_real)0.0);
+        std::vector<T_real> live_time(width, (T_real)0.0);
+        std::vector<T_real> in_cnt(width, (T_real)0.0);
+        std::vector<T_real> out_cnt(width, (T_real)0.0);
+        for (size_t col = 0; col < width && col < spectra_row->size(); col++)
+        {
+            const data_struct::Spectra<T_real>* spectra = (*spectra_row)[col];
+            if (spectra == nullptr)
+            {
+                continue;
+            }
+            size_t samples = std::min((size_t)spectra->size(), stream->spectra_size);
+            for (size_t s = 0; s < samples; s++)
+            {
+                buffer[(s * width) + col] = (*spectra)[s];
+            }
+            real_time[col] = spectra->elapsed_realtime();
+            live_time[col] = spectra->elapsed_livetime();
+            in_cnt[col] = spectra->input_counts();
+            out_cnt[col] = spectra->output_counts();
+        }
+
+        if (rows > stream->rows_saved)
+        {
+            H5Dset_extent(stream->mca_dset_id, dims_out);
+            H5Dset_extent(stream->ert_dset_id, dims_time_out);
+            H5Dset_extent(stream->elt_dset_id, dims_time_out);
+            H5Dset_extent(stream->incnt_dset_id, dims_time_out);
+            H5Dset_extent(stream->outcnt_dset_id, dims_time_out);
+        }
+
+        memoryspace_id = H5Screate_simple(3, count, nullptr);
+        dataspace_id = H5Dget_space(stream->mca_dset_id);
+        H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+        status = _write_h5d<T_real>(stream->mca_dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)buffer.data());
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write spectra row " << row << "\n";
+        }
+        H5Sclose(dataspace_id);
+        H5Sclose(memoryspace_id);
+
+        memoryspace_id = H5Screate_simple(2, count_time, nullptr);
+        _write_stream_row<T_real>(stream->ert_dset_id, memoryspace_id, offset_time, count_time, real_time.data(), STR_ELAPSED_REAL_TIME);
+        _write_stream_row<T_real>(stream->elt_dset_id, memoryspace_id, offset_time, count_time, live_time.data(), STR_ELAPSED_LIVE_TIME);
+        _write_stream_row<T_real>(stream->incnt_dset_id, memoryspace_id, offset_time, count_time, in_cnt.data(), STR_INPUT_COUNTS);
+        _write_stream_row<T_real>(stream->outcnt_dset_id, memoryspace_id, offset_time, count_time, out_cnt.data(), STR_OUTPUT_COUNTS);
+        H5Sclose(memoryspace_id);
+
+        if (fit_counts_row != nullptr)
+        {
+            hsize_t count_fit[3] = { 1, 1, width };
+            memoryspace_id = H5Screate_simple(3, count_fit, nullptr);
+            for (const auto& itr : *fit_counts_row)
+            {
+                if (stream->fit_dset_ids.count(itr.first) < 1)
+                {
+                    if (false == _create_stream_fit_dataset<T_real>(stream, itr.first, itr.second))
+                    {
+                        continue;
+                    }
+                }
+                hid_t fit_dset_id = stream->fit_dset_ids.at(itr.first);
+                const std::vector<std::string>& channel_names = stream->fit_channel_names.at(itr.first);
+                hsize_t dims_fit_out[3] = { channel_names.size(), rows, width };
+                hsize_t offset_fit[3] = { 0, row, 0 };
+                H5Dset_extent(fit_dset_id, dims_fit_out);
+                dataspace_id = H5Dget_space(fit_dset_id);
+                for (size_t i = 0; i < channel_names.size(); i++)
+                {
+                    const auto& el_itr = itr.second.find(channel_names[i]);
+                    if (el_itr == itr.second.end() || (size_t)el_itr->second.size() < width)
+                    {
+                        continue;
+                    }
+                    offset_fit[0] = i;
+                    H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset_fit, nullptr, count_fit, nullptr);
+                    status = _write_h5d<T_real>(fit_dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)el_itr->second.data());
+                    if (status < 0)
+                    {
+                        logE << " H5Dwrite failed to write " << itr.first << " " << channel_names[i] << " row " << row << "\n";
+                    }
+                }
+                H5Sclose(dataspace_id);
+            }
+            H5Sclose(memoryspace_id);
+        }
+
+        stream->rows_saved = rows;
+        // flush periodically so a partially processed scan can be read while we are still streaming
+        if (stream->rows_saved % HDF5_STREAM_FLUSH_ROWS == 0)
+        {
+            H5Fflush(stream->file_id, H5F_SCOPE_LOCAL);
+        }
+
+        return true;
     }
 
     //-----------------------------------------------------------------------------
 
     template<typename T_real>
-    bool save_itegrade_spectra(data_struct::Spectra<T_real> * spectra)
+    bool save_itegrade_spectra(size_t d_hash, size_t detector_num, data_struct::Spectra<T_real> * spectra)
     {
-        return false;
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Stream_HDF5_Struct* stream = _get_stream_dataset(d_hash, detector_num);
+        if (stream == nullptr)
+        {
+            logE << "Stream dataset was never generated. Call generate_stream_dataset() before this function." << "\n";
+            return false;
+        }
+        if (spectra == nullptr || spectra->size() < 1)
+        {
+            return false;
+        }
+
+        hid_t maps_grp_id, spec_grp_id, int_spec_grp_id, dset_id, dataspace_id, memoryspace_id;
+        herr_t status = 0;
+        hsize_t count[1] = { (hsize_t)spectra->size() };
+
+        if (false == _open_or_create_group(STR_MAPS, stream->file_id, maps_grp_id))
+        {
+            return false;
+        }
+        if (false == _open_or_create_group(STR_SPECTRA, maps_grp_id, spec_grp_id))
+        {
+            return false;
+        }
+        if (false == _open_or_create_group(STR_INT_SPEC, spec_grp_id, int_spec_grp_id))
+        {
+            return false;
+        }
+
+        _create_memory_space(1, count, memoryspace_id);
+        if (false == _open_h5_dataset<T_real>(STR_SPECTRA, int_spec_grp_id, 1, count, count, dset_id, dataspace_id))
+        {
+            return false;
+        }
+        status = _write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&(*spectra)[0]);
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << STR_INT_SPEC << "/" << STR_SPECTRA << "\n";
+        }
+
+        count[0] = 1;
+        _create_memory_space(1, count, memoryspace_id);
+        const std::vector<std::pair<std::string, T_real> > save_vals = { {STR_ELAPSED_REAL_TIME, spectra->elapsed_realtime()},
+                                                                          {STR_ELAPSED_LIVE_TIME, spectra->elapsed_livetime()},
+                                                                          {STR_INPUT_COUNTS, spectra->input_counts()},
+                                                                          {STR_OUTPUT_COUNTS, spectra->output_counts()} };
+        for (const auto& itr : save_vals)
+        {
+            if (false == _open_h5_dataset<T_real>(itr.first, int_spec_grp_id, 1, count, count, dset_id, dataspace_id))
+            {
+                return false;
+            }
+            status = _write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&itr.second);
+            if (status < 0)
+            {
+                logE << " H5Dwrite failed to write " << STR_INT_SPEC << "/" << itr.first << "\n";
+            }
+        }
+
+        //save file version
+        T_real save_val = HDF5_SAVE_VERSION;
+        if (false == _open_h5_dataset<T_real>(STR_VERSION, maps_grp_id, 1, count, count, dset_id, dataspace_id))
+        {
+            return false;
+        }
+        status = _write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&save_val);
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << STR_MAPS << "/" << STR_VERSION << "\n";
+        }
+        _close_h5_objects(_global_close_map);
+
+        H5Fflush(stream->file_id, H5F_SCOPE_LOCAL);
+
+        return true;
     }
 
     //-----------------------------------------------------------------------------
@@ -4069,9 +4396,48 @@ public:
 
     bool start_save_seq(const std::string filename, bool force_new_file=false, bool open_file_only=false);
 
-    bool start_save_seq(bool force_new_file=false){ return start_save_seq(_cur_filename, force_new_file, false);}
+    bool start_save_seq(bool force_new_file=false);
+
+    void set_filename(std::string fname);
+
+    //-----------------------------------------------------------------------------
+
+    // Start a dedicated io thread that runs queued save jobs in order (write-behind).
+    void start_async_saves(size_t max_queued_jobs = HDF5_ASYNC_MAX_JOBS);
+
+    // Queue a save job. Blocks while the queue is full. Runs the job immediately if async saves are not started.
+    void async_save(std::function<void()> job);
+
+    // Wait until all queued save jobs are written.
+    void flush_async_saves();
+
+    // Flush and join the io thread.
+    void stop_async_saves();
+
+    // Queue closing the current file after the pending save jobs.
+    void async_end_save_seq();
+
+    // Hand obj over to the io thread, it is deleted once the save jobs queued before this call have run.
+    template<typename T>
+    void async_release(std::unique_ptr<T> obj)
+    {
+        std::shared_ptr<T> owned(std::move(obj));
+        async_save([owned]() mutable { owned.reset(); });
+    }
+
+    //-----------------------------------------------------------------------------
+
+    // Filters used for new datasets that don't have a per dataset setting
+    void set_compression(const H5_Compression& compression);
+
+    // Filters used for new datasets named dataset_name, ex: "mca_arr"
+    void set_dataset_compression(const std::string& dataset_name, const H5_Compression& compression);
+
+    // Drop the per dataset setting so dataset_name uses the default filters again
+    void clear_dataset_compression(const std::string& dataset_name);
 
-    void set_filename(std::string fname) {_cur_filename = fname;}
+    // Threads used to compress spectra volume chunks before writing them, default 1
+    void set_compress_threads(size_t num_threads) { std::lock_guard<std::mutex> lock(_mutex); _compress_threads = num_threads; }
 
     //-----------------------------------------------------------------------------
 
@@ -4131,7 +4497,8 @@ public:
         count[2] = 1;
         chunk_dims[0] = dims_out[0];
         chunk_dims[1] = 1;
-        chunk_dims[2] = 1;
+        // group neighbouring pixels of a row into one chunk, one spectrum per chunk compresses poorly
+        chunk_dims[2] = std::max((size_t)1, std::min((size_t)dims_out[2], (size_t)HDF5_SPECTRA_CHUNK_BYTES / (sizeof(T_real) * std::max((size_t)dims_out[0], (size_t)1))));
 
 
         dims_time_out[0] = spectra_volume->rows();
@@ -4161,8 +4528,9 @@ public:
             return false;
         }
 
-        // try to open mca dataset and expand before creating 
-        if (false == _open_h5_dataset<T_real>(path, spec_grp_id, 3, dims_out, chunk_dims, dset_id, dataspace_id))
+        // try to open mca dataset and expand before creating. uncompressed volumes are stored contiguous so they can be read in one pass
+        bool contiguous = (_get_compression(path).filter == H5_COMP_NONE);
+        if (false == _open_h5_dataset<T_real>(path, spec_grp_id, 3, dims_out, chunk_dims, dset_id, dataspace_id, contiguous))
         {
             logE << "Error creating " << path << "\n";
             return false;
@@ -4191,6 +4559,13 @@ public:
 
         H5Sselect_hyperslab(memoryspace_time_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
 
+        // whole volume: compress chunks on worker threads and write them directly, or write contiguous planes
+        bool volume_written = false;
+        if (row_idx_start == 0 && (size_t)row_idx_end == spectra_volume->rows() && col_idx_start == 0 && (size_t)col_idx_end == spectra_volume->cols())
+        {
+            volume_written = _write_precompressed_spectra_volume(dset_id, spectra_volume) || _write_contiguous_spectra_volume(dset_id, spectra_volume);
+        }
+
         T_real real_time;
         T_real life_time;
         T_real in_cnt;
@@ -4204,12 +4579,15 @@ public:
                 const data_struct::Spectra<T_real>* spectra = &((*spectra_volume)[row][col]);
                 offset[2] = col;
                 offset_time[1] = col;
-                H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-
-                status = _write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&(*spectra)[0]);
-                if (status < 0)
+                if (false == volume_written)
                 {
-                    logE << " H5Dwrite failed to write spectra\n";
+                    H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+
+                    status = _write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)&(*spectra)[0]);
+                    if (status < 0)
+                    {
+                        logE << " H5Dwrite failed to write spectra\n";
+                    }
                 }
 
                 H5Sselect_hyperslab(dataspace_rt_id, H5S_SELECT_SET, offset_time, nullptr, count_time, nullptr);
@@ -4421,11 +4799,31 @@ public:
     //-----------------------------------------------------------------------------
 
     template<typename T_real>
-    bool save_element_fits(const std::string path, const data_struct::Fit_Count_Dict<T_real>* const element_counts, size_t row_idx_start=0, int row_idx_end=-1, size_t col_idx_start=0, int col_idx_end=-1)
+    bool save_element_fits(const std::string path, const data_struct::Fit_Count_Dict<T_real>* const element_counts)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
+        if (element_counts == nullptr || element_counts->size() == 0)
+        {
+            return false;
+        }
+        std::vector<std::string> element_lines = data_struct::get_element_save_order(*element_counts);
+        const data_struct::ArrayXXr<T_real>& first = element_counts->begin()->second;
+        data_struct::Fit_Count_Tensor<T_real> counts(element_lines, first.rows(), first.cols());
+        for (size_t p = 0; p < element_lines.size(); p++)
+        {
+            const data_struct::ArrayXXr<T_real>& el_map = element_counts->at(element_lines[p]);
+            std::copy(el_map.data(), el_map.data() + el_map.size(), &counts.at(p, 0, 0));
+        }
+        return save_element_fits(path, &counts);
+    }
 
+    //-----------------------------------------------------------------------------
 
+    // Planes are saved in the tensor order, build it with data_struct::get_element_save_order() names.
+    // Counts, channel names and units are each written with a single H5Dwrite.
+    template<typename T_real>
+    bool save_element_fits(const std::string path, const data_struct::Fit_Count_Tensor<T_real>* const element_counts)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
 
         if (_cur_file_id < 0)
         {
@@ -4437,45 +4835,23 @@ public:
         start = std::chrono::system_clock::now();
 
         hid_t   dset_id, dset_ch_id, dset_un_id;
-        hid_t   memoryspace, dataspace_id, dataspace_ch_id, dataspace_un_id, dataspace_ch_off_id;
+        hid_t   memoryspace_id, memoryspace_ch_id, dataspace_id, dataspace_ch_id, dataspace_un_id;
         hid_t   filetype, memtype;
         herr_t  status;
-        hid_t   dcpl_id;
         hid_t   xrf_grp_id, fit_grp_id, maps_grp_id;
+        bool ret_val = true;
 
         dset_id = -1;
         dset_ch_id = -1;
+        dset_un_id = -1;
         hsize_t dims_out[3];
-        hsize_t offset[1] = { 0 };
-        hsize_t offset2[1] = { 0 };
+        dims_out[0] = element_counts->planes();
+        dims_out[1] = element_counts->rows();
+        dims_out[2] = element_counts->cols();
         hsize_t offset_3d[3] = { 0, 0, 0 };
-        hsize_t count[1] = { 1 };
-        hsize_t count_3d[3] = { 1, 1, 1 };
-        hsize_t chunk_dims[3];
-        hsize_t tmp_dims[3];
-
-        //fix this
-        for (const auto& iter : *element_counts)
-        {
-            dims_out[1] = iter.second.rows();
-            dims_out[2] = iter.second.cols();
-            break;
-        }
-        //H5T_FLOAT
-
-        dims_out[0] = element_counts->size();
-        offset_3d[0] = 0;
-        offset_3d[1] = 0;
-        offset_3d[2] = 0;
-        count_3d[0] = 1;
-        count_3d[1] = dims_out[1];
-        count_3d[2] = dims_out[2];
-        chunk_dims[0] = 1;
-        chunk_dims[1] = dims_out[1];
-        chunk_dims[2] = dims_out[2];
 
-        _create_memory_space(1, count_3d, dataspace_ch_off_id);
-        _create_memory_space(3, count_3d, memoryspace);
+        _create_memory_space(3, dims_out, memoryspace_id);
+        _create_memory_space(1, dims_out, memoryspace_ch_id);
 
         if (false == _open_or_create_group(STR_MAPS, _cur_file_id, maps_grp_id))
         {
@@ -4491,116 +4867,68 @@ public:
         {
             return false;
         }
-
-        if (false == _open_h5_dataset<T_real>(STR_COUNTS_PER_SEC, fit_grp_id, 3, dims_out, dims_out, dset_id, dataspace_id))
-        {
-            return false;
-        }
-
-        //filetype = H5Tcopy (H5T_FORTRAN_S1);
-        filetype = H5Tcopy(H5T_C_S1);
-        H5Tset_size(filetype, 256);
-        memtype = H5Tcopy(H5T_C_S1);
-        status = H5Tset_size(memtype, 255);
-
-        if (false == _open_h5_dataset(STR_CHANNEL_NAMES, filetype, fit_grp_id, 1, dims_out, dims_out, dset_ch_id, dataspace_ch_id))
-        {
-            return false;
-        }
-
-        if (false == _open_h5_dataset(STR_CHANNEL_UNITS, filetype, fit_grp_id, 1, dims_out, dims_out, dset_un_id, dataspace_un_id))
-        {
-            return false;
-        }
-
-
-        /*
-           if (row_idx_end < row_idx_start || row_idx_end > spectra_volume->rows() -1)
-            {
-                row_idx_end = spectra_volume->rows();
-            }
-            if (col_idx_end < col_idx_start || col_idx_end > spectra_volume->cols() -1)
-            {
-                col_idx_end = spectra_volume->cols();
-            }
-        */
-
-        //create save ordered vector by element Z number with K , L, M lines
-        std::vector<std::string> element_lines;
-        for (std::string el_name : data_struct::Element_Symbols)
-        {
-            element_lines.push_back(el_name);
-        }
-        for (std::string el_name : data_struct::Element_Symbols)
+
+        if (false == _open_h5_dataset<T_real>(STR_COUNTS_PER_SEC, fit_grp_id, 3, dims_out, dims_out, dset_id, dataspace_id))
         {
-            element_lines.push_back(el_name + "_L");
+            return false;
         }
-        for (std::string el_name : data_struct::Element_Symbols)
+
+        //filetype = H5Tcopy (H5T_FORTRAN_S1);
+        filetype = H5Tcopy(H5T_C_S1);
+        H5Tset_size(filetype, 256);
+        memtype = H5Tcopy(H5T_C_S1);
+        status = H5Tset_size(memtype, 256);
+
+        if (false == _open_h5_dataset(STR_CHANNEL_NAMES, filetype, fit_grp_id, 1, dims_out, dims_out, dset_ch_id, dataspace_ch_id))
         {
-            element_lines.push_back(el_name + "_M");
+            return false;
         }
 
-        //add the rest 
-        for (const auto& itr : *element_counts)
+        if (false == _open_h5_dataset(STR_CHANNEL_UNITS, filetype, fit_grp_id, 1, dims_out, dims_out, dset_un_id, dataspace_un_id))
         {
-            if (std::find(element_lines.begin(), element_lines.end(), itr.first) == element_lines.end())
-            {
-                element_lines.push_back(itr.first);
-            }
+            return false;
         }
 
-        //H5Sselect_hyperslab (memoryspace, H5S_SELECT_SET, offset_3d, nullptr, count_3d, nullptr);
-
-        int i = 0;
-        //save by element Z order
-        //for(const auto& iter : *element_counts)
+        // fixed 256 char strings, one per plane
         std::string units = "cts/s";
-        for (std::string el_name : element_lines)
+        std::vector<char> names_buf(element_counts->planes() * 256, '\0');
+        std::vector<char> units_buf(element_counts->planes() * 256, '\0');
+        for (size_t i = 0; i < element_counts->planes(); i++)
         {
-            char tmp_char[256] = { 0 };
-            if (element_counts->count(el_name) < 1)
-            {
-                continue;
-            }
-            offset[0] = i;
-            offset_3d[0] = i;
-
-            H5Sselect_hyperslab(dataspace_ch_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-            H5Sselect_hyperslab(dataspace_un_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
-            H5Sselect_hyperslab(dataspace_ch_off_id, H5S_SELECT_SET, offset2, nullptr, count, nullptr);
-
-            el_name.copy(tmp_char, 254);
-
-            status = H5Dwrite(dset_ch_id, memtype, dataspace_ch_off_id, dataspace_ch_id, H5P_DEFAULT, (void*)tmp_char);
-            if (status < 0)
-            {
-                logE << " H5Dwrite failed to write " << STR_CHANNEL_NAMES << " at row " << i << "\n";
-            }
-
-            for (int z = 0; z < 256; z++)
-            {
-                tmp_char[z] = '\0';
-            }
+            const std::string& el_name = element_counts->names()[i];
+            el_name.copy(&names_buf[i * 256], 254);
             if (el_name != STR_NUM_ITR && el_name != STR_RESIDUAL)
             {
-                units.copy(tmp_char, 256);
+                units.copy(&units_buf[i * 256], 254);
             }
-            status = H5Dwrite(dset_un_id, memtype, dataspace_ch_off_id, dataspace_un_id, H5P_DEFAULT, (void*)tmp_char);
-            if (status < 0)
-            {
-                logE << " H5Dwrite failed to write " << STR_CHANNEL_UNITS << " at row " << i << "\n";
-            }
-            H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset_3d, nullptr, chunk_dims, nullptr);
+        }
 
-            status = _write_h5d<T_real>(dset_id, memoryspace, dataspace_id, H5P_DEFAULT, (void*)element_counts->at(el_name).data());
-            if (status < 0)
-            {
-                logE << " H5Dwrite failed to write " << STR_COUNTS_PER_SEC << " at row " << i << "\n";
-            }
+        // an existing dataset smaller than the tensor fails the selection instead of being overrun
+        H5Sselect_hyperslab(dataspace_ch_id, H5S_SELECT_SET, offset_3d, nullptr, dims_out, nullptr);
+        H5Sselect_hyperslab(dataspace_un_id, H5S_SELECT_SET, offset_3d, nullptr, dims_out, nullptr);
+        H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset_3d, nullptr, dims_out, nullptr);
 
-            i++;
+        status = H5Dwrite(dset_ch_id, memtype, memoryspace_ch_id, dataspace_ch_id, H5P_DEFAULT, (void*)names_buf.data());
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << STR_CHANNEL_NAMES << "\n";
+            ret_val = false;
+        }
+        status = H5Dwrite(dset_un_id, memtype, memoryspace_ch_id, dataspace_un_id, H5P_DEFAULT, (void*)units_buf.data());
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << STR_CHANNEL_UNITS << "\n";
+            ret_val = false;
+        }
+        status = _write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)element_counts->data());
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << STR_COUNTS_PER_SEC << "\n";
+            ret_val = false;
         }
 
+        H5Tclose(filetype);
+        H5Tclose(memtype);
         _close_h5_objects(_global_close_map);
 
         end = std::chrono::system_clock::now();
@@ -4608,9 +4936,7 @@ public:
 
         logI << "elapsed time: " << elapsed_seconds.count() << "s" << "\n";
 
-
-        return true;
-
+        return ret_val;
     }
 
     //-----------------------------------------------------------------------------
@@ -6271,7 +6597,7 @@ public:
 
         hid_t saved_file_id = _cur_file_id;
         _cur_file_id = file_id;
-        end_save_seq();
+        _end_save_seq();
         logI << "closing file" << "\n";
         _cur_file_id = saved_file_id;
     }
@@ -6380,6 +6706,348 @@ private:
     //static std::mutex _mutex;
     std::mutex _mutex;
 
+    bool _end_save_seq(bool loginfo = true);
+
+    void _async_save_thread();
+
+    const H5_Compression& _get_compression(const std::string& dataset_name);
+
+    void _set_dcpl_compression(hid_t dcpl_id, const std::string& dataset_name);
+
+    //-----------------------------------------------------------------------------
+
+    // Alternate read of mca_arr when it is stored contiguous, unfiltered and in the native float type: the file is
+    // mapped read only and copied into the spectra volume in file order, instead of one hyperslab read per pixel.
+    // The spectra volume still holds its own copy, the mapping is released before returning.
+    // Returns false if the dataset can not be read this way so the caller falls back to H5Dread.
+    template<typename T_real>
+    bool _read_contiguous_spectra_volume(const std::string& path,
+                                     hid_t file_id,
+                                     hid_t dset_id,
+                                     const hsize_t* dims_in,
+                                     data_struct::Spectra_Volume<T_real>* spectra_volume,
+                                     size_t row_idx_start,
+                                     size_t row_idx_end,
+                                     size_t col_idx_start,
+                                     size_t col_idx_end)
+    {
+#ifdef H5_MMAP_READ
+        bool can_map = true;
+        hid_t dcpl_id = H5Dget_create_plist(dset_id);
+        if (H5Pget_layout(dcpl_id) != H5D_CONTIGUOUS || H5Pget_nfilters(dcpl_id) != 0)
+        {
+            can_map = false;
+        }
+        H5Pclose(dcpl_id);
+
+        hid_t native_type = std::is_same<T_real, float>::value ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE;
+        hid_t dtype_id = H5Dget_type(dset_id);
+        if (H5Tequal(dtype_id, native_type) <= 0)
+        {
+            can_map = false;
+        }
+        H5Tclose(dtype_id);
+
+        // offsets are only file offsets for the default single file driver
+        hid_t fapl_id = H5Fget_access_plist(file_id);
+        if (H5Pget_driver(fapl_id) != H5FD_SEC2)
+        {
+            can_map = false;
+        }
+        H5Pclose(fapl_id);
+
+        haddr_t data_addr = H5Dget_offset(dset_id);
+        if (false == can_map || data_addr == HADDR_UNDEF)
+        {
+            return false;
+        }
+
+        hsize_t userblock = 0;
+        hid_t fcpl_id = H5Fget_create_plist(file_id);
+        H5Pget_userblock(fcpl_id, &userblock);
+        H5Pclose(fcpl_id);
+
+        const size_t samples = dims_in[0];
+        const size_t rows = dims_in[1];
+        const size_t cols = dims_in[2];
+        const size_t plane_size = rows * cols;
+        const size_t data_size = samples * plane_size * sizeof(T_real);
+        if (row_idx_end > rows || col_idx_end > cols || samples > spectra_volume->samples_size())
+        {
+            return false;
+        }
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat file_stat;
+        off_t file_offset = (off_t)(data_addr + userblock);
+        if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < (size_t)file_offset + data_size)
+        {
+            close(fd);
+            return false;
+        }
+
+        // mmap offset has to be page aligned
+        off_t page_size = (off_t)sysconf(_SC_PAGESIZE);
+        off_t map_offset = file_offset - (file_offset % page_size);
+        size_t map_size = data_size + (size_t)(file_offset - map_offset);
+        void* map_ptr = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+        close(fd);
+        if (map_ptr == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(map_ptr, map_size, MADV_SEQUENTIAL);
+
+        const T_real* data = (const T_real*)((const char*)map_ptr + (file_offset - map_offset));
+        // mca_arr is [sample][row][col], walk the mapping in file order so pages are touched once
+        for (size_t s = 0; s < samples; s++)
+        {
+            for (size_t row = row_idx_start; row < row_idx_end; row++)
+            {
+                const T_real* src = &data[(s * plane_size) + (row * cols)];
+                for (size_t col = col_idx_start; col < col_idx_end; col++)
+                {
+                    (*spectra_volume)[row][col][s] = src[col];
+                }
+            }
+        }
+
+        munmap(map_ptr, map_size);
+        logI << "Read contiguous mca_arr through a file mapping\n";
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    //-----------------------------------------------------------------------------
+
+    // Writes the whole spectra volume to a contiguous dataset one sample plane at a time, so every H5Dwrite is
+    // a single sequential block instead of one strided write per pixel. Returns false for chunked datasets.
+    template<typename T_real>
+    bool _write_contiguous_spectra_volume(hid_t dset_id, data_struct::Spectra_Volume<T_real>* spectra_volume)
+    {
+        hid_t dcpl_id = H5Dget_create_plist(dset_id);
+        if (dcpl_id < 0)
+        {
+            return false;
+        }
+        H5D_layout_t layout = H5Pget_layout(dcpl_id);
+        H5Pclose(dcpl_id);
+
+        hsize_t dims[3] = { 0,0,0 };
+        hid_t dataspace_id = H5Dget_space(dset_id);
+        H5Sget_simple_extent_dims(dataspace_id, dims, nullptr);
+        if (layout != H5D_CONTIGUOUS || dims[0] != spectra_volume->samples_size() || dims[1] != spectra_volume->rows() || dims[2] != spectra_volume->cols())
+        {
+            H5Sclose(dataspace_id);
+            return false;
+        }
+
+        const size_t rows = dims[1];
+        const size_t cols = dims[2];
+        hsize_t offset[3] = { 0, 0, 0 };
+        hsize_t count[3] = { 1, dims[1], dims[2] };
+        hid_t memoryspace_id = H5Screate_simple(3, count, nullptr);
+        std::vector<T_real> plane(rows * cols);
+        bool ret = true;
+        for (size_t s = 0; s < dims[0] && ret; s++)
+        {
+            for (size_t row = 0; row < rows; row++)
+            {
+                for (size_t col = 0; col < cols; col++)
+                {
+                    plane[(row * cols) + col] = (*spectra_volume)[row][col][s];
+                }
+            }
+            offset[0] = s;
+            H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+            if (_write_h5d<T_real>(dset_id, memoryspace_id, dataspace_id, H5P_DEFAULT, (void*)plane.data()) < 0)
+            {
+                logE << "H5Dwrite failed to write spectra plane " << s << "\n";
+                ret = false;
+            }
+        }
+        H5Sclose(memoryspace_id);
+        H5Sclose(dataspace_id);
+        return ret;
+    }
+
+    //-----------------------------------------------------------------------------
+
+    // Writes the whole spectra volume with H5Dwrite_chunk after compressing the chunks on _compress_threads threads.
+    // Only handles deflate and shuffle+deflate pipelines. zstd, lz4 and blosc are plugin filters we don't link against,
+    // for those (and contiguous layouts) it returns false and the caller falls back to a serial H5Dwrite.
+    template<typename T_real>
+    bool _write_precompressed_spectra_volume(hid_t dset_id, data_struct::Spectra_Volume<T_real>* spectra_volume)
+    {
+#ifdef H5_PRECOMPRESS_CHUNKS
+        hsize_t dims[3] = { 0,0,0 };
+        hsize_t chunk_dims[3] = { 0,0,0 };
+        bool shuffle = false;
+        int level = -1;
+
+        hid_t dcpl_id = H5Dget_create_plist(dset_id);
+        if (dcpl_id < 0)
+        {
+            return false;
+        }
+        bool supported = (H5Pget_layout(dcpl_id) == H5D_CHUNKED && H5Pget_chunk(dcpl_id, 3, chunk_dims) == 3);
+        int nfilters = H5Pget_nfilters(dcpl_id);
+        for (int i = 0; i < nfilters && supported; i++)
+        {
+            unsigned int flags = 0;
+            size_t cd_nelmts = 1;
+            unsigned int cd_values[1] = { 0 };
+            unsigned int filter_config = 0;
+            H5Z_filter_t filter_id = H5Pget_filter2(dcpl_id, (unsigned)i, &flags, &cd_nelmts, cd_values, 0, nullptr, &filter_config);
+            if (filter_id == H5Z_FILTER_SHUFFLE && i == 0)
+            {
+                shuffle = true;
+            }
+            else if (filter_id == H5Z_FILTER_DEFLATE && i == nfilters - 1)
+            {
+                level = cd_values[0];
+            }
+            else
+            {
+                logI << "No parallel chunk compression for hdf5 filter " << filter_id << ", writing spectra volume serially\n";
+                supported = false;
+            }
+        }
+        H5Pclose(dcpl_id);
+
+        hid_t dataspace_id = H5Dget_space(dset_id);
+        H5Sget_simple_extent_dims(dataspace_id, dims, nullptr);
+        H5Sclose(dataspace_id);
+
+        // chunks are raw memory bytes, file type has to match T_real
+        hid_t type_id = H5Dget_type(dset_id);
+        supported = supported && H5Tget_class(type_id) == H5T_FLOAT && H5Tget_size(type_id) == sizeof(T_real) && H5Tget_order(type_id) == H5T_ORDER_LE;
+        H5Tclose(type_id);
+
+        if (false == supported || level < 0 || dims[0] != spectra_volume->samples_size() || dims[1] != spectra_volume->rows() || dims[2] != spectra_volume->cols() || chunk_dims[0] != dims[0] || chunk_dims[1] != 1)
+        {
+            return false;
+        }
+
+        const size_t samples = dims[0];
+        const size_t chunk_cols = chunk_dims[2];
+        const size_t chunks_per_row = (dims[2] + chunk_cols - 1) / chunk_cols;
+        const size_t total_chunks = dims[1] * chunks_per_row;
+        const size_t chunk_bytes = samples * chunk_cols * sizeof(T_real);
+        const size_t num_threads = std::max((size_t)1, _compress_threads);
+        const size_t batch_size = std::max(num_threads, (size_t)HDF5_PRECOMPRESS_BATCH_BYTES / chunk_bytes);
+
+        std::vector<std::vector<Bytef> > compressed(std::min(batch_size, total_chunks));
+        std::vector<uLongf> compressed_size(compressed.size());
+
+        for (size_t batch_start = 0; batch_start < total_chunks; batch_start += batch_size)
+        {
+            const size_t batch_end = std::min(total_chunks, batch_start + batch_size);
+            std::atomic<size_t> next_chunk(batch_start);
+            std::atomic<bool> failed(false);
+
+            auto compress_chunks = [&]()
+            {
+                std::vector<T_real> buffer(samples * chunk_cols);
+                std::vector<Bytef> shuffled(shuffle ? chunk_bytes : 0);
+                for (size_t c = next_chunk++; c < batch_end; c = next_chunk++)
+                {
+                    size_t row = c / chunks_per_row;
+                    size_t col_start = (c % chunks_per_row) * chunk_cols;
+                    // chunk layout is [sample][col], edge chunks are zero padded
+                    std::fill(buffer.begin(), buffer.end(), (T_real)0.0);
+                    for (size_t col = col_start; col < std::min((size_t)dims[2], col_start + chunk_cols); col++)
+                    {
+                        const data_struct::Spectra<T_real>& spectra = (*spectra_volume)[row][col];
+                        for (size_t s = 0; s < samples; s++)
+                        {
+                            buffer[(s * chunk_cols) + (col - col_start)] = spectra[s];
+                        }
+                    }
+                    const Bytef* src = (const Bytef*)buffer.data();
+                    if (shuffle)
+                    {
+                        // same byte transpose as the hdf5 shuffle filter
+                        const size_t num_elements = buffer.size();
+                        for (size_t i = 0; i < num_elements; i++)
+                        {
+                            for (size_t b = 0; b < sizeof(T_real); b++)
+                            {
+                                shuffled[(b * num_elements) + i] = src[(i * sizeof(T_real)) + b];
+                            }
+                        }
+                        src = shuffled.data();
+                    }
+                    std::vector<Bytef>& dest = compressed[c - batch_start];
+                    uLongf dest_len = compressBound(chunk_bytes);
+                    dest.resize(dest_len);
+                    if (compress2(dest.data(), &dest_len, src, chunk_bytes, level) != Z_OK)
+                    {
+                        failed = true;
+                    }
+                    compressed_size[c - batch_start] = dest_len;
+                }
+            };
+
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < std::min(num_threads, batch_end - batch_start); t++)
+            {
+                workers.emplace_back(compress_chunks);
+            }
+            compress_chunks();
+            for (auto& worker : workers)
+            {
+                worker.join();
+            }
+
+            if (failed)
+            {
+                logE << "Failed to compress spectra volume chunks\n";
+                return false;
+            }
+
+            for (size_t c = batch_start; c < batch_end; c++)
+            {
+                hsize_t offset[3] = { 0, c / chunks_per_row, (c % chunks_per_row) * chunk_cols };
+                if (H5Dwrite_chunk(dset_id, H5P_DEFAULT, 0, offset, compressed_size[c - batch_start], compressed[c - batch_start].data()) < 0)
+                {
+                    logE << "H5Dwrite_chunk failed to write spectra chunk " << c << "\n";
+                    return false;
+                }
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    H5_Compression _default_compression;
+
+    std::map<std::string, H5_Compression> _dataset_compression;
+
+    size_t _compress_threads;
+
+    std::thread* _async_thread;
+
+    std::queue<std::function<void()> > _async_jobs;
+
+    std::mutex _async_mutex;
+
+    std::condition_variable _async_condition;
+
+    size_t _async_max_jobs;
+
+    bool _async_running;
+
+    bool _async_busy;
+
     //-----------------------------------------------------------------------------
 
     template<typename T_real>
@@ -6796,7 +7464,7 @@ private:
 
                 dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
                 H5Pset_chunk(dcpl_id, 3, count_3d);
-                H5Pset_deflate(dcpl_id, 7);
+                _set_dcpl_compression(dcpl_id, STR_VALUES);
 
                 count_3d[0] = scalers_map->size();
                 count[0] = count_3d[0];
@@ -6999,20 +7667,21 @@ private:
     bool _open_h5_object(hid_t &id, H5_OBJECTS obj, std::stack<std::pair<hid_t, H5_OBJECTS> > &close_map, std::string s1, hid_t id2, bool log_error=true, bool close_on_fail=true);
     bool _open_or_create_group(const std::string name, hid_t parent_id, hid_t& out_id, bool log_error = true, bool close_on_fail = true);
     bool _create_memory_space(int rank, const hsize_t* count, hid_t& out_id);
-    bool _open_h5_dataset(const std::string& name, hid_t data_type, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece);
+    // contiguous creates a fixed size dataset without chunks or filters, existing ones are replaced when dims change
+    bool _open_h5_dataset(const std::string& name, hid_t data_type, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece, bool contiguous=false);
 
     //-----------------------------------------------------------------------------
 
     template<typename T_real>
-    bool _open_h5_dataset(const std::string& name, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece)
+    bool _open_h5_dataset(const std::string& name, hid_t parent_id, int dims_size, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id, hid_t& out_dataspece, bool contiguous=false)
     {
         if (std::is_same<T_real, float>::value)
         {
-            return _open_h5_dataset(name, H5T_INTEL_F32, parent_id, dims_size, dims, chunk_dims, out_id, out_dataspece);
+            return _open_h5_dataset(name, H5T_INTEL_F32, parent_id, dims_size, dims, chunk_dims, out_id, out_dataspece, contiguous);
         }
         else if (std::is_same<T_real, double>::value)
         {
-            return _open_h5_dataset(name, H5T_INTEL_F64, parent_id, dims_size, dims, chunk_dims, out_id, out_dataspece);
+            return _open_h5_dataset(name, H5T_INTEL_F64, parent_id, dims_size, dims, chunk_dims, out_id, out_dataspece, contiguous);
         }
         return false;
     }
@@ -7023,6 +7692,48 @@ private:
 
     //-----------------------------------------------------------------------------
 
+
+    bool _generate_stream_dataset(std::string dataset_directory, std::string dataset_name, size_t d_hash, int detector_num, size_t height, size_t width, size_t spectra_size, hid_t data_type);
+
+    Stream_HDF5_Struct* _get_stream_dataset(size_t d_hash, size_t detector_num);
+
+    bool _create_stream_dataset(Stream_HDF5_Struct* stream, const std::string& name, hid_t data_type, hid_t parent_id, int rank, const hsize_t* dims, const hsize_t* chunk_dims, hid_t& out_id);
+
+    bool _create_stream_fit_dataset(Stream_HDF5_Struct* stream, const std::string& fit_name, const std::vector<std::string>& channel_names, hid_t data_type);
+
+    //-----------------------------------------------------------------------------
+
+    template<typename T_real>
+    bool _create_stream_fit_dataset(Stream_HDF5_Struct* stream, const std::string& fit_name, const data_struct::Fit_Count_Dict<T_real>& fit_counts)
+    {
+        if (std::is_same<T_real, float>::value)
+        {
+            return _create_stream_fit_dataset(stream, fit_name, data_struct::get_element_save_order(fit_counts), H5T_INTEL_F32);
+        }
+        else if (std::is_same<T_real, double>::value)
+        {
+            return _create_stream_fit_dataset(stream, fit_name, data_struct::get_element_save_order(fit_counts), H5T_INTEL_F64);
+        }
+        return false;
+    }
+
+    //-----------------------------------------------------------------------------
+
+    template<typename T_real>
+    void _write_stream_row(hid_t dset_id, hid_t mem_space_id, const hsize_t* offset, const hsize_t* count, const T_real* buf, const std::string& name)
+    {
+        hid_t dataspace_id = H5Dget_space(dset_id);
+        H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+        herr_t status = _write_h5d<T_real>(dset_id, mem_space_id, dataspace_id, H5P_DEFAULT, (void*)buf);
+        if (status < 0)
+        {
+            logE << " H5Dwrite failed to write " << name << " row " << offset[0] << "\n";
+        }
+        H5Sclose(dataspace_id);
+    }
+
+    //-----------------------------------------------------------------------------
+
     template<typename T_real>
     herr_t _read_h5d(hid_t dset_id, hid_t mem_space_id, hid_t file_space_id, hid_t plist_id, void* buf)
     {
@@ -7036,6 +7747,69 @@ private:
         }
         return -1;
     }
+
+    //-----------------------------------------------------------------------------
+
+    // Read the block at offset/count with one H5Dread, ex: a row of livetime instead of a read per pixel.
+    // Columns past the end of the dataset repeat the last column read, like the per pixel reads
+    // kept the last value when their selection failed. Rows outside of the extent are left as default_val.
+    template<typename T_real>
+    herr_t _read_h5d_block(hid_t dset_id, hid_t file_space_id, int rank, const hsize_t* offset, const hsize_t* count, std::vector<T_real>& out_buffer, T_real default_val = 1.0)
+    {
+        std::vector<hsize_t> file_dims(rank, 0);
+        std::vector<hsize_t> read_count(rank, 0);
+        std::vector<hsize_t> mem_offset(rank, 0);
+        hsize_t total = 1;
+        for (int i = 0; i < rank; i++)
+        {
+            total *= count[i];
+        }
+        out_buffer.assign(total, default_val);
+
+        if (H5Sget_simple_extent_dims(file_space_id, file_dims.data(), nullptr) != rank)
+        {
+            return -1;
+        }
+        for (int i = 0; i < rank; i++)
+        {
+            if (offset[i] >= file_dims[i])
+            {
+                return -1;
+            }
+            read_count[i] = std::min(count[i], file_dims[i] - offset[i]);
+        }
+
+        hid_t mem_space_id = H5Screate_simple(rank, count, nullptr);
+        H5Sselect_hyperslab(mem_space_id, H5S_SELECT_SET, mem_offset.data(), nullptr, read_count.data(), nullptr);
+        H5Sselect_hyperslab(file_space_id, H5S_SELECT_SET, offset, nullptr, read_count.data(), nullptr);
+        herr_t error = _read_h5d<T_real>(dset_id, mem_space_id, file_space_id, H5P_DEFAULT, out_buffer.data());
+        H5Sclose(mem_space_id);
+
+        const hsize_t line_len = count[rank - 1];
+        const hsize_t read_len = read_count[rank - 1];
+        if (error > -1 && read_len > 0 && read_len < line_len)
+        {
+            for (hsize_t line = 0; line < total / line_len; line++)
+            {
+                bool line_read = true;
+                hsize_t idx = line;
+                for (int i = rank - 2; i >= 0; i--)
+                {
+                    if (idx % count[i] >= read_count[i])
+                    {
+                        line_read = false;
+                    }
+                    idx /= count[i];
+                }
+                if (line_read)
+                {
+                    T_real* line_ptr = &out_buffer[line * line_len];
+                    std::fill(line_ptr + read_len, line_ptr + line_len, line_ptr[read_len - 1]);
+                }
+            }
+        }
+        return error;
+    }
     
     //-----------------------------------------------------------------------------
 
@@ -7059,6 +7833,9 @@ private:
     std::string _cur_filename;
     std::stack<std::pair<hid_t, H5_OBJECTS> > _global_close_map;
 
+    // open stream files by dataset hash and detector number
+    std::map<size_t, std::map<size_t, Stream_HDF5_Struct> > _stream_datasets;
+
 };
 
 
@@ -204,6 +204,32 @@ bool load_scalers_lookup(const std::string filename)
 
 // ----------------------------------------------------------------------------
 
+bool load_element_info_cached(const std::string element_henke_filename, const std::string element_csv_filename, const std::string element_cache_filename)
+{
+    if (load_element_info_cache(element_cache_filename, element_henke_filename, element_csv_filename))
+    {
+        return true;
+    }
+
+    if (false == load_element_info<float>(element_henke_filename, element_csv_filename))
+    {
+        return false;
+    }
+    if (false == load_element_info<double>(element_henke_filename, element_csv_filename))
+    {
+        return false;
+    }
+
+    // best effort, the reference directory may be read only
+    if (false == save_element_info_cache(element_cache_filename, element_henke_filename, element_csv_filename))
+    {
+        logI << "Could not write element cache " << element_cache_filename << "\n";
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 void save_optimized_fit_params(std::string dataset_dir, std::string dataset_filename, int detector_num, string result, data_struct::Fit_Parameters<double> *fit_params, data_struct::Spectra<double>* spectra, data_struct::Fit_Element_Map_Dict<double>* elements_to_fit)
 {
     std::string full_path = dataset_dir + DIR_END_CHAR + "output" + DIR_END_CHAR + dataset_filename;
@@ -60,6 +60,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "io/file/hdf5_io.h"
 #include "io/file/csv_io.h"
 #include "io/file/file_scan.h"
+#include "io/file/element_info_cache.h"
 
 #include "data_struct/spectra_volume.h"
 
@@ -104,6 +105,9 @@ DLL_EXPORT void generate_h5_averages(std::string dataset_directory, std::string
 
 DLL_EXPORT bool load_scalers_lookup(const std::string filename);
 
+/// \brief Load Element_Info_Map<float> and <double> from element_cache_filename, or parse the henke and csv files and write the cache.
+DLL_EXPORT bool load_element_info_cached(const std::string element_henke_filename, const std::string element_csv_filename, const std::string element_cache_filename);
+
 DLL_EXPORT bool load_quantification_standardinfo(std::string dataset_directory, std::string quantification_info_file, vector<Quantification_Standard<double>>& standard_element_weights);
 
 //DLL_EXPORT void populate_netcdf_hdf5_files(std::string dataset_dir);
@@ -273,6 +277,8 @@ DLL_EXPORT bool init_analysis_job_detectors(data_struct::Analysis_Job<T_real>* a
         {
             detector->model = new fitting::models::Gaussian_Model<T_real>();
         }
+        // maps are fit a pixel per thread pool job
+        detector->model->set_num_threads(analysis_job->model_threads(data_struct::PARALLELISM_POLICY::PIXEL));
         data_struct::Params_Override<T_real>* override_params = &(detector->fit_params_override_dict);
 
         override_params->dataset_directory = analysis_job->dataset_directory;
@@ -305,6 +311,10 @@ DLL_EXPORT bool init_analysis_job_detectors(data_struct::Analysis_Job<T_real>* a
         {
             //Fitting models
             detector->fit_routines[proc_type] = generate_fit_routine(proc_type, analysis_job->optimizer());
+            if (proc_type == data_struct::Fitting_Routines::GAUSS_MATRIX)
+            {
+                ((fitting::routines::Matrix_Optimized_Fit_Routine<T_real>*)detector->fit_routines[proc_type])->set_batch_size(analysis_job->fit_batch_size);
+            }
 
             //reset model fit parameters to defaults
             detector->model->reset_to_default_fit_params();
@@ -532,6 +542,11 @@ DLL_EXPORT bool load_and_integrate_spectra_volume(std::string dataset_directory,
             }
 
 
+            // netCDF-4 reads go through HDF5 without HDF5_IO's lock, let queued saves finish first
+            if (hasNetcdf || hasBnpNetcdf)
+            {
+                io::file::HDF5_IO::inst()->flush_async_saves();
+            }
             if (hasNetcdf)
             {
                 std::ifstream file_io(dataset_directory + "flyXRF" + DIR_END_CHAR + tmp_dataset_file + file_middle + "0.nc");
@@ -814,6 +829,11 @@ DLL_EXPORT bool load_spectra_volume(std::string dataset_directory,
     }
     else
     {
+        // netCDF-4 reads go through HDF5 without HDF5_IO's lock, let queued saves finish first
+        if (hasNetcdf || hasBnpNetcdf)
+        {
+            io::file::HDF5_IO::inst()->flush_async_saves();
+        }
         if (hasNetcdf)
         {
             std::ifstream file_io(dataset_directory + "flyXRF" + DIR_END_CHAR + tmp_dataset_file + file_middle + "0.nc");
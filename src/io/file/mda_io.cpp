@@ -47,6 +47,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "mda_io.h"
+#include "core/mem_info.h"
+
+#include <list>
+#include <mutex>
+#include <sys/stat.h>
 
 
 
@@ -55,6 +60,121 @@ namespace io
 namespace file
 {
 
+// parsed scans kept for the detectors and scaler passes of a dataset
+#define MDA_CACHE_MAX_BYTES (512LL * 1024LL * 1024LL)
+
+struct MDA_Cache_Entry
+{
+    time_t mtime;
+    long long file_size;
+    // scan levels parsed, the data rank for a full parse
+    int levels;
+    long long bytes;
+    std::shared_ptr<struct mda_file> mda;
+};
+
+static std::mutex mda_cache_mutex;
+// most recently used first
+static std::list<std::pair<std::string, MDA_Cache_Entry> > mda_cache;
+
+//-----------------------------------------------------------------------------
+
+static long long mda_scan_bytes(const struct mda_scan* scan)
+{
+    if (scan == nullptr)
+    {
+        return 0;
+    }
+    long long bytes = (long long)scan->requested_points * ((scan->number_positioners * sizeof(double)) + (scan->number_detectors * sizeof(float)));
+    if (scan->sub_scans != nullptr)
+    {
+        for (int32_t i = 0; i < scan->requested_points; i++)
+        {
+            bytes += mda_scan_bytes(scan->sub_scans[i]);
+        }
+    }
+    return bytes;
+}
+
+//-----------------------------------------------------------------------------
+
+static std::shared_ptr<struct mda_file> mda_cache_load(const std::string& path, int levels)
+{
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0)
+    {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mda_cache_mutex);
+        for (auto itr = mda_cache.begin(); itr != mda_cache.end(); itr++)
+        {
+            if (itr->first == path)
+            {
+                MDA_Cache_Entry& entry = itr->second;
+                int needed = (levels > 0) ? levels : entry.mda->header->data_rank;
+                if (entry.mtime == file_stat.st_mtime && entry.file_size == (long long)file_stat.st_size && entry.levels >= needed)
+                {
+                    mda_cache.splice(mda_cache.begin(), mda_cache, itr);
+                    return entry.mda;
+                }
+                // rewritten since or parsed too shallow
+                mda_cache.erase(itr);
+                break;
+            }
+        }
+    }
+
+    std::FILE* fptr = std::fopen(path.c_str(), "rb");
+    if (fptr == nullptr)
+    {
+        return nullptr;
+    }
+    struct mda_file* mda_file = (levels > 0) ? mda_load_levels(fptr, levels) : mda_load(fptr);
+    std::fclose(fptr);
+    if (mda_file == nullptr)
+    {
+        return nullptr;
+    }
+
+    MDA_Cache_Entry entry;
+    entry.mtime = file_stat.st_mtime;
+    entry.file_size = (long long)file_stat.st_size;
+    entry.levels = (levels > 0) ? std::min(levels, (int)mda_file->header->data_rank) : mda_file->header->data_rank;
+    entry.bytes = mda_scan_bytes(mda_file->scan);
+    entry.mda = std::shared_ptr<struct mda_file>(mda_file, mda_unload);
+
+    long long budget = std::min(MDA_CACHE_MAX_BYTES, get_available_mem() / 4);
+    if (entry.bytes <= budget)
+    {
+        std::lock_guard<std::mutex> lock(mda_cache_mutex);
+        mda_cache.emplace_front(path, entry);
+        long long total = 0;
+        for (auto itr = mda_cache.begin(); itr != mda_cache.end();)
+        {
+            total += itr->second.bytes;
+            if (total > budget)
+            {
+                itr = mda_cache.erase(itr);
+            }
+            else
+            {
+                itr++;
+            }
+        }
+    }
+    return entry.mda;
+}
+
+//-----------------------------------------------------------------------------
+
+void mda_clear_cache()
+{
+    std::lock_guard<std::mutex> lock(mda_cache_mutex);
+    mda_cache.clear();
+}
+
 //-----------------------------------------------------------------------------
 
 template<typename T_real>
@@ -78,24 +198,21 @@ MDA_IO<T_real>::~MDA_IO()
 //-----------------------------------------------------------------------------
 
 template<typename T_real>
-bool MDA_IO<T_real>::load_scalers(std::string path)
+bool MDA_IO<T_real>::_load_mda(const std::string& path, int levels)
 {
-    if (_mda_file != nullptr)
-    {
-        unload();
-    }
-
-    std::FILE* fptr = fopen(path.c_str(), "rb");
-
-    if (fptr == nullptr)
-    {
-        return false;
-    }
+    unload();
+    _mda_file_ref = mda_cache_load(path, levels);
+    _mda_file = _mda_file_ref.get();
+    return _mda_file != nullptr;
+}
 
-    _mda_file = mda_load(fptr);
-    std::fclose(fptr);
+//-----------------------------------------------------------------------------
 
-    if (_mda_file == nullptr)
+template<typename T_real>
+bool MDA_IO<T_real>::load_scalers(std::string path)
+{
+    // scalers are in the row and column scans, skip the spectra. load_integrated_spectra sums those.
+    if (false == _load_mda(path, 2))
     {
         return false;
     }
@@ -106,7 +223,7 @@ bool MDA_IO<T_real>::load_scalers(std::string path)
         return false;
     }
 
-    _load_scalers(true);
+    _load_scalers(false);
     _load_meta_info();
     _load_extra_pvs_vector();
 
@@ -118,11 +235,8 @@ bool MDA_IO<T_real>::load_scalers(std::string path)
 template<typename T_real>
 void MDA_IO<T_real>::unload()
 {
-    if(_mda_file != nullptr)
-    {
-        mda_unload(_mda_file);
-        _mda_file = nullptr;
-    }
+    _mda_file_ref.reset();
+    _mda_file = nullptr;
     if(_mda_file_info != nullptr)
     {
         mda_info_unload(_mda_file_info);
@@ -143,19 +257,8 @@ bool MDA_IO<T_real>::load_quantification_scalers(std::string path, data_struct::
     {
         if (_mda_file == nullptr)
         {
-            std::FILE* fptr = std::fopen(path.c_str(), "rb");
-
-            size_t cols = 1;
-            size_t rows = 1;
-            size_t samples = 1;
-
-            if (fptr == nullptr)
-            {
-                return false;
-            }
-
-            _mda_file = mda_load(fptr);
-            std::fclose(fptr);
+            // scalers are in the row and column scans, skip the spectra
+            _load_mda(path, 2);
         }
         if (_mda_file == nullptr)
         {
@@ -235,21 +338,12 @@ bool MDA_IO<T_real>::load_spectra_volume(std::string path,
     const data_struct::ArrayXXr<T_real>* ert_arr = nullptr;
     const data_struct::ArrayXXr<T_real>* icr_arr = nullptr;
     const data_struct::ArrayXXr<T_real>* ocr_arr = nullptr;
-    std::FILE *fptr = std::fopen(path.c_str(), "rb");
 
     size_t cols = 1;
     size_t rows = 1;
     size_t samples = 1;
 
-    if (fptr == nullptr)
-    {
-        return false;
-    }
-
-
-    _mda_file = mda_load(fptr);
-    std::fclose(fptr);
-    if (_mda_file == nullptr || vol == nullptr)
+    if (false == _load_mda(path, 0) || vol == nullptr)
     {
         return false;
     }
@@ -492,19 +586,9 @@ bool MDA_IO<T_real>::load_spectra_volume_with_callback(std::string path,
     size_t max_detecotr_num = 0;
     bool is_single_row = false;
 
-    std::FILE *fptr = std::fopen(path.c_str(), "rb");
-
     size_t samples = 1;
 
-    if (fptr == nullptr)
-    {
-        return false;
-    }
-
-
-    _mda_file = mda_load(fptr);
-    std::fclose(fptr);
-    if (_mda_file == nullptr)
+    if (false == _load_mda(path, 0))
     {
         return false;
     }
@@ -751,21 +835,11 @@ bool MDA_IO<T_real>::load_integrated_spectra(std::string path,
     const data_struct::ArrayXXr<T_real>* ocr_arr = nullptr;
 	bool is_single_row = false;
 
-	std::FILE *fptr = std::fopen(path.c_str(), "rb");
-
 	size_t cols = 1;
 	size_t rows = 1;
 	size_t samples = 1;
 
-	if (fptr == nullptr)
-	{
-		return false;
-	}
-
-
-	_mda_file = mda_load(fptr);
-	std::fclose(fptr);
-	if (_mda_file == nullptr || out_integrated_spectra == nullptr)
+	if (false == _load_mda(path, 0) || out_integrated_spectra == nullptr)
 	{
 		logE << "_mda_file or out_integrated_spectra == nullptr\n";
 		return false;
@@ -1530,6 +1604,11 @@ int mda_get_multiplied_dims(std::string path)
 
 
     std::FILE* fptr = std::fopen(path.c_str(), "rb");
+    if (fptr == nullptr)
+    {
+        logE << "Unable to open mda file " << path << "\n";
+        return f_size;
+    }
     struct mda_header* header = mda_header_load(fptr);
 
     std::fclose(fptr);
@@ -1563,6 +1642,11 @@ int mda_get_rank_and_dims(std::string path, size_t* dims)
 {
 
     std::FILE* fptr = std::fopen(path.c_str(), "rb");
+    if (fptr == nullptr)
+    {
+        logE << "Unable to open mda file " << path << "\n";
+        return -1;
+    }
     struct mda_header* header = mda_header_load(fptr);
     int rank = -1;
     std::fclose(fptr);
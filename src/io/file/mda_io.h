@@ -49,7 +49,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef MDA_IO_H
 #define MDA_IO_H
 
-#include "support/mda_utils/mda-load.h"
+#include "support/mdautils-1.4.1/mda-load.h"
 #include "data_struct/element_info.h"
 #include "data_struct/spectra_volume.h"
 #include "data_struct/quantification_standard.h"
@@ -59,6 +59,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <memory>
 
 #include <stdio.h>
 #include <stdint.h>
@@ -139,6 +140,9 @@ public:
 
 private:
 
+    /// Parse the outer scan levels of path (all when levels < 1), shared with other loads of the same file
+    bool _load_mda(const std::string& path, int levels);
+
     void _load_scalers(bool load_int_spec);
 
     void _load_extra_pvs_vector();
@@ -152,6 +156,11 @@ private:
      */
     struct mda_file* _mda_file;
 
+    /**
+     * @brief _mda_file_ref: owns _mda_file, the parsed file may also be held by the mda cache
+     */
+    std::shared_ptr<struct mda_file> _mda_file_ref;
+
     /**
      * @brief _mda_file_info: lazy load struct
      */
@@ -174,6 +183,8 @@ DLL_EXPORT int mda_get_multiplied_dims(std::string path);
 
 DLL_EXPORT int mda_get_rank_and_dims(std::string path, size_t* dims);
 
+DLL_EXPORT void mda_clear_cache();
+
 
 }// end namespace file
 }// end namespace io
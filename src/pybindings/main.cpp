@@ -4,6 +4,7 @@
 #include <pybind11/chrono.h>
 #include <pybind11/functional.h>
 #include <pybind11/eigen.h>
+#include <cstring>
 
 #if defined _WIN32 || defined __CYGWIN__
   #ifdef _BUILD_WITH_ZMQ
@@ -112,53 +113,56 @@ PYBIND11_MODULE(pyxrfmaps, m) {
     .value("NNLS", data_struct::Fitting_Routines::NNLS);
 
     //data structures
-    /*
-    py::class_<data_struct::Spectra, data_struct::ArrayXr>(m, "Spectra", py::buffer_protocol())
-    //py::class_<data_struct::Spectra, data_struct::ArrayXr>(m, "Spectra")
+    // numpy.array(spectra, copy=False) is a view of the channels, no copy
+    py::class_<data_struct::Spectra<float>>(m, "Spectra", py::buffer_protocol())
         .def(py::init<size_t>())
-        .def("add", &data_struct::Spectra::add)
-        .def("recalc_elapsed_livetime", &data_struct::Spectra::recalc_elapsed_livetime)
-        .def("set_elapsed_livetime", (void (data_struct::Spectra::*)(real_t)) &data_struct::Spectra::elapsed_livetime )
-        .def("get_elapsed_livetime", (const real_t (data_struct::Spectra::*)() const) &data_struct::Spectra::elapsed_livetime)
-        .def("set_elapsed_realtime", (void (data_struct::Spectra::*)(real_t)) &data_struct::Spectra::elapsed_realtime )
-        .def("get_elapsed_realtime", (const real_t (data_struct::Spectra::*)() const) &data_struct::Spectra::elapsed_realtime)
-        .def("set_input_counts", (void (data_struct::Spectra::*)(real_t)) &data_struct::Spectra::input_counts )
-        .def("get_input_counts", (const real_t (data_struct::Spectra::*)() const) &data_struct::Spectra::input_counts)
-        .def("set_output_counts", (void (data_struct::Spectra::*)(real_t)) &data_struct::Spectra::output_counts )
-        .def("get_output_counts", (const real_t (data_struct::Spectra::*)() const) &data_struct::Spectra::output_counts)
-        .def("sub_spectra", &data_struct::Spectra::sub_spectra);
-
-        .def_buffer([](data_struct::Spectra &m) -> py::buffer_info {
+        .def("add", (void (data_struct::Spectra<float>::*)(const data_struct::Spectra<float>&)) &data_struct::Spectra<float>::add)
+        .def("recalc_elapsed_livetime", &data_struct::Spectra<float>::recalc_elapsed_livetime)
+        .def("set_elapsed_livetime", (void (data_struct::Spectra<float>::*)(float)) &data_struct::Spectra<float>::elapsed_livetime)
+        .def("get_elapsed_livetime", (const float (data_struct::Spectra<float>::*)() const) &data_struct::Spectra<float>::elapsed_livetime)
+        .def("set_elapsed_realtime", (void (data_struct::Spectra<float>::*)(float)) &data_struct::Spectra<float>::elapsed_realtime)
+        .def("get_elapsed_realtime", (const float (data_struct::Spectra<float>::*)() const) &data_struct::Spectra<float>::elapsed_realtime)
+        .def("set_input_counts", (void (data_struct::Spectra<float>::*)(float)) &data_struct::Spectra<float>::input_counts)
+        .def("get_input_counts", (const float (data_struct::Spectra<float>::*)() const) &data_struct::Spectra<float>::input_counts)
+        .def("set_output_counts", (void (data_struct::Spectra<float>::*)(float)) &data_struct::Spectra<float>::output_counts)
+        .def("get_output_counts", (const float (data_struct::Spectra<float>::*)() const) &data_struct::Spectra<float>::output_counts)
+        .def("sub_spectra", &data_struct::Spectra<float>::sub_spectra)
+        .def("__len__", [](const data_struct::Spectra<float>& s) { return (size_t)s.size(); })
+        .def_property_readonly("size", [](const data_struct::Spectra<float>& s) { return (size_t)s.size(); })
+        .def_buffer([](data_struct::Spectra<float>& s) -> py::buffer_info {
                 return py::buffer_info(
-                    m.data(),                               // Pointer to buffer
-                    sizeof(real_t),                          // Size of one scalar
-                    py::format_descriptor<real_t>::format(), // Python struct-style format descriptor
+                    s.data(),                               // Pointer to buffer
+                    sizeof(float),                          // Size of one scalar
+                    py::format_descriptor<float>::format(), // Python struct-style format descriptor
                     1,                                      // Number of dimensions
-                    { m.size() },                 // Buffer dimensions
-                    { sizeof(real_t) }             // Strides (in bytes) for each index
+                    { (size_t)s.size() },                   // Buffer dimensions
+                    { sizeof(float) }                       // Strides (in bytes) for each index
                 );
             });
-*/
 
-    py::class_<data_struct::Spectra_Line<float>>(m, "Spectra_Line", py::buffer_protocol())
+    // items are returned by reference and kept alive by their parent, so indexing does not copy spectra
+    py::class_<data_struct::Spectra_Line<float>>(m, "Spectra_Line")
         .def(py::init<>())
-        .def("__getitem__", [](const data_struct::Spectra_Line<float>&s, size_t i) {
+        .def("__getitem__", [](data_struct::Spectra_Line<float>&s, size_t i) -> data_struct::Spectra<float>& {
         if (i >= s.size()) throw py::index_error();
         return s[i];
-        })
+        }, py::return_value_policy::reference_internal)
+        .def("__len__", &data_struct::Spectra_Line<float>::size)
         .def("resize_and_zero", &data_struct::Spectra_Line<float>::resize_and_zero)
         .def("alloc_row_size", &data_struct::Spectra_Line<float>::alloc_row_size)
         .def("recalc_elapsed_livetime", &data_struct::Spectra_Line<float>::recalc_elapsed_livetime)
         .def("size", &data_struct::Spectra_Line<float>::size);
 
-    py::class_<data_struct::Spectra_Volume<float>>(m, "Spectra_Volume", py::buffer_protocol())
+    // the volume is stored as rows of separately allocated spectra, so there is no single buffer to view, index it instead.
+    py::class_<data_struct::Spectra_Volume<float>>(m, "Spectra_Volume")
         .def(py::init<>())
-        .def("__getitem__", [](const data_struct::Spectra_Volume<float>&s, size_t i) {
+        .def("__getitem__", [](data_struct::Spectra_Volume<float>&s, size_t i) -> data_struct::Spectra_Line<float>& {
         if (i >= s.rows()) throw py::index_error();
         return s[i];
-        })
+        }, py::return_value_policy::reference_internal)
+        .def("__len__", &data_struct::Spectra_Volume<float>::rows)
         .def("resize_and_zero", &data_struct::Spectra_Volume<float>::resize_and_zero)
-        .def("integrate", &data_struct::Spectra_Volume<float>::integrate)
+        .def("integrate", &data_struct::Spectra_Volume<float>::integrate, py::call_guard<py::gil_scoped_release>())
         .def("generate_scaler_maps", &data_struct::Spectra_Volume<float>::generate_scaler_maps)
         .def("cols", &data_struct::Spectra_Volume<float>::cols)
         .def("rows", &data_struct::Spectra_Volume<float>::rows)
@@ -421,14 +425,14 @@ PYBIND11_MODULE(pyxrfmaps, m) {
 		const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_spectra(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
 	.def("fit_counts", [](fitting::routines::ROI_Fit_Routine& self,
 		fitting::models::Base_Model* const model,
 		const Spectra* const spectra,
 		const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_counts(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
     .def("get_name", &fitting::routines::ROI_Fit_Routine::get_name)
     .def("initialize", &fitting::routines::ROI_Fit_Routine::initialize);
 
@@ -440,15 +444,15 @@ PYBIND11_MODULE(pyxrfmaps, m) {
 			const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_spectra(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
 		.def("fit_counts", [](fitting::routines::Param_Optimized_Fit_Routine& self,
 			const fitting::models::Base_Model* const model,
 			const Spectra* const spectra,
 			const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_counts(&self, model, spectra, elements_to_fit);
-	})
-		.def("fit_spectra_parameters", &fitting::routines::Param_Optimized_Fit_Routine::fit_spectra_parameters)
+	}, py::call_guard<py::gil_scoped_release>())
+		.def("fit_spectra_parameters", &fitting::routines::Param_Optimized_Fit_Routine::fit_spectra_parameters, py::call_guard<py::gil_scoped_release>())
 		.def("get_name", &fitting::routines::Param_Optimized_Fit_Routine::get_name)
 		.def("initialize", &fitting::routines::Param_Optimized_Fit_Routine::initialize)
 		.def("set_optimizer", &fitting::routines::Param_Optimized_Fit_Routine::set_optimizer)
@@ -479,14 +483,14 @@ PYBIND11_MODULE(pyxrfmaps, m) {
 		return spec_model;
 		*/
 		return fit_spectra(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
 	.def("fit_counts", [](fitting::routines::Matrix_Optimized_Fit_Routine& self,
 			const fitting::models::Base_Model* const model,
 			const Spectra* const spectra,
 			const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_counts(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
     .def("get_name", &fitting::routines::Matrix_Optimized_Fit_Routine::get_name)
     .def("initialize", &fitting::routines::Matrix_Optimized_Fit_Routine::initialize);
 
@@ -498,14 +502,14 @@ PYBIND11_MODULE(pyxrfmaps, m) {
 		const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_spectra(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
 	.def("fit_counts", [](fitting::routines::NNLS_Fit_Routine& self, 
 		fitting::models::Base_Model* const model,
 		const Spectra* const spectra,
 		const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_counts(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
     .def("get_name", &fitting::routines::NNLS_Fit_Routine::get_name)
     .def("initialize", &fitting::routines::NNLS_Fit_Routine::initialize);
 
@@ -517,14 +521,14 @@ PYBIND11_MODULE(pyxrfmaps, m) {
 			const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_spectra(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
 		.def("fit_counts", [](fitting::routines::SVD_Fit_Routine& self,
 			fitting::models::Base_Model* const model,
 			const Spectra* const spectra,
 			const Fit_Element_Map_Dict* const elements_to_fit)
 	{
 		return fit_counts(&self, model, spectra, elements_to_fit);
-	})
+	}, py::call_guard<py::gil_scoped_release>())
 		.def("get_name", &fitting::routines::SVD_Fit_Routine::get_name)
 		.def("initialize", &fitting::routines::SVD_Fit_Routine::initialize);
 
@@ -552,7 +556,7 @@ PYBIND11_MODULE(pyxrfmaps, m) {
     m.def("generate_fit_routine", &io::generate_fit_routine);
     m.def("init_analysis_job_detectors", &io::init_analysis_job_detectors);
     m.def("load_element_info", &io::load_element_info);
-    m.def("load_and_integrate_spectra_volume", &io::load_and_integrate_spectra_volume);
+    m.def("load_and_integrate_spectra_volume", &io::load_and_integrate_spectra_volume, py::call_guard<py::gil_scoped_release>());
    // m.def("load_override_params", &io::load_override_params);
 	m.def("load_override_params", [](std::string dataset_directory,
 									int detector_num,
@@ -564,7 +568,7 @@ PYBIND11_MODULE(pyxrfmaps, m) {
 		
 	});
   ///  m.def("load_quantification_standard", &io::load_quantification_standard);
-    m.def("load_spectra_volume", &io::load_spectra_volume);
+    m.def("load_spectra_volume", &io::load_spectra_volume, py::call_guard<py::gil_scoped_release>());
     m.def("populate_netcdf_hdf5_files", &io::populate_netcdf_hdf5_files);
    // m.def("save_averaged_fit_params", &io::save_averaged_fit_params);
     m.def("save_optimized_fit_params", &io::save_optimized_fit_params);
@@ -585,7 +589,7 @@ PYBIND11_MODULE(pyxrfmaps, m) {
     py::class_<io::file::MDA_IO>(io_file, "MDA_IO")
     .def(py::init<>())
     .def("unload", &io::file::MDA_IO::unload)
-    .def("load_spectra_volume", &io::file::MDA_IO::load_spectra_volume)
+    .def("load_spectra_volume", &io::file::MDA_IO::load_spectra_volume, py::call_guard<py::gil_scoped_release>())
     .def("load_spectra_volume_with_callback", &io::file::MDA_IO::load_spectra_volume_with_callback)
     //.def("find_scaler_index", &io::file::MDA_IO::find_scaler_index)
     .def("get_multiplied_dims", &io::file::mda_get_multiplied_dims)
@@ -597,7 +601,7 @@ PYBIND11_MODULE(pyxrfmaps, m) {
                 data_struct::Spectra_Line* spec_line)
                 {
                     return io::file::NetCDF_IO::inst()->load_spectra_line(path, detector, spec_line);
-                });
+                }, py::call_guard<py::gil_scoped_release>());
     //NetCDF_IO
     io_file.def("netcdf_load_spectra_line_with_callback", [](std::string path,
                 std::vector<size_t> detector_num_arr,
@@ -655,12 +659,85 @@ PYBIND11_MODULE(pyxrfmaps, m) {
     //process_whole
     //m.def("generate_fit_count_dict", &generate_fit_count_dict<real_t>);
     m.def("fit_single_spectra", &fit_single_spectra);
-    m.def("optimize_integrated_fit_params", &optimize_integrated_fit_params);
-    m.def("generate_optimal_params", &generate_optimal_params);
+    m.def("optimize_integrated_fit_params", &optimize_integrated_fit_params, py::call_guard<py::gil_scoped_release>());
+    m.def("generate_optimal_params", &generate_optimal_params, py::call_guard<py::gil_scoped_release>());
    // m.def("generate_optimal_params_mp", &generate_optimal_params_mp);
     m.def("proc_spectra", &proc_spectra);
-    m.def("process_dataset_files", &process_dataset_files);
-    m.def("perform_quantification", &perform_quantification);
+    m.def("process_dataset_files", &process_dataset_files, py::call_guard<py::gil_scoped_release>());
+    // Fits a whole (rows, cols, channels) volume on a thread pool, the same jobs proc_spectra runs.
+    // elapsed_livetime is an optional (rows, cols) map, without it the maps are counts instead of counts per second.
+    // Returns the map names and a (maps, rows, cols) array in hdf5 save order.
+    m.def("fit_spectra_volume", [](py::array_t<float, py::array::c_style | py::array::forcecast> spectra,
+                                   fitting::routines::Base_Fit_Routine* fit_routine,
+                                   fitting::models::Base_Model* model,
+                                   Fit_Element_Map_Dict* elements_to_fit,
+                                   py::object elapsed_livetime,
+                                   size_t num_threads)
+    {
+        if (spectra.ndim() != 3)
+        {
+            throw py::value_error("spectra must be a (rows, cols, channels) array");
+        }
+        const size_t rows = spectra.shape(0);
+        const size_t cols = spectra.shape(1);
+        const size_t samples = spectra.shape(2);
+        py::array_t<float, py::array::c_style | py::array::forcecast> livetime;
+        if (false == elapsed_livetime.is_none())
+        {
+            livetime = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(elapsed_livetime);
+            if (!livetime || (size_t)livetime.size() != rows * cols)
+            {
+                throw py::value_error("elapsed_livetime must be a (rows, cols) array");
+            }
+        }
+
+        data_struct::Fit_Count_Tensor<float>* fit_counts = nullptr;
+        {
+            py::gil_scoped_release release;
+            const float* src = spectra.data();
+            const float* lt = livetime ? livetime.data() : nullptr;
+            data_struct::Spectra_Volume<float> spectra_volume;
+            spectra_volume.resize_and_zero(rows, cols, samples);
+            for (size_t i = 0; i < rows; i++)
+            {
+                for (size_t j = 0; j < cols; j++)
+                {
+                    data_struct::Spectra<float>& pixel = spectra_volume[i][j];
+                    std::memcpy(pixel.data(), src + ((i * cols) + j) * samples, samples * sizeof(float));
+                    if (lt != nullptr)
+                    {
+                        pixel.elapsed_livetime(lt[(i * cols) + j]);
+                    }
+                }
+            }
+
+            data_struct::Fitting_Routines proc_type = data_struct::Fitting_Routines::GAUSS_TAILS;
+            if (fit_routine->get_name() == STR_FIT_ROI)
+            {
+                proc_type = data_struct::Fitting_Routines::ROI;
+            }
+            else if (fit_routine->get_name() == STR_FIT_GAUSS_MATRIX)
+            {
+                proc_type = data_struct::Fitting_Routines::GAUSS_MATRIX;
+            }
+            // fit_spectra_volume expects an initialized routine, initialize it for this model and sample count
+            data_struct::Fit_Parameters fit_params = model->fit_parameters();
+            data_struct::Range energy_range = data_struct::get_energy_range(samples, &fit_params);
+            fit_routine->initialize(model, elements_to_fit, energy_range);
+
+            fit_counts = generate_fit_count_tensor(elements_to_fit, rows, cols, true);
+            ThreadPool tp(std::max((size_t)1, num_threads));
+            fit_spectra_volume(&spectra_volume, proc_type, fit_routine, model, elements_to_fit, fit_counts, &tp);
+        }
+
+        std::vector<std::string> names = fit_counts->names();
+        py::array_t<float> maps({ fit_counts->planes(), rows, cols });
+        std::memcpy(maps.mutable_data(), fit_counts->data(), fit_counts->planes() * rows * cols * sizeof(float));
+        delete fit_counts;
+        return py::make_tuple(names, maps);
+    }, py::arg("spectra"), py::arg("fit_routine"), py::arg("model"), py::arg("elements_to_fit"),
+       py::arg("elapsed_livetime") = py::none(), py::arg("num_threads") = (size_t)std::thread::hardware_concurrency());
+    m.def("perform_quantification", &perform_quantification, py::call_guard<py::gil_scoped_release>());
     //m.def("average_quantification", &average_quantification);
 
 	m.def("get_energy_range", (data_struct::Range (*)(size_t, Fit_Parameters*)) &data_struct::get_energy_range);
@@ -163,7 +163,7 @@ void Quantification_Model<T_real>::init_element_quant(Element_Quant<T_real>& ele
     // replace straight henke routines, with those
     // that take the absorption edges into account
     // make sure we are a bit above the absorption edge to make sure that for calibration purposes we do not eoncouner any weird things.
-    beta = element_info->calc_beta(element_info->density, (incident_energy + (T_real)0.1) * (T_real)1000.0);
+    beta = _calc_beta(element_info->name, element_info->density, (incident_energy + (T_real)0.1) * (T_real)1000.0, element_info);
     // stds in microgram/cm2
     // density rho = g/cm3 = 1 microgram/cm2 /1000/1000/cm = 1 microgram/cm2 /1000/1000/*10*1000/um = 1 microgram/cm2 /100/um
     // thickness for 1 ugr/cm2
@@ -175,11 +175,11 @@ void Quantification_Model<T_real>::init_element_quant(Element_Quant<T_real>& ele
 
     if(ev > 0)
     {
-        beta  = Element_Info_Map<T_real>::inst()->calc_beta("Be", (T_real)1.848, ev);
+        beta  = _calc_beta("Be", (T_real)1.848, ev);
         ////aux_arr[mm, 1] = self.transmission(self.maps_conf.fit_t_be, beta, 1239.852/ev)
         element_quant.transmission_Be = transmission(beryllium_window_thickness, beta, (T_real)1239.852 / ev);
 
-        beta  = Element_Info_Map<T_real>::inst()->calc_beta("Ge", (T_real)5.323, ev);
+        beta  = _calc_beta("Ge", (T_real)5.323, ev);
         ////aux_arr[mm, 2] = self.transmission(self.maps_conf.fit_t_ge, beta, 1239.852/ev)
         element_quant.transmission_Ge = transmission(germanium_dead_layer, beta, (T_real)1239.852 / ev);
     }
@@ -187,7 +187,7 @@ void Quantification_Model<T_real>::init_element_quant(Element_Quant<T_real>& ele
 
     if (detector_element->name == "Si" && detector_chip_thickness > 0.0 && ev > 0) //  (self.maps_conf.add_long['a'] == 1)
     {
-        beta  = Element_Info_Map<T_real>::inst()->calc_beta("Si", (T_real)2.3, ev);
+        beta  = _calc_beta("Si", (T_real)2.3, ev);
         element_quant.transmission_through_Si_detector = transmission(detector_chip_thickness, beta, (T_real)1239.852 / ev);
     }
     ////aux_arr[mm, 4] = self.transmission(self.maps_conf.add_float['a'], beta, 1239.852/ev)
@@ -205,7 +205,7 @@ void Quantification_Model<T_real>::init_element_quant(Element_Quant<T_real>& ele
         //air_ele = 'N78.08O20.95Ar0.93'
         //density = 1.2047e-3
         //f1, f2, delta, beta, graze_mrad, reflect, inverse_mu, atwt = Chenke.get_henke_single('air', density, ev)
-        beta = Element_Info_Map<T_real>::inst()->calc_beta("N:78.08,O:20.95,Ar:0.93", density, ev); // air
+        beta = _calc_beta("N:78.08,O:20.95,Ar:0.93", density, ev); // air
         ////aux_arr[mm, 5] = self.transmission(airpath*1000., beta, 1239.852/ev)  // airpath is read in microns, transmission function expects nm
         // airpath is read in microns, transmission function expects nm
         element_quant.transmission_through_air = transmission( airpath , beta, (T_real)1239.852 / ev);
@@ -219,6 +219,31 @@ void Quantification_Model<T_real>::init_element_quant(Element_Quant<T_real>& ele
 
 //-----------------------------------------------------------------------------
 
+template<typename T_real>
+T_real Quantification_Model<T_real>::_calc_beta(const std::string& name, T_real density, T_real energy, Element_Info<T_real>* element_info)
+{
+    const std::tuple<std::string, T_real, T_real> key(name, density, energy);
+    const auto itr = _beta_cache.find(key);
+    if (itr != _beta_cache.end())
+    {
+        return itr->second;
+    }
+
+    T_real beta;
+    if (element_info != nullptr)
+    {
+        beta = element_info->calc_beta(density, energy);
+    }
+    else
+    {
+        beta = Element_Info_Map<T_real>::inst()->calc_beta(name, density, energy);
+    }
+    _beta_cache.emplace(key, beta);
+    return beta;
+}
+
+//-----------------------------------------------------------------------------
+
 template<typename T_real>
 T_real Quantification_Model<T_real>::transmission(T_real thickness, T_real beta, T_real llambda) const
 {
@@ -240,7 +265,7 @@ T_real Quantification_Model<T_real>::absorption(T_real thickness, T_real beta, T
 //-----------------------------------------------------------------------------
 
 template<typename T_real>
-std::unordered_map<std::string, T_real> Quantification_Model<T_real>::model_calibrationcurve(std::unordered_map<std::string, Element_Quant<T_real>> quant_map, T_real p)
+T_real Quantification_Model<T_real>::calibration_coefficient(const Element_Quant<T_real>& quant) const
 {
     // aux_arr[mm, 0] = absorption
     // aux_arr[mm, 1] = transmission, Be
@@ -248,15 +273,43 @@ std::unordered_map<std::string, T_real> Quantification_Model<T_real>::model_cali
     // aux_arr[mm, 3] = yield
     // aux_arr[mm, 4] = transmission through Si detector
     // aux_arr[mm, 5] = transmission through  air (N2)
-//aux array[92, 6] (92 elements)
-    //aux_arr = self.aux_arr;
-//returns array size 3
-    //z_prime is array size 3 of element index of calibraion elements
-    //std::vector<T_real> result(aux_arr.size);
+    //return p[0] * aux_arr[z_prime, 0] * aux_arr[z_prime, 1] * aux_arr[z_prime, 2] * aux_arr[z_prime, 3] * ( 1. - aux_arr[z_prime, 4]) * aux_arr[z_prime, 5];
+    return quant.absorption * quant.transmission_Be * quant.transmission_Ge * quant.yield * ((T_real)1. - quant.transmission_through_Si_detector) * quant.transmission_through_air;
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Quantification_Model<T_real>::calibration_coefficients(const std::unordered_map<std::string, Element_Quant<T_real>*>& quant_map, ArrayTr<T_real>& out_coefs, ArrayTr<T_real>& out_e_cal_ratios) const
+{
+    out_coefs.resize(quant_map.size());
+    out_e_cal_ratios.resize(quant_map.size());
+    Eigen::Index idx = 0;
+    for (const auto& itr : quant_map)
+    {
+        out_coefs(idx) = calibration_coefficient(*(itr.second));
+        out_e_cal_ratios(idx) = itr.second->e_cal_ratio;
+        idx++;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+void Quantification_Model<T_real>::model_calibrationcurve(const ArrayTr<T_real>& coefs, T_real p, ArrayTr<T_real>& out_curve) const
+{
+    out_curve = (p * coefs).unaryExpr([](T_real v) { return std::isfinite(v) ? v : (T_real)0.0; });
+}
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+std::unordered_map<std::string, T_real> Quantification_Model<T_real>::model_calibrationcurve(const std::unordered_map<std::string, Element_Quant<T_real>>& quant_map, T_real p)
+{
     std::unordered_map<std::string, T_real> result_map;
-    for(auto& itr : quant_map)
+    for(const auto& itr : quant_map)
     {
-        T_real val = p * itr.second.absorption * itr.second.transmission_Be * itr.second.transmission_Ge * itr.second.yield * ((T_real)1. - itr.second.transmission_through_Si_detector) * itr.second.transmission_through_air;
+        T_real val = p * calibration_coefficient(itr.second);
         if(false == std::isfinite(val))
         {
             val = 0;
@@ -265,7 +318,6 @@ std::unordered_map<std::string, T_real> Quantification_Model<T_real>::model_cali
     }
 
     return result_map;
-    //return p[0] * aux_arr[z_prime, 0] * aux_arr[z_prime, 1] * aux_arr[z_prime, 2] * aux_arr[z_prime, 3] * ( 1. - aux_arr[z_prime, 4]) * aux_arr[z_prime, 5];
 }
 
 //-----------------------------------------------------------------------------
@@ -273,14 +325,16 @@ std::unordered_map<std::string, T_real> Quantification_Model<T_real>::model_cali
 template<typename T_real>
 void Quantification_Model<T_real>::model_calibrationcurve(std::vector<Element_Quant<T_real>> *quant_vec, T_real p)
 {
-    for(auto &itr : *quant_vec)
+    ArrayTr<T_real> coefs(quant_vec->size());
+    for (size_t i = 0; i < quant_vec->size(); i++)
     {
-        T_real val = p * itr.absorption * itr.transmission_Be * itr.transmission_Ge * itr.yield * ((T_real)1. - itr.transmission_through_Si_detector) * itr.transmission_through_air;
-        if (false == std::isfinite(val))
-        {
-            val = 0;
-        }
-        itr.calib_curve_val = val;
+        coefs(i) = calibration_coefficient((*quant_vec)[i]);
+    }
+    ArrayTr<T_real> curve;
+    model_calibrationcurve(coefs, p, curve);
+    for (size_t i = 0; i < quant_vec->size(); i++)
+    {
+        (*quant_vec)[i].calib_curve_val = curve(i);
     }
 }
 
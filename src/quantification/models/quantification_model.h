@@ -54,9 +54,12 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 #include <unordered_map>
+#include <map>
+#include <tuple>
 
 #include "data_struct/element_info.h"
 #include "data_struct/element_quant.h"
+#include "data_struct/spectra.h"
 
 namespace quantification
 {
@@ -104,12 +107,27 @@ public:
 
     T_real absorption(T_real thickness, T_real beta, T_real llambda, T_real shell_factor=1) const;
 
-    std::unordered_map<std::string, T_real> model_calibrationcurve(std::unordered_map<std::string, Element_Quant<T_real>> quant_map, T_real p);
+    /// \brief absorption * transmissions * yield of one element. The calibration curve is p * this so it only changes with the beamline parameters.
+    T_real calibration_coefficient(const Element_Quant<T_real>& quant) const;
+
+    /// \brief Flatten quant_map into per element calibration coefficients and e_cal ratios, in the map's iteration order.
+    void calibration_coefficients(const std::unordered_map<std::string, Element_Quant<T_real>*>& quant_map, ArrayTr<T_real>& out_coefs, ArrayTr<T_real>& out_e_cal_ratios) const;
+
+    /// \brief Calibration curve for all elements at once: p * coefs with non finite values set to 0.
+    void model_calibrationcurve(const ArrayTr<T_real>& coefs, T_real p, ArrayTr<T_real>& out_curve) const;
+
+    std::unordered_map<std::string, T_real> model_calibrationcurve(const std::unordered_map<std::string, Element_Quant<T_real>>& quant_map, T_real p);
 
     void model_calibrationcurve(std::vector<Element_Quant<T_real>>* quant_vec, T_real p);
 
 protected:
 
+    /// \brief calc_beta memoized on (name, density, energy). update_element_quants asks for the same incident and line
+    /// energies for every scaler, fit routine and standard. element_info is used directly when given, else the name is looked up.
+    T_real _calc_beta(const std::string& name, T_real density, T_real energy, Element_Info<T_real>* element_info = nullptr);
+
+    std::map<std::tuple<std::string, T_real, T_real>, T_real> _beta_cache;
+
 };
 
 TEMPLATE_CLASS_DLL_EXPORT Quantification_Model<float>;
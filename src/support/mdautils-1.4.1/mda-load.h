@@ -167,6 +167,7 @@ struct mda_fileinfo
 /******************************************************/
 
 struct mda_file *mda_load( FILE *fptr);
+struct mda_file *mda_load_levels( FILE *fptr, int levels);
 struct mda_header *mda_header_load( FILE *fptr);
 struct mda_scan *mda_scan_load( FILE *fptr);
 struct mda_scan *mda_subscan_load( FILE *fptr, int depth, int *indices, 
@@ -266,8 +266,11 @@ static struct mda_trigger *trigger_read(XDR *xdrs)
 /* it can be turned off by making recursive 0, the rank says what */
 /* the file structure thinks this scan rank is to do error checking, */
 /* test_flag switches to not allocating memory for data */
-static struct mda_scan *scan_read(XDR *xdrs, enum recurse_option recurse_flag, 
-                                  int rank, enum test_option test_flag)
+// reads scans down to min_rank, lower scans are left NULL
+static struct mda_scan *scan_read_levels(XDR *xdrs, 
+                                         enum recurse_option recurse_flag, 
+                                         int rank, enum test_option test_flag,
+                                         int min_rank)
 {
   struct mda_scan *scan;
  
@@ -415,7 +418,7 @@ static struct mda_scan *scan_read(XDR *xdrs, enum recurse_option recurse_flag,
       free(det);
     }
 
-  if( (scan->scan_rank > 1) && (recurse_flag == RECURSE))
+  if( (scan->scan_rank > min_rank) && (recurse_flag == RECURSE))
     {
       scan->sub_scans = 
 	calloc( scan->requested_points, sizeof( struct mda_scan *) );
@@ -431,8 +434,9 @@ static struct mda_scan *scan_read(XDR *xdrs, enum recurse_option recurse_flag,
               if( !xdr_setpos( xdrs,scan->offsets[i] ) )
                 return mda_scan_unload( scan), NULL;
             }
-          scan->sub_scans[i] = scan_read(xdrs, recurse_flag, 
-                                         scan->scan_rank - 1, test_flag);
+          scan->sub_scans[i] = scan_read_levels(xdrs, recurse_flag, 
+                                                scan->scan_rank - 1, test_flag,
+                                                min_rank);
           // if a subscan beyond last point is read, allow to fail
           // as it is considered an unfinished scan
           if( (i < scan->last_point) && (scan->sub_scans[i] == NULL) )
@@ -446,6 +450,13 @@ static struct mda_scan *scan_read(XDR *xdrs, enum recurse_option recurse_flag,
 }
 
 
+static struct mda_scan *scan_read(XDR *xdrs, enum recurse_option recurse_flag, 
+                                  int rank, enum test_option test_flag)
+{
+  return scan_read_levels( xdrs, recurse_flag, rank, test_flag, 1);
+}
+
+
 
 
 static struct mda_pv *pv_read(XDR *xdrs)
@@ -582,7 +593,9 @@ static struct mda_extra *extra_read(XDR *xdrs)
 
 
 
-static struct mda_file *mda_load_full( FILE *fptr, enum test_option test_flag)
+// levels < 1 loads every scan level
+static struct mda_file *mda_load_full( FILE *fptr, enum test_option test_flag,
+                                       int levels)
 {
 #ifndef XDR_HACK
   XDR xdrs;
@@ -606,11 +619,16 @@ static struct mda_file *mda_load_full( FILE *fptr, enum test_option test_flag)
   if( (mda = calloc( 1, sizeof(struct mda_file))) == NULL)
     goto Load_Error;
 
-  if( ((mda->header = header_read( xdrstream)) == NULL) ||
-      ((mda->scan = scan_read( xdrstream, RECURSE, mda->header->data_rank, 
-                               test_flag)) == NULL) )
-        goto Load_Error;
-  for( scan = mda->scan, i = 0; i < (mda->header->data_rank - 1); i++)
+  if( (mda->header = header_read( xdrstream)) == NULL)
+    goto Load_Error;
+  if( (levels < 1) || (levels > mda->header->data_rank) )
+    levels = mda->header->data_rank;
+  if( (mda->scan = scan_read_levels( xdrstream, RECURSE, 
+                                     mda->header->data_rank, test_flag,
+                                     mda->header->data_rank - levels + 1)) 
+      == NULL)
+    goto Load_Error;
+  for( scan = mda->scan, i = 0; i < (levels - 1); i++)
     {
       if( scan == NULL)
         goto Load_Error;
@@ -641,14 +659,21 @@ static struct mda_file *mda_load_full( FILE *fptr, enum test_option test_flag)
 
 struct mda_file *mda_load( FILE *fptr)
 {
-  return mda_load_full( fptr, NOTEST);
+  return mda_load_full( fptr, NOTEST, 0);
+}
+
+/* Loads the header, extra PV's and only the outer "levels" scan levels,
+   so the scalers of a scan can be read without its detector spectra. */
+struct mda_file *mda_load_levels( FILE *fptr, int levels)
+{
+  return mda_load_full( fptr, NOTEST, levels);
 }
 
 int mda_test( FILE *fptr)
 {
   struct mda_file *mda;
 
-  mda = mda_load_full( fptr, TEST);
+  mda = mda_load_full( fptr, TEST, 0);
   if( mda == NULL)
     return 1;
   else
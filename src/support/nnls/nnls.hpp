@@ -25,6 +25,7 @@
 // Argonne National Lab
 // Dec 2017 : Modified to make it template class and use Eigen data structures
 #include <Eigen/Core>
+#include "core/cpu_dispatch.h"
 
 namespace nsNNLS 
 {
@@ -273,12 +274,24 @@ namespace nsNNLS
 
 		void computeObjGrad()
 		{
-			ax = (*A) * x.matrix();
-			ax -= (*b);        // ax = ax - b
-			_T d = (ax*ax).sum();
+			// column by column with the cpu dispatched kernels, A is column major
+			const CPU_Kernels<_T>& kernels = cpu_kernels<_T>();
+			const size_t rows = A->rows();
+			ax = -(*b);        // ax = A*x - b
+			for (long int j = 0; j < A->cols(); j++)
+			{
+				if (x[j] != 0)
+				{
+					kernels.axpy(ax.data(), x[j], A->col(j).data(), rows);
+				}
+			}
+			_T d = kernels.dot(ax.data(), ax.data(), rows);
 			d = std::sqrt(d);
 			out.obj[out.iter] =  (0.5 * d * d);
-			gradient = A->transpose() * ax.matrix(); // A'(ax)
+			for (long int j = 0; j < A->cols(); j++)
+			{
+				gradient[j] = kernels.dot(A->col(j).data(), ax.data(), rows); // A'(ax)
+			}
 		}
 
 		_T computeBBStep()
@@ -288,21 +301,16 @@ namespace nsNNLS
 			_T nr = 0.0;
 			_T dr = 0.0;
 
+			const CPU_Kernels<_T>& kernels = cpu_kernels<_T>();
 			if (out.iter % 2) 
 			{
-				for (int i = 0; i < xdelta.size(); i++)
-				{
-					nr += xdelta[i] * xdelta[i];
-					dr += xdelta[i] * gdelta[i];
-				}
+				nr = kernels.dot(xdelta.data(), xdelta.data(), xdelta.size());
+				dr = kernels.dot(xdelta.data(), gdelta.data(), xdelta.size());
 			}
 			else 
 			{
-				for (int i = 0; i < xdelta.size(); i++)
-				{
-					nr += xdelta[i] * gdelta[i];
-					dr += gdelta[i] * gdelta[i];
-				}
+				nr = kernels.dot(xdelta.data(), gdelta.data(), xdelta.size());
+				dr = kernels.dot(gdelta.data(), gdelta.data(), xdelta.size());
 			}
 
 			//fprintf(stderr, " nr / dr = %lf / %lf\n", nr, dr);
@@ -77,7 +77,7 @@ void Spectra_Stream_Saver<T_real>::save_stream(data_struct::Stream_Block<T_real>
 {
 
     size_t d_hash = stream_block->dataset_hash();
-    size_t detector_num = stream_block->detector_number();
+    int detector_num = stream_block->detector_number();
 
 
     if (stream_block->is_end_block())
@@ -86,6 +86,7 @@ void Spectra_Stream_Saver<T_real>::save_stream(data_struct::Stream_Block<T_real>
         {
             Dataset_Save* dataset = _dataset_map.at(d_hash);
             _finalize_dataset(dataset);
+            _dataset_map.erase(d_hash);
         }
     }
     else
@@ -117,26 +118,11 @@ void Spectra_Stream_Saver<T_real>::save_stream(data_struct::Stream_Block<T_real>
 
                 if (detector->last_row > -1 && stream_block->row() > (size_t)detector->last_row)
                 {
-                    io::file::HDF5_IO::inst()->save_stream_row(d_hash, detector_num, detector->last_row, &detector->spectra_line);
-                    for (size_t i = 0; i < detector->spectra_line.size(); i++)
-                    {
-                        if (detector->spectra_line[i] != nullptr)
-                        {
-                            delete detector->spectra_line[i];
-                            detector->spectra_line[i] = nullptr;
-                        }
-                    }
+                    _save_line(dataset, detector_num, detector);
                 }
 
-                detector->last_row = stream_block->row();
                 detector->integrated_spectra.add(*stream_block->spectra);
-                //TODO: add limit checks to spectra_line
-                if (detector->spectra_line[stream_block->col()] != nullptr)
-                {
-                    delete detector->spectra_line[stream_block->col()];
-                }
-                detector->spectra_line[stream_block->col()] = stream_block->spectra;
-                stream_block->spectra = nullptr;
+                _add_to_line(detector, stream_block);
             }
         }
     }
@@ -148,8 +134,15 @@ template<typename T_real>
 void Spectra_Stream_Saver<T_real>::_new_dataset(size_t d_hash, data_struct::Stream_Block<T_real>* stream_block)
 {
     Dataset_Save *dataset = new Dataset_Save();
-    dataset->dataset_directory = stream_block->dataset_directory;
-    dataset->dataset_name = stream_block->dataset_name;
+    dataset->d_hash = d_hash;
+    if (stream_block->dataset_directory != nullptr)
+    {
+        dataset->dataset_directory = *stream_block->dataset_directory;
+    }
+    if (stream_block->dataset_name != nullptr)
+    {
+        dataset->dataset_name = *stream_block->dataset_name;
+    }
     _dataset_map.insert( {d_hash, dataset} );
     _new_detector(dataset, stream_block);
 }
@@ -163,12 +156,73 @@ void Spectra_Stream_Saver<T_real>::_new_detector(Dataset_Save *dataset, data_str
     dataset->detector_map.insert( { stream_block->detector_number(), detector } );
 
     detector->integrated_spectra = *stream_block->spectra;
-    detector->spectra_line[stream_block->col()] = stream_block->spectra;
 
+    io::file::HDF5_IO::inst()->generate_stream_dataset<T_real>(dataset->dataset_directory, dataset->dataset_name, dataset->d_hash, stream_block->detector_number(), stream_block->height(), stream_block->width(), stream_block->spectra->size());
+
+    _add_to_line(detector, stream_block);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Spectra_Stream_Saver<T_real>::_add_to_line(Detector_Save *detector, data_struct::Stream_Block<T_real>* stream_block)
+{
+    size_t col = stream_block->col();
+    if (col >= detector->spectra_line.size())
+    {
+        logW << "Column " << col << " is out of range of width " << detector->spectra_line.size() << ". Skipping.\n";
+        return;
+    }
+
+    detector->last_row = stream_block->row();
+
+    if (detector->spectra_line[col] != nullptr)
+    {
+        delete detector->spectra_line[col];
+    }
+    detector->spectra_line[col] = stream_block->spectra;
     //release ownership
     stream_block->spectra = nullptr;
 
-    io::file::HDF5_IO::inst()->generate_stream_dataset(*dataset->dataset_directory, *dataset->dataset_name, stream_block->detector_number(), stream_block->height(), stream_block->width());
+    for (const auto& itr : stream_block->fitting_blocks)
+    {
+        if (itr.second.fit_routine == nullptr)
+        {
+            continue;
+        }
+        data_struct::Fit_Count_Dict<T_real>& fit_counts = detector->fit_counts_line[itr.second.fit_routine->get_name()];
+        for (const auto& el_itr : itr.second.fit_counts)
+        {
+            if (fit_counts.count(el_itr.first) < 1)
+            {
+                fit_counts[el_itr.first] = data_struct::ArrayXXr<T_real>::Zero(1, detector->spectra_line.size());
+            }
+            fit_counts.at(el_itr.first)(0, col) = el_itr.second;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename T_real>
+void Spectra_Stream_Saver<T_real>::_save_line(Dataset_Save *dataset, int detector_num, Detector_Save *detector)
+{
+    io::file::HDF5_IO::inst()->save_stream_row(dataset->d_hash, detector_num, detector->last_row, &detector->spectra_line, &detector->fit_counts_line);
+    for (size_t i = 0; i < detector->spectra_line.size(); i++)
+    {
+        if (detector->spectra_line[i] != nullptr)
+        {
+            delete detector->spectra_line[i];
+            detector->spectra_line[i] = nullptr;
+        }
+    }
+    for (auto& itr : detector->fit_counts_line)
+    {
+        for (auto& el_itr : itr.second)
+        {
+            el_itr.second.setZero();
+        }
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -184,14 +238,18 @@ void Spectra_Stream_Saver<T_real>::_finalize_dataset(Dataset_Save* dataset)
             //save and close hdf5 for this detector
             if (detector != nullptr)
             {
-                io::file::HDF5_IO::inst()->save_itegrade_spectra(&detector->integrated_spectra);
+                // last row never sees a following row so save it now
+                if (detector->last_row > -1)
+                {
+                    _save_line(dataset, itr.first, detector);
+                }
+                io::file::HDF5_IO::inst()->save_itegrade_spectra(dataset->d_hash, itr.first, &detector->integrated_spectra);
                 ///io::file::HDF5_IO::inst()->save_scan_scalers(detector_num, stream_block->mda_io, params_override, false);
-                //io::file::HDF5_IO::inst()->close_dataset(d_hash);
             }
-            ///delete stream_block->mda_io;
             delete detector;
         }
         dataset->detector_map.clear();
+        io::file::HDF5_IO::inst()->close_dataset(dataset->d_hash);
         delete dataset;
     }
 }
@@ -100,6 +100,8 @@ protected:
         int last_row;
         data_struct::Spectra<T_real> integrated_spectra;
         std::vector< data_struct::Spectra<T_real>* > spectra_line;
+        //by fit routine name, each element is 1 x width
+        std::unordered_map<std::string, data_struct::Fit_Count_Dict<T_real> > fit_counts_line;
     };
 
     class Dataset_Save
@@ -108,16 +110,6 @@ protected:
         Dataset_Save(){}
         ~Dataset_Save()
         {
-            if (dataset_directory != nullptr)
-            {
-                delete dataset_directory;
-            }
-            dataset_directory = nullptr;
-            if (dataset_name != nullptr)
-            {
-                delete dataset_name;
-            }
-            dataset_name = nullptr;
             for(auto& itr : detector_map)
             {
                 if (itr.second != nullptr)
@@ -128,8 +120,10 @@ protected:
             detector_map.clear();
         }
 
-        std::string *dataset_directory;
-        std::string *dataset_name;
+        size_t d_hash;
+        // copies, the stream block strings are owned by the source
+        std::string dataset_directory;
+        std::string dataset_name;
         //by detector_num
         std::map<int, Detector_Save*> detector_map;
     };
@@ -138,6 +132,10 @@ protected:
 
     void _new_detector(Dataset_Save *dataset, data_struct::Stream_Block<T_real>* stream_block);
 
+    void _add_to_line(Detector_Save *detector, data_struct::Stream_Block<T_real>* stream_block);
+
+    void _save_line(Dataset_Save *dataset, int detector_num, Detector_Save *detector);
+
     void _finalize_dataset(Dataset_Save *dataset);
 
     //by detector_dir + dataset hash
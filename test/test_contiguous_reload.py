@@ -0,0 +1,66 @@
+
+# Fits a dataset twice so the second fit reloads the spectra volume from the img.dat file XRF-Maps wrote.
+# With --spectra-compression none mca_arr is stored contiguous and reloaded through a file mapping, with
+# deflate it is chunked and reloaded with H5Dread. Both reloads have to give the same element maps.
+# Run from the test directory, set XRF_MAPS_BIN if xrf_maps is not in ../bin
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import h5py
+import numpy as np
+
+xrf_maps_bin = os.environ.get('XRF_MAPS_BIN', os.path.join('..', 'bin', 'xrf_maps'))
+dataset_src = '2_ID_E_dataset'
+dataset_file = '2xfm_0011.mda'
+contiguous_log = 'Read contiguous mca_arr through a file mapping'
+map_paths = ['/MAPS/XRF_Analyzed/ROI/Counts_Per_Sec', '/MAPS/XRF_Analyzed/NNLS/Counts_Per_Sec']
+
+def run_fit(dataset_dir, compression):
+	args = [xrf_maps_bin, '--dir', dataset_dir, '--fit', 'roi,nnls', '--files', dataset_file, '--detectors', '0', '--spectra-compression', compression]
+	proc = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+	return proc.returncode, proc.stdout
+
+def fit_and_reload(tmp_dir, compression):
+	dataset_dir = os.path.join(tmp_dir, compression.replace(':', '_'), dataset_src)
+	shutil.copytree(dataset_src, dataset_dir)
+	h5_path = os.path.join(dataset_dir, 'img.dat', dataset_file + '.h50')
+	ret, out = run_fit(dataset_dir, compression)
+	if ret != 0 or not os.path.exists(h5_path):
+		print(out)
+		print('First fit failed with --spectra-compression ' + compression)
+		return None, None
+	ret, out = run_fit(dataset_dir, compression)
+	if ret != 0:
+		print(out)
+		print('Reload failed with --spectra-compression ' + compression)
+		return None, None
+	maps = {}
+	with h5py.File(h5_path, 'r') as h5:
+		for path in map_paths:
+			maps[path] = h5[path][...]
+	return maps, contiguous_log in out
+
+def test_contiguous_reload():
+	tmp_dir = tempfile.mkdtemp()
+	try:
+		contiguous_maps, contiguous_read = fit_and_reload(tmp_dir, 'none')
+		chunked_maps, chunked_read = fit_and_reload(tmp_dir, 'deflate:1')
+	finally:
+		shutil.rmtree(tmp_dir)
+	if contiguous_maps is None or chunked_maps is None:
+		return False
+	if False == contiguous_read or chunked_read:
+		print('Expected the contiguous read only for the uncompressed volume')
+		return False
+	for path in map_paths:
+		if contiguous_maps[path].shape != chunked_maps[path].shape or False == np.array_equal(contiguous_maps[path], chunked_maps[path]):
+			print(path + ' differs between the contiguous and H5Dread reloads')
+			return False
+	print('Contiguous and H5Dread reloads give the same element maps')
+	return True
+
+if __name__ == '__main__':
+	sys.exit(0 if test_contiguous_reload() else 1)
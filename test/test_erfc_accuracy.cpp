@@ -0,0 +1,120 @@
+/***
+Copyright (c) 2016, UChicago Argonne, LLC. All rights reserved.
+
+Copyright 2016. UChicago Argonne, LLC. This software was produced
+under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+U.S. Department of Energy. The U.S. Government has rights to use,
+reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+modified to produce derivative works, such modified software should
+be clearly marked, so as not to confuse it with the version available
+from ANL.
+
+Additionally, redistribution and use in source and binary forms, with
+or without modification, are permitted provided that the following
+conditions are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the name of UChicago Argonne, LLC, Argonne National
+      Laboratory, ANL, the U.S. Government, nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+***/
+
+// Max relative error of the erfc kernel against std::erfc over the arguments the line shapes pass it.
+// Returns non zero if a precision is outside its bound.
+
+#include "core/cpu_dispatch.h"
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+
+// step and tail erfc's get (energy - peak) / (sigma * sqrt(2)) plus the tail offset, far from the peak they are
+// large either way, so cover well past where erfc reaches 2 or underflows
+const double ARG_MIN = -30.0;
+const double ARG_MAX = 30.0;
+const size_t NUM_ARGS = 600001;
+
+//-----------------------------------------------------------------------------
+
+template<typename T_real>
+bool check_erfc(const char* name, double max_rel_err)
+{
+    std::vector<T_real> x(NUM_ARGS);
+    std::vector<T_real> out(NUM_ARGS);
+    for (size_t i = 0; i < NUM_ARGS; i++)
+    {
+        x[i] = (T_real)(ARG_MIN + ((ARG_MAX - ARG_MIN) * (double)i / (double)(NUM_ARGS - 1)));
+    }
+    cpu_kernels<T_real>().erfc(out.data(), x.data(), NUM_ARGS);
+
+    // relative error while erfc is a normal number of this precision, below that it only has to stay under it
+    const double smallest = (double)std::numeric_limits<T_real>::min();
+    double worst_rel = 0.0;
+    double worst_arg = 0.0;
+    bool ret = true;
+    for (size_t i = 0; i < NUM_ARGS; i++)
+    {
+        double expected = std::erfc((double)x[i]);
+        double actual = (double)out[i];
+        if (false == std::isfinite(actual))
+        {
+            std::cout << name << " erfc(" << x[i] << ") = " << actual << "\n";
+            ret = false;
+        }
+        else if (expected >= smallest)
+        {
+            double rel = std::abs(actual - expected) / expected;
+            if (rel > worst_rel)
+            {
+                worst_rel = rel;
+                worst_arg = (double)x[i];
+            }
+        }
+        else if (std::abs(actual) >= smallest)
+        {
+            std::cout << name << " erfc(" << x[i] << ") = " << actual << ", expected below " << smallest << "\n";
+            ret = false;
+        }
+    }
+
+    std::cout << name << " " << cpu_path_name(cpu_path()) << " max relative error " << worst_rel << " at " << worst_arg << " (bound " << max_rel_err << ")\n";
+    return ret && worst_rel <= max_rel_err;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    // float: the Chebyshev fit is good to 1.2e-7, exp(-x * x) in float adds up to a few 1e-6 near underflow
+    bool float_ok = check_erfc<float>("float", 1.0e-5);
+    // double: cephes is good to a few ulp, exp(-x * x) adds up to ~6e-14 before erfc underflows
+    bool double_ok = check_erfc<double>("double", 1.0e-13);
+
+    return (float_ok && double_ok) ? 0 : 1;
+}